@@ -0,0 +1,507 @@
+/** @file
+
+    Ahead of time code generation for key-cmd, producing a C function for each Key, e.g.
+
+        key-cmd --emit-c "Accept-Encoding;substr=gzip" "User-Agent;match=Mobile" > keys.c
+
+    The generated functions evaluate their Key exactly like http_key_eval() does, but with the
+    header fetches unrolled and the parameter values (MATCH and SUBSTR strings, DIV dividers, PREFER
+    codings) compiled in as constants. The generated key_compiled_register() registers all of them
+    with http_key_register().
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <stdio.h>
+#include <ctype.h>
+#include <inttypes.h>
+
+#include "key-cmd.h"
+#include "include/platform.h"
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+/* The helpers the generated functions use, one line per string. These are copies of the library
+   internals, since the generated code must only depend on the public API. */
+static const char *g_preamble[] = {
+    "/* Generated by key-cmd --emit-c, do not edit.\n",
+    "\n",
+    "   Each function evaluates one Key exactly like http_key_eval() does, and key_compiled_register()\n",
+    "   registers all of them with http_key_register(). */\n",
+    "#ifndef _GNU_SOURCE\n",
+    "#define _GNU_SOURCE /* memmem() */\n",
+    "#endif\n",
+    "#include <ctype.h>\n",
+    "#include <string.h>\n",
+    "#include <strings.h>\n",
+    "\n",
+    "#include <http/key.h>\n",
+    "\n",
+    "int key_compiled_register(http_key_t *key);\n",
+    "\n",
+    "/* Same as key_strsep() in the library */\n",
+    "static inline size_t\n",
+    "key_compiled_token(const char *value, size_t value_len, const char **start, const char **next, char separator)\n",
+    "{\n",
+    "    const char *end;\n",
+    "\n",
+    "    while ((*start < value + value_len) && isspace(**start)) {\n",
+    "        ++*start;\n",
+    "    }\n",
+    "    if (*start >= value + value_len) {\n",
+    "        return 0;\n",
+    "    }\n",
+    "    if ((*next = memchr(*start, separator, value_len - (*start - value)))) {\n",
+    "        end = *next - 1;\n",
+    "    } else {\n",
+    "        end = *next = value + value_len - 1;\n",
+    "    }\n",
+    "    while ((end > *start) && isspace(*end)) {\n",
+    "        --end;\n",
+    "    }\n",
+    "    ++*next;\n",
+    "\n",
+    "    return end - *start + 1;\n",
+    "}\n",
+    "\n",
+    "/* Same as key_empty_item_before() in the library */\n",
+    "static inline int\n",
+    "key_compiled_empty_before(const char *value, const char *pos)\n",
+    "{\n",
+    "    const char *item = value;\n",
+    "\n",
+    "    while (item < pos) {\n",
+    "        while ((item < pos) && isspace(*item)) {\n",
+    "            ++item;\n",
+    "        }\n",
+    "        if ((item < pos) && (',' == *item)) {\n",
+    "            return 1;\n",
+    "        }\n",
+    "        if (!(item = memchr(item, ',', pos - item))) {\n",
+    "            return 0;\n",
+    "        }\n",
+    "        ++item;\n",
+    "    }\n",
+    "\n",
+    "    return 0;\n",
+    "}\n",
+    "\n",
+    "/* Same as key_memtoll() in the library */\n",
+    "static inline uint64_t\n",
+    "key_compiled_memtoll(const char *str, size_t len)\n",
+    "{\n",
+    "    uint64_t ret = 0;\n",
+    "\n",
+    "    while ((len > 0) && isspace(*str)) {\n",
+    "        --len, ++str;\n",
+    "    }\n",
+    "    while ((len-- > 0) && isdigit(*str)) {\n",
+    "        ret = ret * 10 + *str++ - '0';\n",
+    "    }\n",
+    "\n",
+    "    return ret;\n",
+    "}\n",
+    "\n",
+    "/* Same as key_print_uint() in the library */\n",
+    "static inline size_t\n",
+    "key_compiled_uint(uint64_t value, char *buf, size_t buf_len)\n",
+    "{\n",
+    "    char digits[20];\n",
+    "    size_t len = 0;\n",
+    "\n",
+    "    do {\n",
+    "        digits[len++] = '0' + (value % 10);\n",
+    "        value /= 10;\n",
+    "    } while (value);\n",
+    "\n",
+    "    if (len > buf_len) {\n",
+    "        return 0;\n",
+    "    }\n",
+    "    for (size_t i = 0; i < len; ++i) {\n",
+    "        buf[i] = digits[len - i - 1];\n",
+    "    }\n",
+    "\n",
+    "    return len;\n",
+    "}\n",
+    "\n",
+    "static inline int\n",
+    "key_compiled_none(char *buf, size_t buf_size, size_t *pos)\n",
+    "{\n",
+    "    if ((buf_size - *pos) < 4) {\n",
+    "        return 0;\n",
+    "    }\n",
+    "    memcpy(buf + *pos, \"none\", 4);\n",
+    "    *pos += 4;\n",
+    "\n",
+    "    return 1;\n",
+    "}\n",
+    "\n",
+    "/* Same as key_qvalue() in the library */\n",
+    "static inline int\n",
+    "key_compiled_qvalue(const char *str, size_t len)\n",
+    "{\n",
+    "    int q, scale = 1000;\n",
+    "\n",
+    "    if ((len == 0) || ((*str != '0') && (*str != '1'))) {\n",
+    "        return -1;\n",
+    "    }\n",
+    "    q = (*str++ - '0') * 1000;\n",
+    "    if (--len > 0) {\n",
+    "        if (*str++ != '.') {\n",
+    "            return -1;\n",
+    "        }\n",
+    "        --len;\n",
+    "        while ((len > 0) && (scale > 1) && isdigit(*str)) {\n",
+    "            scale /= 10;\n",
+    "            q += (*str++ - '0') * scale;\n",
+    "            --len;\n",
+    "        }\n",
+    "        if (len > 0) {\n",
+    "            return -1;\n",
+    "        }\n",
+    "    }\n",
+    "\n",
+    "    return q > 1000 ? 1000 : q;\n",
+    "}\n",
+    "\n",
+    "/* Same as key_eval_prefer() in the library, the codings are lower case */\n",
+    "static inline size_t\n",
+    "key_compiled_prefer(const char *value, size_t value_len, const char *const *codings, const size_t *coding_lens,\n",
+    "                    size_t num_codings, char *buf, size_t buf_size)\n",
+    "{\n",
+    "    const char *token_start = value;\n",
+    "    const char *token_next = NULL;\n",
+    "    size_t token_len;\n",
+    "    int qvalues[HTTP_KEY_MAX_PREFER];\n",
+    "    int star = -1, best_q = 0;\n",
+    "    size_t best = 0;\n",
+    "\n",
+    "    for (size_t i = 0; i < num_codings; ++i) {\n",
+    "        qvalues[i] = -1;\n",
+    "    }\n",
+    "    while ((token_len = key_compiled_token(value, value_len, &token_start, &token_next, ',')) > 0) {\n",
+    "        const char *semi = memchr(token_start, ';', token_len);\n",
+    "        size_t coding_len = semi ? (size_t)(semi - token_start) : token_len;\n",
+    "        int q = 1000;\n",
+    "\n",
+    "        while ((coding_len > 0) && isspace(token_start[coding_len - 1])) {\n",
+    "            --coding_len;\n",
+    "        }\n",
+    "        if (semi) {\n",
+    "            const char *qparam_start = semi + 1;\n",
+    "            const char *qparam_next = NULL;\n",
+    "            size_t qparams_len = token_len - (qparam_start - token_start);\n",
+    "            size_t qparam_len;\n",
+    "\n",
+    "            while ((qparam_len = key_compiled_token(semi + 1, qparams_len, &qparam_start, &qparam_next, ';')) > 0) {\n",
+    "                if ((qparam_len > 2) && (tolower(*qparam_start) == 'q') && (qparam_start[1] == '=')) {\n",
+    "                    q = key_compiled_qvalue(qparam_start + 2, qparam_len - 2);\n",
+    "                }\n",
+    "                qparam_start = qparam_next;\n",
+    "            }\n",
+    "        }\n",
+    "        if (q >= 0) {\n",
+    "            if ((coding_len == 1) && (*token_start == '*')) {\n",
+    "                star = q;\n",
+    "            } else {\n",
+    "                for (size_t i = 0; i < num_codings; ++i) {\n",
+    "                    if ((coding_len == coding_lens[i]) && (qvalues[i] < 0) &&\n",
+    "                        !strncasecmp(token_start, codings[i], coding_len)) {\n",
+    "                        qvalues[i] = q;\n",
+    "                        break;\n",
+    "                    }\n",
+    "                }\n",
+    "            }\n",
+    "        }\n",
+    "        token_start = token_next;\n",
+    "    }\n",
+    "\n",
+    "    for (size_t i = 0; i < num_codings; ++i) {\n",
+    "        int q = qvalues[i] >= 0 ? qvalues[i] : star;\n",
+    "\n",
+    "        if (q > best_q) {\n",
+    "            best_q = q;\n",
+    "            best = i + 1;\n",
+    "        }\n",
+    "    }\n",
+    "\n",
+    "    return key_compiled_uint(best, buf, buf_size);\n",
+    "}\n",
+    NULL,
+};
+
+/* Emit a C string literal. The ? is escaped as well, since -std=c11 enables trigraphs. */
+static void
+emit_string(FILE *fp, const char *str, size_t len)
+{
+    fputc('"', fp);
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = str[i];
+
+        if ((c == '"') || (c == '\\') || (c == '?')) {
+            fprintf(fp, "\\%c", c);
+        } else if ((c >= 0x20) && (c < 0x7f)) {
+            fputc(c, fp);
+        } else {
+            fprintf(fp, "\\%03o", c);
+        }
+    }
+    fputc('"', fp);
+}
+
+/* The same as key_strsep() in the library, for splitting the PREFER codings */
+static size_t
+emit_token(const char *value, size_t value_len, const char **start, const char **next, char separator)
+{
+    const char *end;
+
+    while ((*start < value + value_len) && isspace(**start)) {
+        ++*start;
+    }
+    if (*start >= value + value_len) {
+        return 0;
+    }
+    if ((*next = memchr(*start, separator, value_len - (*start - value)))) {
+        end = *next - 1;
+    } else {
+        end = *next = value + value_len - 1;
+    }
+    while ((end > *start) && isspace(*end)) {
+        --end;
+    }
+    ++*next;
+
+    return end - *start + 1;
+}
+
+/* The evaluation of one parameter, when the header is present and there's room for at least one character */
+static int
+emit_param(FILE *fp, const http_key_param_info_t *info)
+{
+    const char *arg = info->arg;
+    size_t len = info->arg_len;
+
+    if (!strcmp(info->type, "MATCH") || (!strcmp(info->type, "SUBSTR") &&
+                                         ((0 == len) || memchr(arg, ',', len) || isspace(arg[0]) || isspace(arg[len - 1])))) {
+        /* Compared to each list item */
+        fprintf(fp, "        const char *start = value, *next = NULL;\n");
+        fprintf(fp, "        size_t len;\n\n");
+        fprintf(fp, "        buf[pos] = '0';\n");
+        fprintf(fp, "        while ((len = key_compiled_token(value, value_len, &start, &next, ',')) > 0) {\n");
+        if (!strcmp(info->type, "MATCH")) {
+            fprintf(fp, "            if ((len == %zu) && !memcmp(start, ", len);
+            emit_string(fp, arg, len);
+            fprintf(fp, ", %zu)) {\n", len);
+        } else {
+            fprintf(fp, "            if (memmem(start, len, ");
+            emit_string(fp, arg, len);
+            fprintf(fp, ", %zu)) {\n", len);
+        }
+        fprintf(fp, "                buf[pos] = '1';\n");
+        fprintf(fp, "                break;\n");
+        fprintf(fp, "            }\n");
+        fprintf(fp, "            start = next;\n");
+        fprintf(fp, "        }\n");
+        fprintf(fp, "        ++pos;\n");
+    } else if (!strcmp(info->type, "SUBSTR")) {
+        /* A substring that can not span list items is searched for in the whole value, up to an empty item */
+        if (1 == len) {
+            fprintf(fp, "        const char *match = memchr(value, ");
+            if ((arg[0] == '\'') || (arg[0] == '\\')) {
+                fprintf(fp, "'\\%c'", arg[0]);
+            } else if (isprint((unsigned char)arg[0])) {
+                fprintf(fp, "'%c'", arg[0]);
+            } else {
+                fprintf(fp, "'\\%03o'", (unsigned char)arg[0]);
+            }
+            fprintf(fp, ", value_len);\n\n");
+        } else {
+            fprintf(fp, "        const char *match = memmem(value, value_len, ");
+            emit_string(fp, arg, len);
+            fprintf(fp, ", %zu);\n\n", len);
+        }
+        fprintf(fp, "        buf[pos++] = (match && !key_compiled_empty_before(value, match)) ? '1' : '0';\n");
+    } else if (!strcmp(info->type, "DIV")) {
+        uint64_t divider = 0;
+        size_t i = 0;
+
+        while ((i < len) && isspace(arg[i])) {
+            ++i;
+        }
+        while ((i < len) && isdigit(arg[i])) {
+            divider = divider * 10 + arg[i++] - '0';
+        }
+        if (0 == divider) {
+            fprintf(fp, "        return 0; /* Division by zero */\n");
+        } else {
+            /* A constant divider, which the compiler turns into a multiplication by its reciprocal */
+            fprintf(fp, "        const char *start = value, *next = NULL;\n");
+            fprintf(fp, "        size_t len = key_compiled_token(value, value_len, &start, &next, ',');\n\n");
+            fprintf(fp, "        if (!len || !(len = key_compiled_uint(key_compiled_memtoll(start, len) / UINT64_C(%" PRIu64
+                        "), buf + pos, buf_size - pos))) {\n",
+                    divider);
+            fprintf(fp, "            return 0;\n");
+            fprintf(fp, "        }\n");
+            fprintf(fp, "        pos += len;\n");
+        }
+    } else if (!strcmp(info->type, "PREFER")) {
+        const char *codings[HTTP_KEY_MAX_PREFER];
+        size_t coding_lens[HTTP_KEY_MAX_PREFER];
+        const char *coding_start = arg;
+        const char *coding_next = NULL;
+        size_t coding_len, num_codings = 0;
+
+        while ((num_codings < HTTP_KEY_MAX_PREFER) && (coding_len = emit_token(arg, len, &coding_start, &coding_next, ':')) > 0) {
+            codings[num_codings] = coding_start;
+            coding_lens[num_codings++] = coding_len;
+            coding_start = coding_next;
+        }
+        fprintf(fp, "        static const char *const codings[] = {");
+        for (size_t i = 0; i < num_codings; ++i) {
+            fprintf(fp, i ? ", " : "");
+            emit_string(fp, codings[i], coding_lens[i]);
+        }
+        fprintf(fp, "};\n");
+        fprintf(fp, "        static const size_t coding_lens[] = {");
+        for (size_t i = 0; i < num_codings; ++i) {
+            fprintf(fp, "%s%zu", i ? ", " : "", coding_lens[i]);
+        }
+        fprintf(fp, "};\n");
+        fprintf(fp, "        size_t len = key_compiled_prefer(value, value_len, codings, coding_lens, %zu,\n", num_codings);
+        fprintf(fp, "                                         buf + pos, buf_size - pos);\n\n");
+        fprintf(fp, "        if (!len) {\n");
+        fprintf(fp, "            return 0;\n");
+        fprintf(fp, "        }\n");
+        fprintf(fp, "        pos += len;\n");
+    } else if (!strcmp(info->type, "PARTITION") || !strcmp(info->type, "PARAM")) {
+        fprintf(fp, "        return 0; /* Not implemented, the library fails these evaluations as well */\n");
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Write the generated C code for the Keys to the file */
+int
+emit_keys(FILE *fp, const char **keys, int num_keys)
+{
+    int *emitted = calloc(num_keys, sizeof(int));
+
+    if (!emitted) {
+        fprintf(stderr, "error: out of memory\n");
+        return 1;
+    }
+
+    for (int i = 0; g_preamble[i]; ++i) {
+        fputs(g_preamble[i], fp);
+    }
+    for (int i = 0; i < num_keys; ++i) {
+        unsigned char arena[ARENA_SIZE];
+        http_key_params_t params;
+        http_key_params_t param;
+        size_t num_params;
+        const char *last_header = NULL;
+
+        if (HTTP_KEY_PARSE_OK != http_key_parse(arena, sizeof(arena), keys[i], strlen(keys[i]), &params, &num_params)) {
+            fprintf(stderr, "error: failed to parse Key: %s\n", keys[i]);
+            free(emitted);
+            return 1;
+        } else if (!params) {
+            fprintf(stderr, "warning: skipping Key without parameters: %s\n", keys[i]);
+            continue;
+        }
+
+        fprintf(fp, "\n/* Key: ");
+        for (const char *c = keys[i]; *c; ++c) {
+            if ((c > keys[i]) && (((*c == '/') && (c[-1] == '*')) || ((*c == '*') && (c[-1] == '/')))) {
+                fputc('\\', fp); /* Can't end, or nest, the comment */
+            }
+            fputc(*c, fp);
+        }
+        fprintf(fp, " */\nstatic size_t\nkey_compiled_%d(http_key_t *key, void *header_data, char *buf, size_t buf_size)\n{\n", i);
+        fprintf(fp, "    const char *value = NULL;\n");
+        fprintf(fp, "    size_t value_len = 0, pos = 0;\n");
+
+        param = params;
+        while (param) {
+            http_key_param_info_t info;
+
+            param = http_key_param_info(param, &info);
+            fprintf(fp, "\n");
+
+            /* Fetched once for each run of parameters on the same header, like the library does */
+            if (info.header != last_header) {
+                fprintf(fp, "    value = key->get_header(header_data, ");
+                emit_string(fp, info.header, info.header_len);
+                fprintf(fp, ", %zu, &value_len);\n", info.header_len);
+                last_header = info.header;
+            }
+            fprintf(fp, "    /* %s */\n", info.type);
+            fprintf(fp, "    if (!value || (0 == value_len)) {\n");
+            fprintf(fp, "        if (!key_compiled_none(buf, buf_size, &pos)) {\n");
+            fprintf(fp, "            return 0;\n");
+            fprintf(fp, "        }\n");
+            fprintf(fp, "    } else if (pos >= buf_size) {\n");
+            fprintf(fp, "        return 0;\n");
+            fprintf(fp, "    } else {\n");
+            if (emit_param(fp, &info)) {
+                fprintf(stderr, "error: can not generate code for %s in Key: %s\n", info.type, keys[i]);
+                http_key_release(params);
+                free(emitted);
+                return 1;
+            }
+            fprintf(fp, "    }\n");
+        }
+        fprintf(fp, "\n    return pos;\n}\n");
+        emitted[i] = 1;
+        http_key_release(params);
+    }
+
+    fprintf(fp, "\nint\nkey_compiled_register(http_key_t *key)\n{\n");
+    for (int i = 0; i < num_keys; ++i) {
+        if (emitted[i]) {
+            fprintf(fp, "    if (http_key_register(key, ");
+            emit_string(fp, keys[i], strlen(keys[i]));
+            fprintf(fp, ", &key_compiled_%d)) {\n", i);
+            fprintf(fp, "        return -1;\n");
+            fprintf(fp, "    }\n");
+        }
+    }
+    fprintf(fp, "\n    return 0;\n}\n");
+    free(emitted);
+
+    return 0;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
@@ -29,9 +29,11 @@
 #include <stdio.h>
 #include <assert.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <ctype.h>
+#include <time.h>
 
-#include "http/key.h"
+#include "key-cmd.h"
 #include "include/platform.h"
 
 #if HAVE_STRING_H
@@ -42,18 +44,126 @@
 #include <stdlib.h>
 #endif
 
-#define ARENA_SIZE 8192
 #define HEADERS_TABLE_SIZE 256
+#define MAX_RESULTS 128
+#define EXPLAIN_ITERATIONS 1000
 
 /* Produce help text, from command line parsing etc. */
 static void
 help()
 {
-    fprintf(stderr, "Usage: key-cmd [-H header] [-h] <Key string> ...\n");
+    fprintf(stderr,
+            "Usage: key-cmd [-H header] [-N header] [-V vary] [-l limits] [-b size] [-n count] [-a] [-c] [-g] [-e stored] [-i file] [-s] [-f file] [-m entries] [-q] [-t] [-C] [-x] [-h] <Key string> ...\n");
+    fprintf(stderr, "       key-cmd replay [-j threads] [-b size] [-t] <log file> <Key string> ...\n");
     fprintf(stderr, "\t-H <header>	Set the header (e.g. 'Accept-Encoding: gzip')\n");
+    fprintf(stderr, "\t-N <header[:lws]>	Normalize the header values, lower case, whitespace and/or sorted lists (default all)\n");
+    fprintf(stderr, "\t-V <vary>	Evaluate the Vary header (e.g. 'Accept-Encoding, Accept') before each Key\n");
+    fprintf(stderr, "\t-l <len,tokens,bytes>	Budget per evaluation, max value length, list items and total bytes (0 is unlimited)\n");
+    fprintf(stderr, "\t-b <size>	Size of the evaluation buffer (default %d)\n", ARENA_SIZE - 1);
+    fprintf(stderr, "\t-n <count>	Benchmark, evaluating each Key this many times\n");
+    fprintf(stderr, "\t-a		Analyze the worst-case number of variants, instead of evaluating\n");
+    fprintf(stderr, "\t-c		Evaluate into the compact binary encoding, shown in hex\n");
+    fprintf(stderr, "\t-g		Evaluate into scatter segments, shown joined, with the number of segments\n");
+    fprintf(stderr, "\t-e <stored>	Check if each Key evaluates to the stored secondary key, 1 or 0\n");
+    fprintf(stderr, "\t-i <file>	Find the matching variant among the stored keys in the file, one per line\n");
+    fprintf(stderr, "\t-s		Stream raw HTTP/1.x header blocks from stdin, evaluating the Keys for each\n");
+    fprintf(stderr, "\t-f <file>	Stream raw HTTP/1.x header blocks from a file\n");
+    fprintf(stderr, "\t-m <entries>	Attach a result memo with this many entries to each Key, when streaming\n");
+    fprintf(stderr, "\t-q		Quiet, only show the throughput when streaming\n");
+    fprintf(stderr, "\t-t		Terse output, <result>,<length> or <variants>,<unbounded params>\n");
+    fprintf(stderr, "\t-C		Emit C code evaluating the Keys, with a key_compiled_register() function for http_key_register()\n");
+    fprintf(stderr, "\t-x		Explain the cost of each parameter, over the -n count (default %d) evaluations\n", EXPLAIN_ITERATIONS);
     exit(0);
 }
 
+/* Print a count, which might be unbounded */
+static void
+print_count(size_t count)
+{
+    if (HTTP_KEY_UNBOUNDED == count) {
+        printf("unbounded");
+    } else {
+        printf("%zu", count);
+    }
+}
+
+/* Show the static analysis of the variants a Key can produce */
+static void
+analyze(const char *key_string, http_key_params_t params, int terse)
+{
+    http_key_params_t param = params;
+    size_t unbounded = 0;
+
+    if (!terse) {
+        printf("\tKey: %s\n", key_string);
+    }
+    while (param) {
+        http_key_param_info_t info;
+
+        param = http_key_param_info(param, &info);
+        if (HTTP_KEY_UNBOUNDED == info.cardinality) {
+            ++unbounded;
+        }
+        if (!terse) {
+            printf("\t\t%.*s;%s -> ", (int)info.header_len, info.header, info.type);
+            print_count(info.cardinality);
+            printf(" variants%s\n", HTTP_KEY_UNBOUNDED == info.cardinality ? " (UNBOUNDED)" : "");
+        }
+    }
+
+    if (terse) {
+        print_count(http_key_cardinality(params));
+        printf(",%zu\n", unbounded);
+    } else {
+        printf("\t\tWorst case: ");
+        print_count(http_key_cardinality(params));
+        printf(" variants, %zu unbounded parameter(s)\n", unbounded);
+    }
+}
+
+/* Show the sampled time, bytes and list items of each parameter, with every evaluation sampled. The
+   parameters of the same type on the same header share their samples. */
+static void
+explain(http_key_t *key, const char *key_string, http_key_params_t params, char *buf, size_t buf_size, long iterations, int terse)
+{
+    http_key_params_t param = params;
+    size_t len = 0;
+
+    if (http_key_profile(key, 1)) {
+        fprintf(stderr, "error: out of memory\n");
+        return;
+    }
+    for (long n = 0; n < iterations; ++n) {
+        len = http_key_eval(key, NULL, params, buf, buf_size);
+    }
+
+    if (!terse) {
+        printf("\tKey: %s -> \"%.*s\"\n", key_string, (int)len, buf);
+    }
+    while (param) {
+        http_key_profile_stats_t stats;
+        http_key_param_info_t info;
+
+        http_key_param_info(param, &info);
+        if (http_key_profile_param(key, param, &stats) && stats.samples) {
+            uint64_t bytes = stats.bytes / stats.samples;
+            uint64_t tokens = stats.tokens / stats.samples;
+
+            if (terse) {
+                printf("%.*s;%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", (int)info.header_len, info.header,
+                       info.type, bytes, tokens, stats.eval_ns[0], stats.eval_ns[2], stats.fetch_ns[0]);
+            } else {
+                printf("\t\t%.*s;%s: %" PRIu64 " ns p50, %" PRIu64 " ns p99, %" PRIu64 " bytes, %" PRIu64 " tokens, lookup %" PRIu64
+                       " ns p50\n",
+                       (int)info.header_len, info.header, info.type, stats.eval_ns[0], stats.eval_ns[2], bytes, tokens,
+                       stats.fetch_ns[0]);
+            }
+        }
+        param = http_key_param_info(param, &info);
+    }
+    http_key_profile(key, 0);
+}
+
 /* Manage our header lookup table */
 typedef struct _http_headers {
     char *header;
@@ -144,17 +254,206 @@ add_header(const char *header_val)
     help();
 }
 
+/* Parse the -N option, e.g. "Accept-Encoding:lw" */
+static void
+add_normalize(http_key_t *key, char *arg)
+{
+    char *sep = strchr(arg, ':');
+    unsigned int flags = 0;
+
+    if (sep) {
+        *sep++ = '\0';
+        for (; *sep; ++sep) {
+            switch (*sep) {
+                case 'l':
+                    flags |= HTTP_KEY_NORMALIZE_LOWER;
+                    break;
+                case 'w':
+                    flags |= HTTP_KEY_NORMALIZE_SPACE;
+                    break;
+                case 's':
+                    flags |= HTTP_KEY_NORMALIZE_SORT;
+                    break;
+                default:
+                    fprintf(stderr, "error: %c is not a valid normalization, use l, w or s\n\n", *sep);
+                    help();
+            }
+        }
+    } else {
+        flags = HTTP_KEY_NORMALIZE_LOWER | HTTP_KEY_NORMALIZE_SPACE | HTTP_KEY_NORMALIZE_SORT;
+    }
+
+    if (!*arg || http_key_normalize(key, arg, flags)) {
+        fprintf(stderr, "error: %s is not a valid option to -N\n\n", arg);
+        help();
+    }
+}
+
+/* Parse the -l option, e.g. "1024,16,4096". Omitted limits are unlimited. */
+static void
+set_budget(http_key_t *key, const char *arg)
+{
+    size_t limits[3] = {0, 0, 0};
+    char *end = (char *)arg;
+
+    for (int i = 0; i < 3; ++i) {
+        limits[i] = strtoul(end, &end, 10);
+        if (',' != *end) {
+            break;
+        }
+        ++end;
+    }
+    if (*end) {
+        fprintf(stderr, "error: %s is not a valid option to -l\n\n", arg);
+        help();
+    }
+    http_key_budget(key, limits[0], limits[1], limits[2]);
+}
+
+/* Report the evaluations that were aborted on the budget, on stderr such that stdout only holds the results */
+static void
+report_budget(http_key_t *key)
+{
+    size_t exceeded = http_key_budget_exceeded(key);
+
+    if (exceeded > 0) {
+        fprintf(stderr, "%zu evaluations exceeded the budget\n", exceeded);
+    }
+}
+
+/* Build a variant index from the stored keys in the file, where the line number (from 0) is the variant ID,
+   and look up the variant matching the headers */
+static void
+index_lookup(http_key_t *key, http_key_params_t params, const char *key_string, const char *file, long iterations, int terse)
+{
+    http_key_index_t index = http_key_index_create(key, params);
+    FILE *fp = fopen(file, "r");
+    char *line = NULL;
+    size_t line_size = 0, num = 0, variant;
+    ssize_t len;
+
+    if (!fp || !index) {
+        fprintf(stderr, "error: can not open %s\n", file);
+        http_key_index_destroy(index);
+        return;
+    }
+
+    while ((len = getline(&line, &line_size, fp)) >= 0) {
+        if ((len > 0) && (line[len - 1] == '\n')) {
+            --len;
+        }
+        if (http_key_index_add(index, line, len, num++)) {
+            fprintf(stderr, "error: failed to add variant %zu\n", num - 1);
+        }
+    }
+    free(line);
+    fclose(fp);
+
+    variant = http_key_index_lookup(index, NULL);
+    if (iterations > 0) {
+        struct timespec start, stop;
+        double elapsed;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long n = 0; n < iterations; ++n) {
+            http_key_index_lookup(index, NULL);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        elapsed = (stop.tv_sec - start.tv_sec) * 1e9 + (stop.tv_nsec - start.tv_nsec);
+        fprintf(stderr, "\t%ld lookups in %zu variants: %.1f ns/lookup\n", iterations, num, elapsed / iterations);
+    }
+
+    if (terse) {
+        HTTP_KEY_NO_VARIANT == variant ? printf("none\n") : printf("%zu\n", variant);
+    } else if (HTTP_KEY_NO_VARIANT == variant) {
+        printf("\tKey: %s -> no matching variant\n", key_string);
+    } else {
+        printf("\tKey: %s -> variant %zu\n", key_string, variant);
+    }
+    http_key_index_destroy(index);
+}
+
+/* Typed evaluation, and the compact binary encoding of the results */
+static size_t
+compact_encode(http_key_t *key, http_key_params_t params, unsigned char *encoded, size_t encoded_size)
+{
+    http_key_result_t results[MAX_RESULTS];
+    char bytes[ARENA_SIZE];
+    size_t num = http_key_eval_typed(key, NULL, params, results, MAX_RESULTS, bytes, sizeof(bytes));
+
+    return num ? http_key_encode(results, num, encoded, encoded_size) : 0;
+}
+
+/* Scatter evaluation, with the segments joined into buf for display */
+static size_t
+gather_eval(http_key_t *key, http_key_params_t params, char *buf, size_t buf_size, size_t *num_segments)
+{
+    struct iovec iov[MAX_RESULTS * 2];
+    char bytes[ARENA_SIZE];
+    size_t len = 0;
+
+    *num_segments = http_key_eval_iov(key, NULL, params, iov, MAX_RESULTS * 2, bytes, buf_size);
+    for (size_t i = 0; i < *num_segments; ++i) {
+        if ((buf_size - len) < iov[i].iov_len) {
+            *num_segments = 0;
+            return 0; /* The referenced header values are not bounded by the buffer size */
+        }
+        memcpy(buf + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+
+    return len;
+}
+
 int
 main(int argc, const char *argv[])
 {
     http_key_t key;
     int terse = 0;
+    int analyze_only = 0;
+    int explain_only = 0;
+    int stream = 0;
+    int quiet = 0;
+    int compact = 0;
+    int gather = 0;
+    int emit = 0;
+    size_t memo_entries = 0;
+    const char *stream_file = NULL;
+    const char *vary = NULL;
+    const char *stored = NULL;
+    const char *variants = NULL;
+    size_t buf_size = ARENA_SIZE - 1;
+    long iterations = 0;
 
     /* getopt() options */
     static const struct option longopt[] = {
-        {(char *)"header", required_argument, NULL, 'H'}, {(char *)"help", no_argument, NULL, 'h'}, {NULL, no_argument, NULL, '\0'},
+        {(char *)"header", required_argument, NULL, 'H'},
+        {(char *)"normalize", required_argument, NULL, 'N'},
+        {(char *)"vary", required_argument, NULL, 'V'},
+        {(char *)"limit", required_argument, NULL, 'l'},
+        {(char *)"buffer", required_argument, NULL, 'b'},
+        {(char *)"bench", required_argument, NULL, 'n'},
+        {(char *)"analyze", no_argument, NULL, 'a'},
+        {(char *)"compact", no_argument, NULL, 'c'},
+        {(char *)"gather", no_argument, NULL, 'g'},
+        {(char *)"equals", required_argument, NULL, 'e'},
+        {(char *)"index", required_argument, NULL, 'i'},
+        {(char *)"stream", no_argument, NULL, 's'},
+        {(char *)"file", required_argument, NULL, 'f'},
+        {(char *)"memo", required_argument, NULL, 'm'},
+        {(char *)"quiet", no_argument, NULL, 'q'},
+        {(char *)"terse", no_argument, NULL, 't'},
+        {(char *)"emit-c", no_argument, NULL, 'C'},
+        {(char *)"explain", no_argument, NULL, 'x'},
+        {(char *)"help", no_argument, NULL, 'h'},
+        {NULL, no_argument, NULL, '\0'},
     };
 
+    /* Sub-commands */
+    if ((argc > 1) && !strcmp(argv[1], "replay")) {
+        return replay_main(argc - 1, argv + 1);
+    }
+
     /* Setup the main key object */
     http_key_init(&key, &get_header, /* Header function */
                   NULL,              /* Use system malloc */
@@ -170,15 +469,67 @@ main(int argc, const char *argv[])
 
     /* Parse the command line arguments */
     while (1) {
-        int opt = getopt_long(argc, (char *const *)argv, "hH:t", longopt, NULL);
+        int opt = getopt_long(argc, (char *const *)argv, "hH:N:V:l:b:n:acge:i:sf:m:qtCx", longopt, NULL);
 
         switch (opt) {
             case 'H':
                 add_header(optarg);
                 break;
+            case 'N':
+                add_normalize(&key, optarg);
+                break;
+            case 'V':
+                vary = optarg;
+                break;
+            case 'l':
+                set_budget(&key, optarg);
+                break;
+            case 'b':
+                buf_size = strtoul(optarg, NULL, 10);
+                if (buf_size >= ARENA_SIZE) {
+                    buf_size = ARENA_SIZE - 1;
+                }
+                break;
+            case 'n':
+                iterations = atol(optarg);
+                break;
+            case 'a':
+                analyze_only = 1;
+                break;
+            case 'c':
+                compact = 1;
+                break;
+            case 'g':
+                gather = 1;
+                break;
+            case 'e':
+                stored = optarg;
+                break;
+            case 'i':
+                variants = optarg;
+                break;
+            case 's':
+                stream = 1;
+                break;
+            case 'f':
+                stream = 1;
+                stream_file = optarg;
+                break;
+            case 'm':
+                memo_entries = strtoul(optarg, NULL, 10);
+                break;
+            case 'q':
+                quiet = 1;
+                break;
             case 't':
                 terse = 1;
                 break;
+            case 'C':
+                emit = 1;
+                break;
+            case 'x':
+                explain_only = 1;
+                break;
             case 'h':
                 help();
                 break;
@@ -192,14 +543,51 @@ main(int argc, const char *argv[])
     argc -= optind;
     argv += optind;
 
-    /* ToDo: It'd be neat to have a way to do e.g.
+    /* The generated code evaluates the Keys only, the Vary header is up to the caller */
+    if (emit) {
+        if (vary || (0 == argc)) {
+            fprintf(stderr, "error: need one or more Key strings, and no Vary header, to emit C code\n\n");
+            help();
+        }
+        clear_headers_table();
+
+        return emit_keys(stdout, argv, argc);
+    }
 
-       curl -s -D - -o /dev/null https://example.com | key-cmd "accept-encoding;substr=gzip".
+    /* A Vary header on its own is evaluated as an empty Key */
+    if (vary && (0 == argc)) {
+        static const char *empty[] = {""};
 
-       -- or --
+        argc = 1;
+        argv = empty;
+    }
+
+    /* ToDo: It'd be neat to have a way to do e.g.
 
        key-cmd -u https://example.com "accept-encoding;substr=gzip".
     */
+    if (stream) {
+        FILE *fp = stream_file ? fopen(stream_file, "r") : stdin;
+        int ret;
+
+        if (0 == argc) {
+            fprintf(stderr, "error: need at least one Key string to stream\n\n");
+            help();
+        }
+        if (!fp) {
+            fprintf(stderr, "error: can not open %s\n", stream_file);
+            return 1;
+        }
+        key.get_header = &http_key_block_get;
+        ret = stream_keys(fp, &key, vary, argv, argc, buf_size, memo_entries, terse, quiet);
+        if (stream_file) {
+            fclose(fp);
+        }
+        report_budget(&key);
+        clear_headers_table();
+
+        return ret;
+    }
 
     /* Loop over the remaining arguments, and parse those as if they were Key: headers */
     for (int i = 0; i < argc; ++i) {
@@ -207,14 +595,92 @@ main(int argc, const char *argv[])
         size_t num_params;
         unsigned char arena[ARENA_SIZE];
         char buf[ARENA_SIZE];
+        http_key_parse_status status;
 
-        if (HTTP_KEY_PARSE_OK == http_key_parse((void *)arena, sizeof(arena), argv[i], strlen(argv[i]), &params, &num_params)) {
-            size_t len = http_key_eval(&key, NULL, params, buf, sizeof(buf) - 1);
+        if (vary) {
+            status = http_key_parse_vary((void *)arena, sizeof(arena), vary, strlen(vary), argv[i], strlen(argv[i]), &params,
+                                         &num_params);
+        } else {
+            status = http_key_parse((void *)arena, sizeof(arena), argv[i], strlen(argv[i]), &params, &num_params);
+        }
 
-            if (terse) {
-                printf("%.*s,%d\n", (int)len, buf, (int)len);
+        if (HTTP_KEY_PARSE_OK == status) {
+            if (analyze_only) {
+                analyze(argv[i], params, terse);
+            } else if (explain_only) {
+                explain(&key, argv[i], params, buf, buf_size, (iterations > 0) ? iterations : EXPLAIN_ITERATIONS, terse);
+            } else if (variants) {
+                index_lookup(&key, params, argv[i], variants, iterations, terse);
+            } else if (stored) {
+                int matches = http_key_eval_matches(&key, NULL, params, stored, strlen(stored));
+
+                if (iterations > 0) {
+                    struct timespec start, stop;
+                    double elapsed;
+
+                    clock_gettime(CLOCK_MONOTONIC, &start);
+                    for (long n = 0; n < iterations; ++n) {
+                        http_key_eval_matches(&key, NULL, params, stored, strlen(stored));
+                    }
+                    clock_gettime(CLOCK_MONOTONIC, &stop);
+                    elapsed = (stop.tv_sec - start.tv_sec) * 1e9 + (stop.tv_nsec - start.tv_nsec);
+                    fprintf(stderr, "\t%ld evaluations: %.1f ns/eval\n", iterations, elapsed / iterations);
+                }
+
+                if (terse) {
+                    printf("%d\n", matches);
+                } else {
+                    printf("\tKey: %s %s \"%s\"\n", argv[i], matches ? "==" : "!=", stored);
+                }
             } else {
-                printf("\tKey: %s -> \"%.*s\"\n", argv[i], (int)len, buf);
+                unsigned char encoded[ARENA_SIZE];
+                size_t segments = 0;
+                size_t len = compact  ? compact_encode(&key, params, encoded, buf_size / 2)
+                             : gather ? gather_eval(&key, params, buf, buf_size, &segments)
+                                      : http_key_eval(&key, NULL, params, buf, buf_size);
+
+                if (iterations > 0) {
+                    struct timespec start, stop;
+                    double elapsed;
+
+                    clock_gettime(CLOCK_MONOTONIC, &start);
+                    for (long n = 0; n < iterations; ++n) {
+                        if (compact) {
+                            compact_encode(&key, params, encoded, buf_size / 2);
+                        } else if (gather) {
+                            struct iovec iov[MAX_RESULTS * 2];
+
+                            http_key_eval_iov(&key, NULL, params, iov, MAX_RESULTS * 2, buf, buf_size);
+                        } else {
+                            http_key_eval(&key, NULL, params, buf, buf_size);
+                        }
+                    }
+                    clock_gettime(CLOCK_MONOTONIC, &stop);
+                    elapsed = (stop.tv_sec - start.tv_sec) * 1e9 + (stop.tv_nsec - start.tv_nsec);
+                    fprintf(stderr, "\t%ld evaluations: %.1f ns/eval\n", iterations, elapsed / iterations);
+                }
+
+                if (compact) {
+                    /* Shown in hex, the length is the number of bytes */
+                    for (size_t j = 0; j < len; ++j) {
+                        sprintf(buf + j * 2, "%02x", encoded[j]);
+                    }
+                    if (terse) {
+                        printf("%.*s,%d\n", (int)len * 2, buf, (int)len);
+                    } else {
+                        printf("\tKey: %s -> %.*s (%zu bytes)\n", argv[i], (int)len * 2, buf, len);
+                    }
+                } else if (gather) {
+                    if (terse) {
+                        printf("%.*s,%zu\n", (int)len, buf, segments);
+                    } else {
+                        printf("\tKey: %s -> \"%.*s\" (%zu segments)\n", argv[i], (int)len, buf, segments);
+                    }
+                } else if (terse) {
+                    printf("%.*s,%d\n", (int)len, buf, (int)len);
+                } else {
+                    printf("\tKey: %s -> \"%.*s\"\n", argv[i], (int)len, buf);
+                }
             }
             http_key_release(params);
         } else {
@@ -223,6 +689,7 @@ main(int argc, const char *argv[])
     }
 
     clear_headers_table();
+    report_budget(&key);
 
     return 0;
 }
@@ -0,0 +1,50 @@
+/** @file
+
+    Shared declarations between the various parts of the key-cmd command
+    line utility.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#ifndef KEY_CMD_H
+#define KEY_CMD_H
+
+#include <stdio.h>
+
+#include "http/key.h"
+
+#define ARENA_SIZE 8192
+#define MEMO_ENTRY_SIZE 256
+
+int stream_keys(FILE *fp, http_key_t *key, const char *vary, const char **keys, int num_keys, size_t buf_size, size_t memo_entries,
+                int terse, int quiet);
+int replay_main(int argc, const char *argv[]);
+int emit_keys(FILE *fp, const char **keys, int num_keys);
+
+#endif /* KEY_CMD_H */
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
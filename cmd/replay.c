@@ -0,0 +1,601 @@
+/** @file
+
+    Parallel replay of a (large) log of request headers for key-cmd. The log
+    is the same format as the streaming mode, i.e. one raw HTTP/1.x header
+    block per request, separated by empty lines. The file is memory mapped,
+    split into chunks at block boundaries, and the chunks are processed by
+    a pool of worker threads. Each worker owns a contiguous range of chunks,
+    and steals from the end of other workers' ranges once its own is empty.
+
+    For each Key, we produce a histogram of the resulting variants, and an
+    estimate of the cache fragmentation this Key would cause.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <stdio.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "key-cmd.h"
+#include "include/platform.h"
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#define REPLAY_MIN_CHUNK (64 * 1024)
+#define REPLAY_MAX_CHUNK (4 * 1024 * 1024)
+#define REPLAY_TOP_VARIANTS 10
+
+/* A histogram of variants, as an open addressing hash table. The variant strings are kept in a
+   separate pool, which is only grown when needed. */
+typedef struct {
+    uint64_t hash;
+    size_t offset;
+    size_t len;
+    uint64_t count;
+} variant_t;
+
+typedef struct {
+    variant_t *slots;
+    size_t size; /* Always a power of two */
+    size_t used;
+    char *pool;
+    size_t pool_len;
+    size_t pool_size;
+    uint64_t requests;
+    uint64_t failed;
+} histogram_t;
+
+struct _replay;
+
+typedef struct {
+    struct _replay *replay;
+    int id;
+    pthread_t thread;
+    _Atomic uint64_t range; /* Next chunk in the upper 32 bits, end chunk in the lower */
+    http_key_block_t block; /* The index is not thread safe, so each worker has its own */
+    histogram_t *histograms; /* One per Key */
+    char *buf;
+    size_t records;
+} replay_worker_t;
+
+typedef struct _replay {
+    const char *data;
+    size_t len;
+    size_t *boundaries; /* num_chunks + 1 offsets, each at the start of a header block */
+    size_t num_chunks;
+    http_key_t key;
+    http_key_params_t *params;
+    int num_keys;
+    size_t buf_size;
+    replay_worker_t *workers;
+    int num_workers;
+} replay_t;
+
+static void
+replay_help()
+{
+    fprintf(stderr, "Usage: key-cmd replay [-j threads] [-b size] [-t] <log file> <Key string> ...\n");
+    fprintf(stderr, "\t-j <threads>	Number of worker threads (default is one per core)\n");
+    fprintf(stderr, "\t-b <size>	Size of the evaluation buffer (default %d)\n", ARENA_SIZE - 1);
+    fprintf(stderr, "\t-t		Terse output, <variants>,<requests>,<failed> per Key\n");
+    exit(0);
+}
+
+/* FNV-1a, which is plenty good for variant strings */
+static uint64_t
+variant_hash(const char *str, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    while (len-- > 0) {
+        hash = (hash ^ (unsigned char)*str++) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static int
+histogram_init(histogram_t *hist)
+{
+    memset(hist, 0, sizeof(*hist));
+    hist->size = 64;
+    hist->slots = calloc(hist->size, sizeof(variant_t));
+
+    return hist->slots ? 0 : -1;
+}
+
+static void
+histogram_free(histogram_t *hist)
+{
+    free(hist->slots);
+    free(hist->pool);
+}
+
+static int histogram_add(histogram_t *hist, const char *str, size_t len, uint64_t count);
+
+/* Double the size of the hash table, re-inserting all the existing variants */
+static int
+histogram_grow(histogram_t *hist)
+{
+    size_t size = hist->size * 2;
+    variant_t *slots = calloc(size, sizeof(variant_t));
+
+    if (!slots) {
+        return -1;
+    }
+    for (size_t i = 0; i < hist->size; ++i) {
+        variant_t *v = &hist->slots[i];
+
+        if (v->count) {
+            size_t slot = v->hash & (size - 1);
+
+            while (slots[slot].count) {
+                slot = (slot + 1) & (size - 1);
+            }
+            slots[slot] = *v;
+        }
+    }
+    free(hist->slots);
+    hist->slots = slots;
+    hist->size = size;
+
+    return 0;
+}
+
+static int
+histogram_add(histogram_t *hist, const char *str, size_t len, uint64_t count)
+{
+    uint64_t hash = variant_hash(str, len);
+    size_t slot = hash & (hist->size - 1);
+    variant_t *v;
+
+    while ((v = &hist->slots[slot])->count) {
+        if ((v->hash == hash) && (v->len == len) && !memcmp(hist->pool + v->offset, str, len)) {
+            v->count += count;
+            return 0;
+        }
+        slot = (slot + 1) & (hist->size - 1);
+    }
+
+    /* New variant, keep the load factor below 50% */
+    if ((hist->used + 1) * 2 > hist->size) {
+        if (histogram_grow(hist)) {
+            return -1;
+        }
+        return histogram_add(hist, str, len, count);
+    }
+    if (hist->pool_len + len > hist->pool_size) {
+        size_t pool_size = hist->pool_size ? hist->pool_size : 4096;
+        char *pool;
+
+        while (hist->pool_len + len > pool_size) {
+            pool_size *= 2;
+        }
+        if (!(pool = realloc(hist->pool, pool_size))) {
+            return -1;
+        }
+        hist->pool = pool;
+        hist->pool_size = pool_size;
+    }
+    memcpy(hist->pool + hist->pool_len, str, len);
+    v->hash = hash;
+    v->offset = hist->pool_len;
+    v->len = len;
+    v->count = count;
+    hist->pool_len += len;
+    ++hist->used;
+
+    return 0;
+}
+
+/* Take the next chunk from the front of our own range */
+static int64_t
+replay_take(replay_worker_t *worker)
+{
+    uint64_t range = atomic_load(&worker->range);
+
+    while ((range >> 32) < (range & 0xffffffff)) {
+        if (atomic_compare_exchange_weak(&worker->range, &range, range + (1ULL << 32))) {
+            return range >> 32;
+        }
+    }
+
+    return -1;
+}
+
+/* Steal a chunk from the end of another worker's range */
+static int64_t
+replay_steal(replay_worker_t *victim)
+{
+    uint64_t range = atomic_load(&victim->range);
+
+    while ((range >> 32) < (range & 0xffffffff)) {
+        if (atomic_compare_exchange_weak(&victim->range, &range, range - 1)) {
+            return (range & 0xffffffff) - 1;
+        }
+    }
+
+    return -1;
+}
+
+static void
+replay_chunk(replay_worker_t *worker, size_t chunk)
+{
+    replay_t *replay = worker->replay;
+    size_t pos = replay->boundaries[chunk];
+    size_t end = replay->boundaries[chunk + 1];
+
+    while (pos < end) {
+        size_t consumed = http_key_block_index(worker->block, replay->data + pos, end - pos, 1);
+
+        if (0 == consumed) {
+            break; /* Out of memory, at the end of the data a block is always complete */
+        }
+        if (http_key_block_lines(worker->block) > 0) {
+            ++worker->records;
+            for (int i = 0; i < replay->num_keys; ++i) {
+                histogram_t *hist = &worker->histograms[i];
+                size_t len = http_key_eval(&replay->key, worker->block, replay->params[i], worker->buf, replay->buf_size);
+
+                ++hist->requests;
+                if (0 == len) {
+                    ++hist->failed;
+                } else if (histogram_add(hist, worker->buf, len, 1)) {
+                    ++hist->failed; /* Out of memory, count it rather than giving up */
+                }
+            }
+        }
+        pos += consumed;
+    }
+}
+
+static void *
+replay_worker(void *data)
+{
+    replay_worker_t *worker = (replay_worker_t *)data;
+    replay_t *replay = worker->replay;
+    int64_t chunk;
+
+    while (1) {
+        if ((chunk = replay_take(worker)) < 0) {
+            for (int i = 1; i < replay->num_workers; ++i) {
+                if ((chunk = replay_steal(&replay->workers[(worker->id + i) % replay->num_workers])) >= 0) {
+                    break;
+                }
+            }
+        }
+        if (chunk < 0) {
+            break;
+        }
+        replay_chunk(worker, (size_t)chunk);
+    }
+
+    return NULL;
+}
+
+/* Find the first header block that starts at, or after, the position */
+static size_t
+replay_boundary(const char *data, size_t len, size_t pos)
+{
+    while (pos < len) {
+        const char *nl = memchr(data + pos, '\n', len - pos);
+
+        if (!nl) {
+            return len;
+        }
+        pos = nl - data + 1;
+        if ((pos >= 2) && ((data[pos - 2] == '\n') || ((pos >= 3) && (data[pos - 2] == '\r') && (data[pos - 3] == '\n')))) {
+            return pos;
+        }
+    }
+
+    return len;
+}
+
+static int
+variant_compare(const void *a, const void *b)
+{
+    const variant_t *va = (const variant_t *)a;
+    const variant_t *vb = (const variant_t *)b;
+
+    return va->count < vb->count ? 1 : (va->count > vb->count ? -1 : 0);
+}
+
+/* Print the variant distribution, and the expected fragmentation, for one Key. With an infinitely large
+   cache, every variant is one compulsory miss, hence the ideal hit ratio of (requests - variants) / requests
+   for a single URL. The effective number of variants is 2^H, where H is the Shannon entropy of the
+   distribution; this is much lower than the number of variants if a few of them dominates. */
+static void
+replay_report(const char *key_string, histogram_t *hist, int terse)
+{
+    uint64_t evaluated = hist->requests - hist->failed;
+    variant_t *variants;
+    size_t num = 0;
+    double entropy = 0.0;
+
+    if (terse) {
+        printf("%zu,%llu,%llu\n", hist->used, (unsigned long long)hist->requests, (unsigned long long)hist->failed);
+        return;
+    }
+
+    printf("Key: %s\n", key_string);
+    printf("\trequests: %llu, failed: %llu, variants: %zu\n", (unsigned long long)hist->requests, (unsigned long long)hist->failed,
+           hist->used);
+    if (0 == evaluated) {
+        return;
+    }
+
+    if (!(variants = malloc(hist->used * sizeof(variant_t)))) {
+        return;
+    }
+    for (size_t i = 0; i < hist->size; ++i) {
+        if (hist->slots[i].count) {
+            double p = (double)hist->slots[i].count / evaluated;
+
+            entropy -= p * log2(p);
+            variants[num++] = hist->slots[i];
+        }
+    }
+    qsort(variants, num, sizeof(variant_t), variant_compare);
+
+    printf("\teffective variants: %.2f\n", pow(2.0, entropy));
+    printf("\tideal hit ratio: %.3f%% (%.3f%% without this Key)\n", 100.0 * (evaluated - num) / evaluated,
+           100.0 * (evaluated - 1) / evaluated);
+    printf("\ttop variants:\n");
+    for (size_t i = 0; (i < num) && (i < REPLAY_TOP_VARIANTS); ++i) {
+        printf("\t\t\"%.*s\" %llu (%.2f%%)\n", (int)variants[i].len, hist->pool + variants[i].offset,
+               (unsigned long long)variants[i].count, 100.0 * variants[i].count / evaluated);
+    }
+    free(variants);
+}
+
+int
+replay_main(int argc, const char *argv[])
+{
+    replay_t replay;
+    unsigned char *arenas = NULL;
+    size_t chunk_size;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int terse = 0, fd, ret = 0;
+    struct stat st;
+    struct timespec start, stop;
+    size_t records = 0;
+    double elapsed;
+    void *map;
+
+    static const struct option longopt[] = {
+        {(char *)"threads", required_argument, NULL, 'j'},
+        {(char *)"buffer", required_argument, NULL, 'b'},
+        {(char *)"terse", no_argument, NULL, 't'},
+        {(char *)"help", no_argument, NULL, 'h'},
+        {NULL, no_argument, NULL, '\0'},
+    };
+
+    memset(&replay, 0, sizeof(replay));
+    replay.num_workers = cores > 0 ? (int)cores : 1;
+    replay.buf_size = ARENA_SIZE - 1;
+
+    while (1) {
+        int opt = getopt_long(argc, (char *const *)argv, "hj:b:t", longopt, NULL);
+
+        if (opt == -1) {
+            break;
+        }
+        switch (opt) {
+            case 'j':
+                replay.num_workers = atoi(optarg);
+                if (replay.num_workers < 1) {
+                    replay.num_workers = 1;
+                }
+                break;
+            case 'b':
+                replay.buf_size = strtoul(optarg, NULL, 10);
+                if (replay.buf_size >= ARENA_SIZE) {
+                    replay.buf_size = ARENA_SIZE - 1;
+                }
+                break;
+            case 't':
+                terse = 1;
+                break;
+            default:
+                replay_help();
+                break;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+
+    if (argc < 2) {
+        replay_help();
+    }
+
+    if ((fd = open(argv[0], O_RDONLY)) < 0) {
+        fprintf(stderr, "error: can not open %s\n", argv[0]);
+        return 1;
+    }
+    if (fstat(fd, &st)) {
+        fprintf(stderr, "error: can not stat %s\n", argv[0]);
+        close(fd);
+        return 1;
+    }
+    replay.len = st.st_size;
+    if (replay.len > 0) {
+        if (MAP_FAILED == (map = mmap(NULL, replay.len, PROT_READ, MAP_PRIVATE, fd, 0))) {
+            fprintf(stderr, "error: can not mmap %s\n", argv[0]);
+            close(fd);
+            return 1;
+        }
+        madvise(map, replay.len, MADV_SEQUENTIAL);
+        replay.data = map;
+    }
+    close(fd);
+
+    /* Parse all the Keys, these are shared (read-only) between all the workers */
+    replay.num_keys = argc - 1;
+    replay.params = calloc(replay.num_keys, sizeof(http_key_params_t));
+    arenas = malloc((size_t)replay.num_keys * ARENA_SIZE);
+    replay.workers = calloc(replay.num_workers, sizeof(replay_worker_t));
+    if (!replay.params || !arenas || !replay.workers) {
+        fprintf(stderr, "error: out of memory\n");
+        ret = 1;
+        goto done;
+    }
+    http_key_init(&replay.key, &http_key_block_get, NULL, NULL, ARENA_SIZE, NULL, NULL, NULL);
+    for (int i = 0; i < replay.num_keys; ++i) {
+        size_t num_params;
+
+        if (HTTP_KEY_PARSE_OK != http_key_parse(arenas + (size_t)i * ARENA_SIZE, ARENA_SIZE, argv[i + 1], strlen(argv[i + 1]),
+                                                &replay.params[i], &num_params)) {
+            fprintf(stderr, "error: failed to parse Key: %s\n", argv[i + 1]);
+            ret = 1;
+            goto done;
+        }
+    }
+
+    /* Split the file into chunks, with plenty of chunks per worker for stealing to even out the load */
+    chunk_size = replay.len / ((size_t)replay.num_workers * 64);
+    chunk_size = chunk_size < REPLAY_MIN_CHUNK ? REPLAY_MIN_CHUNK : (chunk_size > REPLAY_MAX_CHUNK ? REPLAY_MAX_CHUNK : chunk_size);
+    replay.num_chunks = (replay.len + chunk_size - 1) / chunk_size;
+    if (!(replay.boundaries = malloc((replay.num_chunks + 1) * sizeof(size_t)))) {
+        fprintf(stderr, "error: out of memory\n");
+        ret = 1;
+        goto done;
+    }
+    replay.boundaries[0] = 0;
+    for (size_t i = 1; i < replay.num_chunks; ++i) {
+        size_t boundary = replay_boundary(replay.data, replay.len, i * chunk_size);
+
+        replay.boundaries[i] = boundary > replay.boundaries[i - 1] ? boundary : replay.boundaries[i - 1];
+    }
+    replay.boundaries[replay.num_chunks] = replay.len;
+
+    /* Setup the workers, each with an even share of the chunks to start with */
+    for (int i = 0; i < replay.num_workers; ++i) {
+        replay_worker_t *worker = &replay.workers[i];
+        uint64_t first = replay.num_chunks * i / replay.num_workers;
+        uint64_t last = replay.num_chunks * (i + 1) / replay.num_workers;
+
+        worker->replay = &replay;
+        worker->id = i;
+        atomic_init(&worker->range, (first << 32) | last);
+        if (!(worker->buf = malloc(replay.buf_size + 1)) || !(worker->histograms = calloc(replay.num_keys, sizeof(histogram_t))) ||
+            !(worker->block = http_key_block_create(&replay.key, replay.params, replay.num_keys))) {
+            fprintf(stderr, "error: out of memory\n");
+            ret = 1;
+            goto done;
+        }
+        for (int k = 0; k < replay.num_keys; ++k) {
+            if (histogram_init(&worker->histograms[k])) {
+                fprintf(stderr, "error: out of memory\n");
+                ret = 1;
+                goto done;
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < replay.num_workers; ++i) {
+        if (pthread_create(&replay.workers[i].thread, NULL, &replay_worker, &replay.workers[i])) {
+            /* Run it inline instead, the other workers will steal from it */
+            replay_worker(&replay.workers[i]);
+            replay.workers[i].thread = pthread_self();
+        }
+    }
+    for (int i = 0; i < replay.num_workers; ++i) {
+        if (!pthread_equal(replay.workers[i].thread, pthread_self())) {
+            pthread_join(replay.workers[i].thread, NULL);
+        }
+        records += replay.workers[i].records;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    /* Merge all the worker histograms into the first worker's */
+    for (int k = 0; k < replay.num_keys; ++k) {
+        histogram_t *hist = &replay.workers[0].histograms[k];
+
+        for (int i = 1; i < replay.num_workers; ++i) {
+            histogram_t *other = &replay.workers[i].histograms[k];
+
+            for (size_t s = 0; s < other->size; ++s) {
+                if (other->slots[s].count) {
+                    histogram_add(hist, other->pool + other->slots[s].offset, other->slots[s].len, other->slots[s].count);
+                }
+            }
+            hist->requests += other->requests;
+            hist->failed += other->failed;
+        }
+        replay_report(argv[k + 1], hist, terse);
+    }
+
+    elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+    if (elapsed <= 0) {
+        elapsed = 1e-9;
+    }
+    fprintf(stderr, "%zu records, %zu bytes, %d threads in %.3fs: %.0f records/s, %.2f MB/s\n", records, replay.len,
+            replay.num_workers, elapsed, records / elapsed, replay.len / elapsed / (1024 * 1024));
+
+done:
+    for (int i = 0; replay.workers && (i < replay.num_workers); ++i) {
+        replay_worker_t *worker = &replay.workers[i];
+
+        for (int k = 0; worker->histograms && (k < replay.num_keys); ++k) {
+            histogram_free(&worker->histograms[k]);
+        }
+        free(worker->histograms);
+        free(worker->buf);
+        http_key_block_destroy(worker->block);
+    }
+    for (int i = 0; replay.params && (i < replay.num_keys); ++i) {
+        http_key_release(replay.params[i]);
+    }
+    free(replay.workers);
+    free(replay.boundaries);
+    free(replay.params);
+    free(arenas);
+    if (replay.data) {
+        munmap((void *)replay.data, replay.len);
+    }
+
+    return ret;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
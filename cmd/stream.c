@@ -0,0 +1,173 @@
+/** @file
+
+    Streaming mode for key-cmd, evaluating Key headers against raw HTTP/1.x
+    header blocks, e.g. from
+
+        curl -s -D - -o /dev/null https://example.com | key-cmd -s "accept-encoding;substr=gzip"
+
+    All buffers are reused between header blocks, and the headers are not
+    copied out of the input buffer.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "key-cmd.h"
+#include "include/platform.h"
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#define STREAM_BUFFER_SIZE (64 * 1024)
+
+/* Read concatenated header blocks from the file, and evaluate all the Keys for each block, as indexed by
+   http_key_block_index(). The key must use http_key_block_get() for the header lookups. The throughput
+   is reported on stderr, such that stdout only holds the results. */
+int
+stream_keys(FILE *fp, http_key_t *key, const char *vary, const char **keys, int num_keys, size_t buf_size, size_t memo_entries,
+            int terse, int quiet)
+{
+    http_key_params_t *params = calloc(num_keys, sizeof(http_key_params_t));
+    unsigned char *arenas = malloc((size_t)num_keys * ARENA_SIZE);
+    char *buf = malloc(buf_size + 1);
+    size_t size = STREAM_BUFFER_SIZE, len = 0;
+    char *data = malloc(size);
+    http_key_block_t block = NULL;
+    size_t blocks = 0, bytes = 0;
+    struct timespec start, stop;
+    double elapsed;
+    int eof = 0, ret = 0;
+
+    if (!params || !arenas || !buf || !data) {
+        fprintf(stderr, "error: out of memory\n");
+        ret = 1;
+        goto done;
+    }
+
+    for (int i = 0; i < num_keys; ++i) {
+        size_t num_params;
+
+        if (HTTP_KEY_PARSE_OK != http_key_parse_vary(arenas + (size_t)i * ARENA_SIZE, ARENA_SIZE, vary, vary ? strlen(vary) : 0,
+                                                     keys[i], strlen(keys[i]), &params[i], &num_params)) {
+            fprintf(stderr, "error: failed to parse Key: %s\n", keys[i]);
+            ret = 1;
+            goto done;
+        }
+        if (memo_entries && http_key_memo_attach(key, params[i], memo_entries, MEMO_ENTRY_SIZE)) {
+            fprintf(stderr, "error: failed to attach a memo to Key: %s\n", keys[i]);
+        }
+    }
+    if (!(block = http_key_block_create(key, params, num_keys))) {
+        fprintf(stderr, "error: out of memory\n");
+        ret = 1;
+        goto done;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (!eof) {
+        size_t pos = 0, consumed;
+
+        /* Grow the buffer only if a single header block does not fit */
+        if (len == size) {
+            char *bigger = realloc(data, size * 2);
+
+            if (!bigger) {
+                fprintf(stderr, "error: out of memory\n");
+                ret = 1;
+                break;
+            }
+            data = bigger;
+            size *= 2;
+        }
+
+        consumed = fread(data + len, 1, size - len, fp);
+        if (0 == consumed) {
+            eof = 1;
+        }
+        len += consumed;
+        bytes += consumed;
+
+        while ((pos < len) && (consumed = http_key_block_index(block, data + pos, len - pos, eof)) > 0) {
+            if (http_key_block_lines(block) > 0) {
+                ++blocks;
+                if (!quiet && !terse) {
+                    printf("Block %zu:\n", blocks);
+                }
+                for (int i = 0; i < num_keys; ++i) {
+                    size_t res_len = http_key_eval(key, block, params[i], buf, buf_size);
+
+                    if (quiet) {
+                        continue;
+                    } else if (terse) {
+                        printf("%.*s,%d\n", (int)res_len, buf, (int)res_len);
+                    } else {
+                        printf("\tKey: %s -> \"%.*s\"\n", keys[i], (int)res_len, buf);
+                    }
+                }
+            }
+            pos += consumed;
+        }
+
+        memmove(data, data + pos, len - pos);
+        len -= pos;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+    if (elapsed <= 0) {
+        elapsed = 1e-9;
+    }
+    fprintf(stderr, "%zu blocks, %zu bytes in %.3fs: %.0f blocks/s, %.2f MB/s\n", blocks, bytes, elapsed, blocks / elapsed,
+            bytes / elapsed / (1024 * 1024));
+    for (int i = 0; memo_entries && (i < num_keys); ++i) {
+        size_t hits, misses;
+
+        http_key_memo_stats(params[i], &hits, &misses);
+        fprintf(stderr, "\tKey: %s memo: %zu hits, %zu misses\n", keys[i], hits, misses);
+    }
+
+done:
+    http_key_block_destroy(block);
+    for (int i = 0; params && (i < num_keys); ++i) {
+        http_key_release(params[i]);
+    }
+    free(data);
+    free(buf);
+    free(arenas);
+    free(params);
+
+    return ret;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
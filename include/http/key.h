@@ -27,18 +27,54 @@
 #define HTTP_KEY_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define HTTP_KEY_MAX_PARTITIONS 32
+#define HTTP_KEY_MAX_PREFER 16
 #define HTTP_KEY_MIN_ARENA 128
 
+/* Returned by the length APIs when the output of a Key can not be bounded at parse time (e.g. PARAM). */
+#define HTTP_KEY_UNBOUNDED ((size_t)-1)
+
+/* Header value normalizations, see http_key_normalize() */
+#define HTTP_KEY_NORMALIZE_LOWER 0x1 /* Lower case the value */
+#define HTTP_KEY_NORMALIZE_SPACE 0x2 /* Trim list items, and collapse whitespace within them to one space */
+#define HTTP_KEY_NORMALIZE_SORT 0x4  /* Sort the list items, and remove duplicates */
+#define HTTP_KEY_MAX_NORMALIZE 16
+#define HTTP_KEY_MAX_COMPILED 16
+
+/* The sampled profile of the parameters, see http_key_profile() */
+#define HTTP_KEY_PROFILE_MAX_HEADER 64 /* Header names are kept up to this length in the stats */
+#define HTTP_KEY_PROFILE_QUANTILES 4   /* The 50th, 90th, 99th and 99.9th percentiles */
+
 /* Holds one single key parameter "rule", which is opaque in the public APIs. This does hold
    all the information necessary for a single parameter rule, but you must not modify it directly. */
 typedef struct _http_key_params *http_key_params_t;
 
+/* Returned by http_key_eval_start() and http_key_eval_resume() while a header value is pending */
+#define HTTP_KEY_PENDING ((size_t)-1)
+
+/* Returned by the header callback for a value that is not yet available, see http_key_eval_start() */
+extern const char http_key_value_pending[];
+#define HTTP_KEY_VALUE_PENDING http_key_value_pending
+
+/* Opaque handle for a per connection memo, see http_key_conn_create() */
+typedef struct _http_key_conn *http_key_conn_t;
+
+/* Opaque handle for an index of raw HTTP/1.x header blocks, see http_key_block_create() */
+typedef struct _http_key_block *http_key_block_t;
+
+/* Opaque handle for a variant index, see http_key_index_create() */
+typedef struct _http_key_index *http_key_index_t;
+
+/* Returned by http_key_index_lookup() when no stored variant matches */
+#define HTTP_KEY_NO_VARIANT ((size_t)-1)
+
 /**
  * @brief Callback function, for retrieving a header value, managing memory and a lookup cache.
  *
@@ -46,6 +82,15 @@ typedef struct _http_key_params *http_key_params_t;
  */
 typedef const char *(*http_key_header_t)(void *, const char *, size_t, size_t *);
 
+/**
+ * @brief Callback function, retrieving a header value along with its table entry ID
+ *
+ * The same as http_key_header_t, but also returns a stable identity for the value in the last
+ * argument, see http_key_eval_conn(). The ID is 0 when the value has no identity, e.g. for a
+ * literal that was not added to the HPACK / QPACK dynamic table.
+ */
+typedef const char *(*http_key_header_id_t)(void *, const char *, size_t, size_t *, uint64_t *);
+
 /**
  * @brief Callback function, for memory allocation during Key header parsing
  *
@@ -80,8 +125,18 @@ typedef void (*http_key_cache_store_t)(void *, const char *, size_t, http_key_pa
  */
 typedef const http_key_params_t (*http_key_cache_lookup_t)(void *, const char *, size_t);
 
+struct _http_key;
+
+/**
+ * @brief A precompiled evaluator for one Key string, see http_key_register()
+ *
+ * This is the signature of the functions generated by key-cmd --emit-c. It must produce exactly
+ * what http_key_eval() does for the same Key string.
+ */
+typedef size_t (*http_key_compiled_t)(struct _http_key *key, void *header_data, char *buf, size_t buf_size);
+
 /* ToDo: Should this be opaque as well? If so, we need a constructor wrapper for this? */
-typedef struct {
+typedef struct _http_key {
     http_key_header_t get_header;
     http_key_malloc_t malloc;
     http_key_free_t free;
@@ -93,8 +148,88 @@ typedef struct {
         http_key_cache_lookup_t lookup;
         void *data;
     } cache;
+
+    /* Headers with normalized values, see http_key_normalize() */
+    struct {
+        const char *header;
+        size_t header_len;
+        unsigned int flags;
+    } normalize[HTTP_KEY_MAX_NORMALIZE];
+    size_t num_normalize;
+
+    /* Per evaluation work budget, see http_key_budget(). Zero means no limit. */
+    struct {
+        size_t max_value_len;
+        size_t max_tokens;
+        size_t max_bytes;
+        size_t exceeded; /* Number of evaluations aborted on the budget, updated atomically */
+    } budget;
+
+    /* Precompiled evaluators, see http_key_register() */
+    struct {
+        const char *key_string;
+        size_t key_string_len;
+        http_key_compiled_t eval;
+    } compiled[HTTP_KEY_MAX_COMPILED];
+    size_t num_compiled;
+
+    /* Sampled timings of the parameters, see http_key_profile(). Zero rate means not sampling. */
+    struct {
+        size_t rate;
+        void *data;
+    } profile;
 } http_key_t;
 
+/* The state of a suspended evaluation, see http_key_eval_start(). This is small enough to keep with the
+   request, and must not be modified directly. */
+typedef struct {
+    http_key_params_t next; /* The parameter to resume from */
+    char *buf;
+    size_t buf_size;
+    size_t pos;  /* Output produced so far */
+    size_t used; /* Header bytes charged to the budget so far */
+} http_key_eval_state_t;
+
+/* Introspection details for one parameter of a parsed Key, see http_key_param_info(). */
+typedef struct {
+    const char *type; /* e.g. "MATCH" */
+    const char *header;
+    size_t header_len;
+    size_t max_len;     /* Max output length, or HTTP_KEY_UNBOUNDED */
+    size_t cardinality; /* Number of distinct outputs, including "none", or HTTP_KEY_UNBOUNDED */
+    const char *arg;    /* The parameter value, e.g. "gzip" (PREFER values are lower cased), not NULL terminated */
+    size_t arg_len;
+} http_key_param_info_t;
+
+/* The sampled profile for one parameter type on one header, see http_key_profile_stats(). The
+   times are in nanoseconds, as the upper bound of the histogram bucket for each quantile. */
+typedef struct {
+    const char *type; /* e.g. "MATCH" */
+    const char *header; /* Not NULL terminated, and cut at HTTP_KEY_PROFILE_MAX_HEADER */
+    size_t header_len;
+    size_t samples;        /* Sampled parameter evaluations */
+    uint64_t bytes;        /* Header value bytes passed to the parameters, summed over the samples */
+    uint64_t tokens;       /* Comma separated list items in those values, summed over the samples */
+    uint64_t eval_ns[HTTP_KEY_PROFILE_QUANTILES];
+    size_t fetches;        /* Sampled header lookups, including normalization */
+    uint64_t fetch_ns[HTTP_KEY_PROFILE_QUANTILES];
+} http_key_profile_stats_t;
+
+/* The typed result of one parameter, see http_key_eval_typed() */
+typedef enum {
+    HTTP_KEY_RESULT_NONE, /* The header is not present */
+    HTTP_KEY_RESULT_BOOL, /* MATCH and SUBSTR */
+    HTTP_KEY_RESULT_UINT, /* DIV, PARTITION and PREFER */
+    HTTP_KEY_RESULT_BYTES, /* PARAM and VALUE (Vary) */
+} http_key_result_type;
+
+typedef struct {
+    http_key_result_type type;
+    uint64_t value;    /* BOOL (0 or 1) and UINT */
+    const char *bytes; /* BYTES, pointing into the buffer passed to http_key_eval_typed() */
+    size_t len;
+} http_key_result_t;
+
 typedef enum {
     HTTP_KEY_PARSE_OK,
     HTTP_KEY_PARSE_ERROR,
@@ -105,15 +240,403 @@ http_key_t *http_key_init(http_key_t *key, http_key_header_t get_header, http_ke
                           size_t arena_size, http_key_cache_store_t cache_store, http_key_cache_lookup_t cache_lookup,
                           void *cache_data);
 
+/**
+ * @brief Normalize the values of a header before evaluation
+ *
+ * This is configured right after http_key_init(), and applies to all evaluations with this key.
+ * Values that differ only in e.g. case or list order (such as "gzip, deflate" and "Deflate,gzip")
+ * then produce the same output, which avoids needless cache variants. The normalization is done in
+ * a fixed size scratch area on the stack, and values too large for it are evaluated as is. A sorted
+ * value may take half the scratch area, with any number of list items. The header string is not
+ * copied, and must outlive the key.
+ *
+ * @param flags The HTTP_KEY_NORMALIZE_* flags, or 0 to remove the normalization for the header.
+ * @return 0 on success, or -1 if there's no room for more headers.
+ */
+int http_key_normalize(http_key_t *key, const char *header, unsigned int flags);
+
+/**
+ * @brief Limit the work done by each evaluation with this key
+ *
+ * Hostile header values (e.g. a 64 KB Cookie, or thousands of commas) otherwise make the cost of
+ * an evaluation grow with the input. An evaluation fails, as on any other evaluation error, when a
+ * header value is longer than max_value_len, or has more than max_tokens comma separated items,
+ * or when the values handed to the parameters add up to more than max_bytes. This keeps the worst
+ * case cost of an evaluation linear in, and capped by, the budget. The checks are done before any
+ * parameter scans the value, so the failure is deterministic. Zero means no limit, which is the
+ * default after http_key_init().
+ */
+void http_key_budget(http_key_t *key, size_t max_value_len, size_t max_tokens, size_t max_bytes);
+
+/**
+ * @brief Number of evaluations that were aborted because they exceeded the budget
+ */
+size_t http_key_budget_exceeded(http_key_t *key);
+
+/**
+ * @brief Sample the time spent in each parameter, and in each header lookup, of the evaluations
+ *
+ * One in every sample_rate calls to http_key_eval() with this key in each thread is evaluated on the
+ * parameter list, without any plan, memo or precompiled evaluator, timing each call to the header callback
+ * and to the evaluators. The times go into log-linear histograms for each parameter type on each
+ * header, see http_key_profile_stats(). The histograms are allocated with the key's malloc callback,
+ * and a rate of 0 stops sampling and frees them. This must not be called during evaluations.
+ *
+ * @return 0 on success, non-zero if out of memory.
+ */
+int http_key_profile(http_key_t *key, size_t sample_rate);
+
+/**
+ * @brief Retrieve the sampled profile, for up to max_stats parameter types and headers
+ *
+ * @return The number of entries filled in.
+ */
+size_t http_key_profile_stats(http_key_t *key, http_key_profile_stats_t *stats, size_t max_stats);
+
+/**
+ * @brief Retrieve the sampled profile for the type and header of the first parameter in params
+ *
+ * @return 1 if the parameter has been sampled, 0 otherwise.
+ */
+int http_key_profile_param(http_key_t *key, http_key_params_t params, http_key_profile_stats_t *stats);
+
+/**
+ * @brief Register a precompiled evaluator for a Key string
+ *
+ * Keys parsed with http_key_parse_alloc() from exactly this Key string (byte for byte) then use
+ * the evaluator in http_key_eval(), instead of interpreting the parameters. The evaluators are
+ * generated with key-cmd --emit-c, which also generates a function registering all of them. The
+ * parameters are still parsed, for all the other APIs, and the evaluator is not used while any
+ * normalization or budget is configured. The Key string is not copied, it must outlive the key.
+ * Returns 0 on success, or -1 if there are already HTTP_KEY_MAX_COMPILED evaluators.
+ */
+int http_key_register(http_key_t *key, const char *key_string, http_key_compiled_t eval);
+
+/**
+ * @brief The exact buffer size http_key_parse() needs for a Key string
+ *
+ * The Key string is parsed without allocating or writing anything, with the same per-type alignment
+ * of the parameters as http_key_parse() uses, so a buffer of exactly this size holds the parsed Key.
+ * The buffer must be aligned as by malloc(). Returns 0 if the Key string fails to parse. A Key in a
+ * caller buffer is only promoted to an optimized plan if the buffer has room to spare for it, since
+ * the library never allocates on behalf of such a Key.
+ */
+size_t http_key_parse_size(const char *key_string, size_t key_string_len);
+
 http_key_parse_status http_key_parse(void *buffer, size_t buffer_size, const char *key_string, size_t key_string_len,
                                      http_key_params_t *params, size_t *num_params);
 http_key_parse_status http_key_parse_alloc(http_key_t *key, const char *key_string, size_t key_string_len,
                                            http_key_params_t *params, size_t *num_params);
 
+/**
+ * @brief Parse many Key strings at once, e.g. when loading a large configuration
+ *
+ * This is the same as calling http_key_parse_alloc() for each Key string, except that the Keys are
+ * carved out of a few shared allocations, each Key only taking the space it needs. All the header
+ * names and parameter values are interned, and stored only once. Each Key is still released with
+ * http_key_release(), and the shared memory is freed when all the Keys are released. The lengths
+ * can be NULL for NULL terminated Key strings.
+ *
+ * @return HTTP_KEY_PARSE_OK if all Keys parsed. Otherwise, the params of the failed Keys are NULL,
+ * and the others are still valid.
+ */
+http_key_parse_status http_key_parse_many(http_key_t *key, const char *const *key_strings, const size_t *key_string_lens,
+                                          size_t num_keys, http_key_params_t *params);
+
+/**
+ * @brief Copy a parsed Key into a tightly packed buffer
+ *
+ * This is meant for Keys going into long lived storage, e.g. a cache of parsed Keys, where the
+ * unused part of an arena_size allocation would otherwise be kept around for the life of the Key.
+ * The copy only takes the bytes it needs, and is independent of the original, which can then be
+ * released. As with http_key_parse(), the buffer is owned by the caller, and must be aligned as by
+ * malloc(). The copy keeps any registered evaluator, but starts without a memo or optimized plan.
+ *
+ * @return The size needed for the copy, which is only made if the buffer is at least this large.
+ * Without a buffer, this only calculates the size. Returns 0 for an empty Key.
+ */
+size_t http_key_compact(http_key_params_t params, void *buffer, size_t buffer_size, http_key_params_t *compacted);
+
+/**
+ * @brief Parse a Vary header, and optionally a Key header, into one parameter list
+ *
+ * Every header listed in Vary becomes a VALUE parameter, producing the whole header value (length
+ * prefixed, e.g. "4:gzip") or "none". The Key parameters, if any, follow the Vary parameters, so a
+ * response with both is evaluated in one http_key_eval() pass, and a header used by both is fetched
+ * once when the Key is hot (see plan.c). Either string can be empty. A Vary of "*" is an error,
+ * since no request can match it.
+ */
+http_key_parse_status http_key_parse_vary(void *buffer, size_t buffer_size, const char *vary_string, size_t vary_string_len,
+                                          const char *key_string, size_t key_string_len, http_key_params_t *params,
+                                          size_t *num_params);
+http_key_parse_status http_key_parse_vary_alloc(http_key_t *key, const char *vary_string, size_t vary_string_len,
+                                                const char *key_string, size_t key_string_len, http_key_params_t *params,
+                                                size_t *num_params);
+
 size_t http_key_eval(http_key_t *http_key, void *header_data, http_key_params_t params, char *buf, size_t buf_size);
 
+/**
+ * @brief Start an evaluation that can be suspended while header values are not yet available
+ *
+ * This is for e.g. an event loop decoding headers lazily, or headers that arrive late as trailers
+ * or through async lookups. The header callback returns HTTP_KEY_VALUE_PENDING for a value that is
+ * not available yet, and the evaluation then stops at the first parameter using that header, with
+ * the output so far kept in the buffer. Once the value is available, http_key_eval_resume() picks up
+ * from that parameter, without redoing the parameters already evaluated. The buffer must stay valid
+ * until the evaluation is done. The output is exactly what http_key_eval() produces, but the header
+ * callback must only return HTTP_KEY_VALUE_PENDING for evaluations started with this function.
+ *
+ * @return The output length, 0 on errors, or HTTP_KEY_PENDING if a header value is pending.
+ */
+size_t http_key_eval_start(http_key_t *key, http_key_eval_state_t *state, void *header_data, http_key_params_t params, char *buf,
+                           size_t buf_size);
+
+/**
+ * @brief Resume a suspended evaluation, with the same return values as http_key_eval_start()
+ *
+ * The header data can be different from before, e.g. with more headers decoded. Resuming an
+ * evaluation that is not pending returns 0.
+ */
+size_t http_key_eval_resume(http_key_t *key, http_key_eval_state_t *state, void *header_data);
+
+/**
+ * @brief Check if a parsed Key evaluates to a stored secondary key
+ *
+ * This is the same as comparing the output of http_key_eval() with stored, except that each
+ * parameter is compared as soon as it's evaluated. At the first mismatch, this returns without
+ * fetching any more headers or running any more evaluators, which is most of the work saved when
+ * validating a cached variant that does not match. An evaluation failure never matches.
+ *
+ * @return 1 if the Key evaluates to exactly stored, 0 otherwise.
+ */
+int http_key_eval_matches(http_key_t *key, void *header_data, http_key_params_t params, const char *stored, size_t stored_len);
+
+/**
+ * @brief Create an index over the stored variants of one parsed Key
+ *
+ * The stored secondary keys (the http_key_eval() outputs) are kept in a trie, and a lookup walks it
+ * while evaluating the parameters in order. This finds the matching variant in time proportional
+ * to the output of the Key, regardless of the number of variants, and stops at the first parameter
+ * that no variant matches. The index holds a reference to the params, and is allocated with the
+ * key's malloc / free callbacks. Lookups can run concurrently, but adding or removing variants
+ * must be serialized with all other uses of the index.
+ *
+ * @return The index, or NULL if the allocation failed.
+ */
+http_key_index_t http_key_index_create(http_key_t *key, http_key_params_t params);
+void http_key_index_destroy(http_key_index_t index);
+
+/**
+ * @brief Add a stored variant to the index, replacing the ID of an identical one
+ * @return 0 on success, -1 if the allocation failed or the variant ID is HTTP_KEY_NO_VARIANT.
+ */
+int http_key_index_add(http_key_index_t index, const char *stored, size_t stored_len, size_t variant);
+
+/**
+ * @brief Remove a stored variant from the index, e.g. when it's evicted from the cache
+ */
+void http_key_index_remove(http_key_index_t index, const char *stored, size_t stored_len);
+
+/**
+ * @brief Find the stored variant matching the request headers
+ * @return The variant ID, or HTTP_KEY_NO_VARIANT.
+ */
+size_t http_key_index_lookup(http_key_index_t index, void *header_data);
+
+/**
+ * @brief Evaluate a parsed Key into typed results, one per parameter
+ *
+ * This produces the same information as http_key_eval(), without any formatting. The BYTES results
+ * are copied into buf, which is only needed for Keys with PARAM or VALUE parameters. The results
+ * can be turned into a compact cache key with http_key_encode().
+ *
+ * @return The number of results, or 0 on an evaluation failure or if num_results is too small.
+ */
+size_t http_key_eval_typed(http_key_t *key, void *header_data, http_key_params_t params, http_key_result_t *results,
+                           size_t num_results, char *buf, size_t buf_size);
+
+/**
+ * @brief Evaluate a parsed Key into scatter segments, without copying the header values
+ *
+ * The segments, concatenated, are exactly the output of http_key_eval(). The constant results
+ * ("0", "1" and "none") point to static storage, and VALUE (Vary) results to the header values
+ * returned by the header callback, which must stay valid while the segments are used. Only the
+ * numbers, VALUE length prefixes and normalized values are written to buf. Adjacent segments are
+ * merged.
+ *
+ * @return The number of segments, or 0 on an evaluation failure or if iov_len or buf is too small.
+ */
+size_t http_key_eval_iov(http_key_t *key, void *header_data, http_key_params_t params, struct iovec *iov, size_t iov_len,
+                         char *buf, size_t buf_size);
+
+/**
+ * @brief Encode typed results into a compact binary cache key
+ *
+ * Every result gets a 2 bit tag (none, false, true, or a value follows), packed four to a byte,
+ * so BOOL results take no other space. This is followed by the UINT results as varints, and the
+ * BYTES results as a varint length and the bytes, in parameter order. Results of the same Key
+ * always have the same types, so two encodings are equal exactly when the results are.
+ *
+ * @return The length of the encoding, or 0 if it does not fit in buf.
+ */
+size_t http_key_encode(const http_key_result_t *results, size_t num_results, unsigned char *buf, size_t buf_size);
+
+/**
+ * @brief Maximum number of bytes http_key_eval() can produce for a parsed Key
+ *
+ * This is calculated at parse time. If the Key has parameters whose output depends on the header
+ * value (PARAM), HTTP_KEY_UNBOUNDED is returned. An evaluation buffer of at least this size lets
+ * http_key_eval() skip all per-parameter bounds checks.
+ */
+size_t http_key_max_output_len(http_key_params_t params);
+
+/**
+ * @brief Worst-case number of distinct secondary keys a parsed Key can produce
+ *
+ * This is the product of the cardinality of each parameter, where MATCH and SUBSTR have 3
+ * ("0", "1" and "none"), PARTITION and PREFER have one more than the number of segments or
+ * values, plus "none". If any parameter is unbounded (DIV, PARAM), or the product overflows,
+ * HTTP_KEY_UNBOUNDED is returned.
+ */
+size_t http_key_cardinality(http_key_params_t params);
+
+/**
+ * @brief Retrieve introspection details for one parameter
+ *
+ * Fills in the info structure for the first parameter in params, and returns the next parameter,
+ * or NULL at the end of the list. The strings in info are owned by the parsed Key.
+ */
+http_key_params_t http_key_param_info(http_key_params_t params, http_key_param_info_t *info);
+
+/**
+ * @brief Take another reference to a parsed Key
+ *
+ * A parsed Key starts out with one reference, owned by the caller of the parser. Every reference
+ * must be given up with http_key_release(), and the Key is destroyed when the last reference is
+ * released. The reference counting is atomic, so e.g. a Key returned from a cache lookup can be
+ * retained by a worker thread while the cache evicts (releases) it concurrently.
+ *
+ * A parsed Key is immutable after parsing, and http_key_eval() only reads the parameters (the
+ * evaluation counter and the promotion to an optimized plan are atomic), so any number of threads
+ * can evaluate the same Key concurrently, without locking. This includes a Key with a memo attached,
+ * see http_key_memo_attach().
+ *
+ * @return The same params, for convenience.
+ */
+http_key_params_t http_key_retain(http_key_params_t params);
+
+/**
+ * @brief Give up a reference to a parsed Key
+ *
+ * When the last reference is released, the Key is destroyed. For Keys parsed with
+ * http_key_parse_alloc(), this also frees the memory; for http_key_parse() the buffer is owned by
+ * the caller, and must not be reused until the last reference is released.
+ */
 void http_key_release(http_key_params_t params);
 
+/**
+ * @brief Attach a result memo to a parsed Key
+ *
+ * The memo maps a hash of all the header values fetched during an evaluation to the output, such
+ * that repeated header values only costs a hash, a compare and a copy. The memo is a direct mapped
+ * table of num_entries (rounded up to a power of two) entries, each entry_size bytes, holding both
+ * the header values (to verify hits) and the output. Results that don't fit in an entry are not
+ * memoized. The memo is allocated with the Key's malloc callback, and freed by http_key_release().
+ *
+ * The memo is shared by all the threads evaluating the Key. Each entry is versioned, such that a hit
+ * only reads it, and an entry that another thread is writing at the same time is treated as a miss
+ * (and not stored). The memo must be attached before the Key is shared with other threads.
+ *
+ * @return 0 on success, -1 if the memo could not be allocated, or the Key already has one.
+ */
+int http_key_memo_attach(http_key_t *key, http_key_params_t params, size_t num_entries, size_t entry_size);
+
+/**
+ * @brief Retrieve the number of hits and misses of the memo for a parsed Key
+ */
+void http_key_memo_stats(http_key_params_t params, size_t *hits, size_t *misses);
+
+/**
+ * @brief Create a memo for the evaluations on one HTTP/2 or HTTP/3 connection
+ *
+ * On these connections, a header value that repeats is sent as an index into the connection's
+ * dynamic table, and the decoder knows it is the same value as before without comparing it. The
+ * memo maps a parsed Key and the table entry ID of a header value to the output already computed
+ * for that header, see http_key_eval_conn(). The memo is a direct mapped table of num_entries
+ * (rounded up to a power of two), allocated with the key's malloc callback. It is not thread safe,
+ * but a connection is usually served by one thread at a time anyways.
+ */
+http_key_conn_t http_key_conn_create(http_key_t *key, size_t num_entries);
+
+/**
+ * @brief Destroy a connection memo, when the connection closes
+ *
+ * The memo holds a reference to each Key it has outputs for, which are released here.
+ */
+void http_key_conn_destroy(http_key_conn_t conn);
+
+/**
+ * @brief Evaluate a Key for a request on a connection, memoized on the table entries
+ *
+ * This produces exactly what http_key_eval() does, with the header values from get_header_id()
+ * instead of the key's get_header callback. The entry IDs must never be reused for a different value
+ * of the same header on the connection, e.g. the absolute index of a dynamic table entry (the number
+ * of insertions before it) offset past the static table. A header value with an ID that was seen
+ * before skips the evaluation of all the parameters for that header, and values without an ID are
+ * always evaluated. Budgets and normalization apply as usual, except that a memoized value is not
+ * normalized again, so the normalization must not change during the life of the connection.
+ */
+size_t http_key_eval_conn(http_key_t *key, http_key_conn_t conn, http_key_header_id_t get_header_id, void *header_data,
+                          http_key_params_t params, char *buf, size_t buf_size);
+
+/**
+ * @brief Retrieve the number of hits and misses of a connection memo, for values with an entry ID
+ */
+void http_key_conn_stats(http_key_conn_t conn, size_t *hits, size_t *misses);
+
+/**
+ * @brief Create an index of raw HTTP/1.x header blocks, for the headers used by a set of Keys
+ *
+ * The index keeps only the headers that the parameters of the given Keys (including Vary) refer to,
+ * and is reused from one header block to the next, see http_key_block_index(). It refers to the header
+ * names of the Keys, so the Keys must outlive the index. It is allocated with the key's malloc
+ * callback, and is not thread safe, so each thread indexes with its own.
+ */
+http_key_block_t http_key_block_create(http_key_t *key, const http_key_params_t *params, size_t num_params);
+
+/**
+ * @brief Destroy an index of header blocks
+ */
+void http_key_block_destroy(http_key_block_t block);
+
+/**
+ * @brief Index one raw HTTP/1.x header block, up to and including the empty line that terminates it
+ *
+ * Lines that are not headers used by the Keys, such as the request or status line, are skipped
+ * without looking at more than the name. Repeated headers are joined with ", " in the order of the
+ * lines, as for a list, while everything else points into the data, which must be kept until the
+ * evaluations of the block are done. At the end of the data, a block without the empty line is
+ * complete as well when at_eof is set.
+ *
+ * @return The number of bytes consumed, or 0 if the block is incomplete (or out of memory).
+ */
+size_t http_key_block_index(http_key_block_t block, const char *data, size_t len, int at_eof);
+
+/**
+ * @brief The number of lines in the last indexed block, used by the Keys or not
+ *
+ * This is 0 for a block of only empty lines, e.g. trailing at the end of the data.
+ */
+size_t http_key_block_lines(http_key_block_t block);
+
+/**
+ * @brief The header callback for an indexed block, which is passed as the header_data
+ *
+ * Use this as the get_header callback of http_key_init(), and evaluate the Keys with
+ * http_key_eval(key, block, params, buf, buf_size) after each http_key_block_index().
+ */
+const char *http_key_block_get(void *block, const char *header, size_t header_len, size_t *value_len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,723 @@
+/** @file
+
+    C++17 interface for the HTTP Key library. Use it like
+
+        #include <http/key.hpp>
+
+    There are two ways to evaluate a Key from C++:
+
+    1) http::key::Key<Data, Getter> wraps an http_key_t, with RAII handles (http::key::Params) for
+       the parsed Keys, and std::string_view in place of pointer / length pairs. The Getter is any
+       callable taking (Data &, std::string_view header) and returning the header value as a
+       std::string_view, empty if the header is missing. It is called from a callback generated for
+       the Getter type, where it can be inlined. This is the library itself, so it supports
+       everything the C API does (Vary, normalization, memos, budgets etc.).
+
+    2) http::key::compile() turns a literal Key string into a Program at compile time, e.g.
+
+           static constexpr auto accept = http::key::compile("Accept-Encoding;substr=gzip");
+           static_assert(accept.valid());
+
+       A Program is evaluated entirely in this header, with the Getter called directly, so the whole
+       evaluation can be inlined. It produces exactly the same output as http_key_eval() with the same
+       Key string, but it evaluates the raw header values (no normalization, memo or budget).
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#ifndef HTTP_KEY_HPP
+#define HTTP_KEY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+#include "http/key.h"
+
+namespace http::key
+{
+/* These are the same as the C library helpers (in the "C" locale), but usable in constant expressions */
+namespace detail
+{
+    constexpr bool
+    is_space(char c)
+    {
+        return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\v') || (c == '\f') || (c == '\r');
+    }
+
+    constexpr bool
+    is_digit(char c)
+    {
+        return (c >= '0') && (c <= '9');
+    }
+
+    constexpr char
+    to_lower(char c)
+    {
+        return ((c >= 'A') && (c <= 'Z')) ? c + ('a' - 'A') : c;
+    }
+
+    constexpr bool
+    iequals(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (std::size_t i = 0; i < a.size(); ++i) {
+            if (to_lower(a[i]) != to_lower(b[i])) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /* Same as key_strsep(): the next token, with leading and trailing whitespace stripped. This returns
+       0 at the end of the value, and also at an empty token. */
+    constexpr std::size_t
+    strsep(std::string_view value, std::size_t &pos, std::size_t &start, char separator)
+    {
+        std::size_t end = 0;
+
+        while ((pos < value.size()) && is_space(value[pos])) {
+            ++pos;
+        }
+        if (pos >= value.size()) {
+            return 0;
+        }
+        start = pos;
+        if ((end = value.find(separator, pos)) == std::string_view::npos) {
+            end = pos = value.size();
+        } else {
+            pos = end + 1;
+        }
+        while ((end > start + 1) && is_space(value[end - 1])) {
+            --end;
+        }
+
+        return end - start;
+    }
+
+    /* Same as key_empty_item_before(): is there an empty item in the list before pos? */
+    constexpr bool
+    empty_item_before(std::string_view value, std::size_t pos)
+    {
+        std::size_t item = 0;
+
+        while (item < pos) {
+            while ((item < pos) && is_space(value[item])) {
+                ++item;
+            }
+            if ((item < pos) && (',' == value[item])) {
+                return true;
+            }
+            if ((item = value.substr(0, pos).find(',', item)) == std::string_view::npos) {
+                return false;
+            }
+            ++item;
+        }
+
+        return false;
+    }
+
+    /* Same as key_memtoll() */
+    constexpr std::uint64_t
+    memtoll(std::string_view str)
+    {
+        std::uint64_t ret = 0;
+        std::size_t i = 0;
+
+        while ((i < str.size()) && is_space(str[i])) {
+            ++i;
+        }
+        while ((i < str.size()) && is_digit(str[i])) {
+            ret = ret * 10 + str[i++] - '0';
+        }
+
+        return ret;
+    }
+
+    /* Same as key_print_uint() */
+    constexpr std::size_t
+    print_uint(std::uint64_t value, char *buf, std::size_t buf_len)
+    {
+        char digits[20] = {};
+        std::size_t len = 0;
+
+        do {
+            digits[len++] = '0' + (value % 10);
+            value /= 10;
+        } while (value);
+
+        if (len > buf_len) {
+            return 0;
+        }
+        for (std::size_t i = 0; i < len; ++i) {
+            buf[i] = digits[len - i - 1];
+        }
+
+        return len;
+    }
+
+    constexpr std::size_t
+    digits(std::uint64_t value)
+    {
+        std::size_t len = 1;
+
+        while (value >= 10) {
+            value /= 10;
+            ++len;
+        }
+
+        return len;
+    }
+
+    /* Same as key_qvalue(), 0 - 1000 or -1 if malformed */
+    constexpr int
+    qvalue(std::string_view str)
+    {
+        int q = 0, scale = 1000;
+        std::size_t i = 1;
+
+        if (str.empty() || ((str[0] != '0') && (str[0] != '1'))) {
+            return -1;
+        }
+        q = (str[0] - '0') * 1000;
+        if (i < str.size()) {
+            if (str[i++] != '.') {
+                return -1;
+            }
+            while ((i < str.size()) && (scale > 1) && is_digit(str[i])) {
+                scale /= 10;
+                q += (str[i++] - '0') * scale;
+            }
+            if (i < str.size()) {
+                return -1;
+            }
+        }
+
+        return q > 1000 ? 1000 : q;
+    }
+
+    /* The Getter adapter for the C callback, the header_data points to one of these */
+    template <typename Data, typename Getter> struct Call {
+        const Getter *get;
+        Data *data;
+
+        static const char *
+        get_header(void *header_data, const char *header, std::size_t header_len, std::size_t *value_len)
+        {
+            const Call *call = static_cast<const Call *>(header_data);
+            std::string_view value = (*call->get)(*call->data, std::string_view(header, header_len));
+
+            *value_len = value.size();
+            return value.empty() ? nullptr : value.data();
+        }
+    };
+} // namespace detail
+
+/**
+ * @brief A parsed Key, which is released when the last copy goes away
+ *
+ * Copies share the parsed Key with http_key_retain(), so they can be handed to other threads.
+ */
+class Params
+{
+public:
+    Params() noexcept = default;
+
+    /* Takes over the reference, e.g. from http_key_parse_alloc() */
+    Params(http_key_params_t params, std::size_t num_params) noexcept : _params(params), _num_params(num_params) {}
+
+    Params(const Params &other) noexcept : _params(http_key_retain(other._params)), _num_params(other._num_params) {}
+
+    Params(Params &&other) noexcept
+        : _params(std::exchange(other._params, nullptr)), _num_params(std::exchange(other._num_params, 0))
+    {
+    }
+
+    Params &
+    operator=(Params other) noexcept
+    {
+        std::swap(_params, other._params);
+        std::swap(_num_params, other._num_params);
+        return *this;
+    }
+
+    ~Params() { http_key_release(_params); }
+
+    explicit operator bool() const noexcept { return _params != nullptr; }
+
+    http_key_params_t
+    get() const noexcept
+    {
+        return _params;
+    }
+
+    std::size_t
+    size() const noexcept
+    {
+        return _num_params;
+    }
+
+    std::size_t
+    max_output_len() const noexcept
+    {
+        return http_key_max_output_len(_params);
+    }
+
+    std::size_t
+    cardinality() const noexcept
+    {
+        return http_key_cardinality(_params);
+    }
+
+private:
+    http_key_params_t _params = nullptr;
+    std::size_t _num_params = 0;
+};
+
+/**
+ * @brief The parameter types of a Program, same as those of the Key header
+ */
+enum class Type { div, partition, match, substr, param, prefer };
+
+/**
+ * @brief A Key string parsed at compile time, see compile()
+ *
+ * The Key string is copied into the Program, and the parameters refer to it by offset, such that
+ * a Program can be copied freely. L is the max length of the Key string.
+ */
+template <std::size_t L> class Program
+{
+public:
+    struct Step {
+        Type type = Type::div;
+        std::size_t header = 0, header_len = 0;
+        std::size_t arg = 0, arg_len = 0;
+        std::uint64_t divider = 0;
+        std::size_t codings[HTTP_KEY_MAX_PREFER] = {};
+        std::size_t coding_lens[HTTP_KEY_MAX_PREFER] = {};
+        std::size_t num_codings = 0;
+    };
+
+    /* Every parameter takes at least 4 characters, e.g. ";a=b" */
+    static constexpr std::size_t max_steps = L / 4 + 1;
+
+    /* Same parsing as http_key_parse(), except that an invalid Key string makes an invalid Program */
+    constexpr explicit Program(std::string_view key_string)
+    {
+        std::size_t comma_pos = 0, comma_start = 0, comma_len = 0;
+
+        if (key_string.size() > L) {
+            return;
+        }
+        for (std::size_t i = 0; i < key_string.size(); ++i) {
+            _text[i] = key_string[i];
+        }
+        _len = key_string.size();
+
+        while ((comma_len = detail::strsep(text(), comma_pos, comma_start, ',')) > 0) {
+            std::string_view item = text().substr(comma_start, comma_len);
+            std::size_t semi_pos = 0, semi_start = 0, semi_len = 0;
+            std::size_t header = 0, header_len = 0;
+
+            while ((semi_len = detail::strsep(item, semi_pos, semi_start, ';')) > 0) {
+                if (0 == header_len) {
+                    header = comma_start + semi_start;
+                    header_len = semi_len;
+                    for (std::size_t i = header; i < header + header_len; ++i) {
+                        _text[i] = detail::to_lower(_text[i]);
+                    }
+                } else if (!add(comma_start + semi_start, semi_len, header, header_len)) {
+                    return;
+                }
+            }
+        }
+        _valid = true;
+    }
+
+    constexpr bool
+    valid() const
+    {
+        return _valid;
+    }
+
+    constexpr std::size_t
+    size() const
+    {
+        return _num_steps;
+    }
+
+    constexpr const Step &
+    operator[](std::size_t i) const
+    {
+        return _steps[i];
+    }
+
+    constexpr std::string_view
+    header(const Step &step) const
+    {
+        return text().substr(step.header, step.header_len);
+    }
+
+    /* Same as http_key_max_output_len(), e.g. for sizing the output buffer at compile time */
+    constexpr std::size_t
+    max_output_len() const
+    {
+        std::size_t total = 0;
+
+        for (std::size_t i = 0; i < _num_steps; ++i) {
+            const Step &step = _steps[i];
+            std::size_t len = 1;
+
+            switch (step.type) {
+            case Type::div:
+                len = detail::digits(step.divider ? UINT64_MAX / step.divider : UINT64_MAX);
+                break;
+            case Type::prefer:
+                len = detail::digits(step.num_codings);
+                break;
+            case Type::param:
+                return HTTP_KEY_UNBOUNDED;
+            default:
+                break;
+            }
+            total += len > 4 ? len : 4;
+        }
+
+        return total;
+    }
+
+    /* Same output as http_key_eval(), 0 on errors. Each header is fetched once per run of parameters on it. */
+    template <typename Getter, typename Data>
+    constexpr std::size_t
+    eval(const Getter &get, Data &data, char *buf, std::size_t buf_size) const
+    {
+        std::string_view value;
+        std::size_t last_header = 0, last_header_len = 0;
+        std::size_t pos = 0;
+
+        for (std::size_t i = 0; i < _num_steps; ++i) {
+            const Step &step = _steps[i];
+            std::size_t len = 0;
+
+            if ((step.header != last_header) || (step.header_len != last_header_len)) {
+                value = get(data, header(step));
+                last_header = step.header;
+                last_header_len = step.header_len;
+            }
+
+            if (value.empty()) {
+                if ((buf_size - pos) < 4) {
+                    return 0;
+                }
+                buf[pos++] = 'n';
+                buf[pos++] = 'o';
+                buf[pos++] = 'n';
+                buf[pos++] = 'e';
+            } else if ((pos < buf_size) && ((len = eval_step(step, value, buf + pos, buf_size - pos)) > 0)) {
+                pos += len;
+            } else {
+                return 0; /* Error. We choose to abort the entire evaluation, as per the RFC. */
+            }
+        }
+
+        return pos;
+    }
+
+private:
+    constexpr std::string_view
+    text() const
+    {
+        return std::string_view(_text, _len);
+    }
+
+    /* Same as key_factory() */
+    constexpr bool
+    add(std::size_t start, std::size_t len, std::size_t header, std::size_t header_len)
+    {
+        std::string_view param = text().substr(start, len);
+        std::size_t delim = param.find('=');
+        Step step;
+
+        if ((delim == std::string_view::npos) || (_num_steps == max_steps)) {
+            return false;
+        }
+        step.header = header;
+        step.header_len = header_len;
+        step.arg = start + delim + 1;
+        step.arg_len = len - delim - 1;
+
+        std::string_view type = param.substr(0, delim);
+        std::string_view arg = param.substr(delim + 1);
+
+        if (detail::iequals(type, "div")) {
+            step.type = Type::div;
+            step.divider = detail::memtoll(arg);
+        } else if (detail::iequals(type, "partition")) {
+            step.type = Type::partition;
+        } else if (detail::iequals(type, "match")) {
+            step.type = Type::match;
+        } else if (detail::iequals(type, "param")) {
+            step.type = Type::param;
+        } else if (detail::iequals(type, "substr")) {
+            step.type = Type::substr;
+        } else if (detail::iequals(type, "prefer")) {
+            std::size_t coding_pos = 0, coding_start = 0, coding_len = 0;
+
+            step.type = Type::prefer;
+            while ((coding_len = detail::strsep(arg, coding_pos, coding_start, ':')) > 0) {
+                if (step.num_codings >= HTTP_KEY_MAX_PREFER) {
+                    return false;
+                }
+                step.codings[step.num_codings] = step.arg + coding_start;
+                step.coding_lens[step.num_codings++] = coding_len;
+                for (std::size_t i = step.arg + coding_start; i < step.arg + coding_start + coding_len; ++i) {
+                    _text[i] = detail::to_lower(_text[i]);
+                }
+            }
+            if (0 == step.num_codings) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+        _steps[_num_steps++] = step;
+
+        return true;
+    }
+
+    /* The evaluators, same as those in evaluators.c. The value is never empty here, and buf has room for at
+       least one character. */
+    constexpr std::size_t
+    eval_step(const Step &step, std::string_view value, char *buf, std::size_t buf_size) const
+    {
+        std::string_view arg = text().substr(step.arg, step.arg_len);
+        std::size_t pos = 0, start = 0, len = 0;
+
+        switch (step.type) {
+        case Type::div:
+            if ((0 == step.divider) || !(len = detail::strsep(value, pos, start, ','))) {
+                return 0;
+            }
+            return detail::print_uint(detail::memtoll(value.substr(start, len)) / step.divider, buf, buf_size);
+        case Type::substr:
+            /* Same as key_eval_substr_value(), a substring that can't span items is searched for in the whole value */
+            if (!arg.empty() && (arg.find(',') == std::string_view::npos) && !detail::is_space(arg.front()) &&
+                !detail::is_space(arg.back())) {
+                pos = value.find(arg);
+                *buf = ((pos != std::string_view::npos) && !detail::empty_item_before(value, pos)) ? '1' : '0';
+                return 1;
+            }
+            [[fallthrough]];
+        case Type::match:
+            *buf = '0';
+            while ((len = detail::strsep(value, pos, start, ',')) > 0) {
+                std::string_view token = value.substr(start, len);
+
+                if ((step.type == Type::match) ? (token == arg) : (token.find(arg) != std::string_view::npos)) {
+                    *buf = '1';
+                    break;
+                }
+            }
+            return 1;
+        case Type::prefer:
+            return eval_prefer(step, value, buf, buf_size);
+        default:
+            return 0; /* PARTITION and PARAM are not implemented yet, the C evaluators always fail as well */
+        }
+    }
+
+    constexpr std::size_t
+    eval_prefer(const Step &step, std::string_view value, char *buf, std::size_t buf_size) const
+    {
+        int qvalues[HTTP_KEY_MAX_PREFER] = {};
+        int star = -1, best_q = 0;
+        std::size_t best = 0;
+        std::size_t pos = 0, start = 0, len = 0;
+
+        for (std::size_t i = 0; i < step.num_codings; ++i) {
+            qvalues[i] = -1;
+        }
+
+        while ((len = detail::strsep(value, pos, start, ',')) > 0) {
+            std::string_view token = value.substr(start, len);
+            std::size_t semi = token.find(';');
+            std::string_view coding = token.substr(0, semi);
+            int q = 1000;
+
+            while (!coding.empty() && detail::is_space(coding.back())) {
+                coding.remove_suffix(1);
+            }
+            if (semi != std::string_view::npos) {
+                std::string_view qparams = token.substr(semi + 1);
+                std::size_t qpos = 0, qstart = 0, qlen = 0;
+
+                while ((qlen = detail::strsep(qparams, qpos, qstart, ';')) > 0) {
+                    if ((qlen > 2) && (detail::to_lower(qparams[qstart]) == 'q') && (qparams[qstart + 1] == '=')) {
+                        q = detail::qvalue(qparams.substr(qstart + 2, qlen - 2));
+                    }
+                }
+            }
+
+            if (q >= 0) {
+                if (coding == "*") {
+                    star = q;
+                } else {
+                    for (std::size_t i = 0; i < step.num_codings; ++i) {
+                        if ((qvalues[i] < 0) && detail::iequals(coding, text().substr(step.codings[i], step.coding_lens[i]))) {
+                            qvalues[i] = q;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        for (std::size_t i = 0; i < step.num_codings; ++i) {
+            int q = qvalues[i] >= 0 ? qvalues[i] : star;
+
+            if (q > best_q) {
+                best_q = q;
+                best = i + 1;
+            }
+        }
+
+        return detail::print_uint(best, buf, buf_size);
+    }
+
+    char _text[L + 1] = {}; /* Never zero sized */
+    std::size_t _len = 0;
+    Step _steps[max_steps] = {};
+    std::size_t _num_steps = 0;
+    bool _valid = false;
+};
+
+/**
+ * @brief Parse a literal Key string into a Program, at compile time when used in a constant expression
+ */
+template <std::size_t N>
+constexpr Program<N - 1>
+compile(const char (&key_string)[N])
+{
+    return Program<N - 1>(std::string_view(key_string, N - 1));
+}
+
+/**
+ * @brief The C++ version of http_key_t, with the header lookups done by the Getter on Data
+ *
+ * A Key can not be copied or moved, since memos attached to parsed Keys refer to it.
+ */
+template <typename Data, typename Getter> class Key
+{
+    using Call = detail::Call<Data, Getter>;
+
+public:
+    explicit Key(Getter get = Getter(), std::size_t arena_size = 1024) : _get(std::move(get))
+    {
+        http_key_init(&_key, &Call::get_header, nullptr, nullptr, arena_size, nullptr, nullptr, nullptr);
+    }
+
+    Key(const Key &) = delete;
+    Key &operator=(const Key &) = delete;
+
+    http_key_t *
+    get() noexcept
+    {
+        return &_key;
+    }
+
+    /* The header string must outlive the Key, see http_key_normalize() */
+    int
+    normalize(const char *header, unsigned int flags) noexcept
+    {
+        return http_key_normalize(&_key, header, flags);
+    }
+
+    void
+    budget(std::size_t max_value_len, std::size_t max_tokens, std::size_t max_bytes) noexcept
+    {
+        http_key_budget(&_key, max_value_len, max_tokens, max_bytes);
+    }
+
+    std::size_t
+    budget_exceeded() noexcept
+    {
+        return http_key_budget_exceeded(&_key);
+    }
+
+    /* An empty Params on errors, and for a Key without any parameters */
+    Params
+    parse(std::string_view key_string, std::string_view vary = {})
+    {
+        http_key_params_t params;
+        std::size_t num_params;
+
+        if (HTTP_KEY_PARSE_OK != http_key_parse_vary_alloc(&_key, vary.data(), vary.size(), key_string.data(), key_string.size(),
+                                                           &params, &num_params)) {
+            return Params();
+        }
+
+        return Params(params, num_params);
+    }
+
+    /* The result is a view into buf, empty on errors */
+    std::string_view
+    eval(Data &data, const Params &params, char *buf, std::size_t buf_size)
+    {
+        Call call{&_get, &data};
+
+        return std::string_view(buf, http_key_eval(&_key, &call, params.get(), buf, buf_size));
+    }
+
+    template <std::size_t L>
+    std::string_view
+    eval(Data &data, const Program<L> &program, char *buf, std::size_t buf_size) const
+    {
+        return std::string_view(buf, program.eval(_get, data, buf, buf_size));
+    }
+
+    bool
+    matches(Data &data, const Params &params, std::string_view stored)
+    {
+        Call call{&_get, &data};
+
+        return http_key_eval_matches(&_key, &call, params.get(), stored.data(), stored.size());
+    }
+
+private:
+    http_key_t _key;
+    Getter _get;
+};
+
+} // namespace http::key
+
+#endif /* HTTP_KEY_HPP */
+
+/*
+  local variables:
+  mode: C++
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
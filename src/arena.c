@@ -34,11 +34,21 @@ key_arena_create(http_key_t *key, void *buffer, size_t size)
     if (buffer && (size >= HTTP_KEY_MIN_ARENA)) {
         key_arena_t *arena = (key_arena_t *)buffer;
 
+        atomic_init(&arena->refcount, 1);
         arena->size = size;
         arena->pos = KEY_ARENA_ALIGN(sizeof(key_arena_t));
         arena->key = key; /* Can be NULL */
         arena->last_header = NULL;
         arena->last_header_len = 0;
+        arena->bounded_len = 0;
+        arena->num_unbounded = 0;
+        arena->memo = NULL;
+        atomic_init(&arena->evals, 0);
+        atomic_init(&arena->plan, NULL);
+        arena->compiled = NULL;
+        arena->intern = NULL;
+        arena->pool = NULL;
+        arena->scratch = NULL;
 
         return arena;
     }
@@ -46,25 +56,43 @@ key_arena_create(http_key_t *key, void *buffer, size_t size)
     return NULL;
 }
 
+/* Only arenas allocated by the library are freed, and an arena carved out of a pool releases the pool */
 void
 key_arena_destroy(key_arena_t *arena)
 {
+    key_arena_t *pool;
+
     assert(arena);
 
+    pool = arena->pool;
     if (arena->key) {
         arena->key->free(arena);
     }
+    if (pool) {
+        key_arena_release(pool);
+    }
+}
+
+void
+key_arena_release(key_arena_t *arena)
+{
+    if (1 == atomic_fetch_sub_explicit(&arena->refcount, 1, memory_order_acq_rel)) {
+        key_arena_destroy(arena);
+    }
 }
 
+/* Allocations are only aligned as much as asked for, e.g. strings are packed without any padding */
 void *
-key_arena_allocate(key_arena_t *arena, size_t size)
+key_arena_allocate(key_arena_t *arena, size_t size, size_t align)
 {
-    if (size <= (arena->pos - arena->size)) {
-        void *memory = (void *)((unsigned char *)arena + arena->pos);
+    size_t pos = (arena->pos + (align - 1)) & ~(align - 1);
 
-        arena->pos = KEY_ARENA_ALIGN(arena->pos + size);
-        return memory;
+    if ((pos >= arena->pos) && (pos <= arena->size) && (size <= (arena->size - pos))) {
+        arena->pos = pos + size;
+        /* A measuring arena hands out the same scratch memory for every allocation */
+        return arena->scratch ? arena->scratch : (void *)((unsigned char *)arena + pos);
     }
+
     return NULL;
 }
 
@@ -0,0 +1,407 @@
+/** @file
+
+    An index of raw HTTP/1.x header blocks, which only keeps the headers used by a set of Keys. The
+    block is scanned once, for the end of the header name and the end of the line, 16 bytes at a time
+    with SSE2. A line is skipped on the length of its name, or its hash, unless it's one of the
+    headers of the Keys, and repeated headers are joined up front. The Keys then evaluate on the
+    block, with http_key_block_get() as the header callback, and without copying any values.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <assert.h>
+
+#include "include/block.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif
+
+#if HAVE_STRINGS_H
+#include <strings.h>
+#endif
+
+/* FNV-1a of the case folded name. Folding with 0x20 also maps a few punctuation characters onto
+   others, which is fine since a hit is always confirmed with strncasecmp(). */
+static inline uint64_t
+key_block_hash(const char *name, size_t name_len)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < name_len; ++i) {
+        hash = (hash ^ (unsigned char)(name[i] | 0x20)) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+static inline uint64_t
+key_block_length_bit(size_t len)
+{
+    return 1ULL << ((len < 63) ? len : 63);
+}
+
+#define KEY_BLOCK_ONES 0x0101010101010101ULL
+#define KEY_BLOCK_HIGHS 0x8080808080808080ULL
+
+/* Non-zero if any byte of the word is the byte, times KEY_BLOCK_ONES */
+static inline uint64_t
+key_block_has_byte(uint64_t word, uint64_t bytes)
+{
+    word ^= bytes;
+
+    return (word - KEY_BLOCK_ONES) & ~word & KEY_BLOCK_HIGHS;
+}
+
+/* Find the first '\n', or also ':' when colon is set, at or after pos. Returns end if there is none. */
+static inline const char *
+key_block_scan(const char *pos, const char *end, int colon)
+{
+#if defined(__SSE2__)
+    const __m128i newlines = _mm_set1_epi8('\n');
+    const __m128i colons = _mm_set1_epi8(colon ? ':' : '\n');
+
+    while ((end - pos) >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)pos);
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, newlines), _mm_cmpeq_epi8(chunk, colons));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+#else
+    const uint64_t colons = KEY_BLOCK_ONES * (unsigned char)(colon ? ':' : '\n');
+
+    /* Eight bytes at a time, and the word with a hit is rescanned byte by byte below */
+    while ((end - pos) >= 8) {
+        uint64_t word;
+
+        memcpy(&word, pos, 8);
+        if (key_block_has_byte(word, KEY_BLOCK_ONES * '\n') || key_block_has_byte(word, colons)) {
+            break;
+        }
+        pos += 8;
+    }
+#endif
+    while ((pos < end) && ('\n' != *pos) && (!colon || (':' != *pos))) {
+        ++pos;
+    }
+
+    return pos;
+}
+
+static inline int
+key_block_space(char c)
+{
+    return (' ' == c) || ('\t' == c) || ('\r' == c);
+}
+
+/* The slot of the header, or NULL if it's not used by the Keys */
+static inline key_block_slot_t *
+key_block_slot(key_block_t *block, const char *name, size_t name_len, uint64_t hash)
+{
+    for (size_t i = 0; i < block->num_slots; ++i) {
+        key_block_slot_t *slot = &block->slots[i];
+
+        if ((slot->hash == hash) && (slot->name_len == name_len) && !strncasecmp(slot->name, name, name_len)) {
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+http_key_block_t
+http_key_block_create(http_key_t *key, const http_key_params_t *params, size_t num_params)
+{
+    size_t num_slots = 0;
+    key_block_t *block;
+
+    assert(key);
+
+    /* Count the distinct headers first, so the block is one allocation */
+    for (size_t i = 0; i < num_params; ++i) {
+        for (const key_common_t *param = (const key_common_t *)params[i]; param; param = param->next) {
+            int seen = 0;
+
+            for (size_t j = 0; (j <= i) && !seen; ++j) {
+                for (const key_common_t *p = (const key_common_t *)params[j]; p && (p != param); p = p->next) {
+                    if ((p->header_len == param->header_len) && !strncasecmp(p->header, param->header, param->header_len)) {
+                        seen = 1;
+                        break;
+                    }
+                }
+            }
+            num_slots += !seen;
+        }
+    }
+
+    if (!(block = (key_block_t *)key->malloc(sizeof(key_block_t) + num_slots * sizeof(key_block_slot_t)))) {
+        return NULL;
+    }
+    if (!(block->repeats = (key_block_repeat_t *)key->malloc(KEY_BLOCK_REPEATS * sizeof(key_block_repeat_t)))) {
+        key->free(block);
+        return NULL;
+    }
+    block->key = key;
+    block->lengths = 0;
+    block->num_lines = 0;
+    block->num_repeats = 0;
+    block->repeats_size = KEY_BLOCK_REPEATS;
+    block->join = NULL;
+    block->join_size = 0;
+    block->num_slots = 0;
+
+    for (size_t i = 0; i < num_params; ++i) {
+        for (const key_common_t *param = (const key_common_t *)params[i]; param; param = param->next) {
+            uint64_t hash = key_block_hash(param->header, param->header_len);
+
+            if (!key_block_slot(block, param->header, param->header_len, hash)) {
+                key_block_slot_t *slot = &block->slots[block->num_slots++];
+
+                slot->name = param->header;
+                slot->name_len = param->header_len;
+                slot->hash = hash;
+                slot->value = NULL;
+                slot->value_len = 0;
+                slot->count = 0;
+                block->lengths |= key_block_length_bit(param->header_len);
+            }
+        }
+    }
+
+    return block;
+}
+
+void
+http_key_block_destroy(http_key_block_t block)
+{
+    if (block) {
+        if (block->join) {
+            block->key->free(block->join);
+        }
+        block->key->free(block->repeats);
+        block->key->free(block);
+    }
+}
+
+size_t
+http_key_block_lines(http_key_block_t block)
+{
+    return block ? block->num_lines : 0;
+}
+
+/* Join the repeated headers with ", ", in the order of the lines. Returns 0 if out of memory. */
+static int
+key_block_join(key_block_t *block)
+{
+    size_t total = 0;
+    char *pos;
+
+    for (size_t i = 0; i < block->num_slots; ++i) {
+        if (block->slots[i].count > 1) {
+            total += block->slots[i].value_len;
+        }
+    }
+    for (size_t i = 0; i < block->num_repeats; ++i) {
+        total += 2 + block->repeats[i].value_len;
+    }
+
+    if (total > block->join_size) {
+        if (block->join) {
+            block->key->free(block->join);
+        }
+        block->join_size = 0;
+        if (!(block->join = (char *)block->key->malloc(total))) {
+            return 0;
+        }
+        block->join_size = total;
+    }
+
+    /* Each joined value is laid out in turn, which leaves its end where the next line appends */
+    pos = block->join;
+    for (size_t i = 0; i < block->num_slots; ++i) {
+        key_block_slot_t *slot = &block->slots[i];
+
+        if (slot->count > 1) {
+            size_t len = slot->value_len;
+
+            memcpy(pos, slot->value, len);
+            slot->value = pos;
+            for (size_t r = 0; r < block->num_repeats; ++r) {
+                const key_block_repeat_t *repeat = &block->repeats[r];
+
+                if (repeat->slot == i) {
+                    memcpy(pos + len, ", ", 2);
+                    memcpy(pos + len + 2, repeat->value, repeat->value_len);
+                    len += 2 + repeat->value_len;
+                }
+            }
+            slot->value_len = len;
+            pos += len;
+        }
+    }
+
+    return 1;
+}
+
+/* Remember a repeated line, to be joined at the end of the block. Returns 0 if out of memory. */
+static int
+key_block_repeat(key_block_t *block, size_t slot, const char *value, size_t value_len)
+{
+    if (block->num_repeats == block->repeats_size) {
+        size_t size = 2 * block->repeats_size * sizeof(key_block_repeat_t);
+        key_block_repeat_t *repeats = (key_block_repeat_t *)block->key->malloc(size);
+
+        if (!repeats) {
+            return 0;
+        }
+        memcpy(repeats, block->repeats, block->num_repeats * sizeof(key_block_repeat_t));
+        block->key->free(block->repeats);
+        block->repeats = repeats;
+        block->repeats_size *= 2;
+    }
+    block->repeats[block->num_repeats].slot = slot;
+    block->repeats[block->num_repeats].value = value;
+    block->repeats[block->num_repeats].value_len = value_len;
+    ++block->num_repeats;
+
+    return 1;
+}
+
+size_t
+http_key_block_index(http_key_block_t block, const char *data, size_t len, int at_eof)
+{
+    const char *pos = data;
+    const char *end = data + len;
+
+    assert(block);
+
+    block->num_lines = 0;
+    block->num_repeats = 0;
+    for (size_t i = 0; i < block->num_slots; ++i) {
+        block->slots[i].value = NULL;
+        block->slots[i].value_len = 0;
+        block->slots[i].count = 0;
+    }
+
+    while (1) {
+        const char *line = pos;
+        const char *colon = key_block_scan(pos, end, 1);
+        const char *eol = ((colon < end) && (':' == *colon)) ? key_block_scan(colon + 1, end, 0) : colon;
+        const char *last = eol;
+
+        if (pos == end) {
+            if (!at_eof) {
+                return 0; /* Wait for the rest of the block */
+            }
+            break;
+        }
+        if (eol == end) {
+            if (!at_eof) {
+                return 0;
+            }
+            pos = end;
+        } else {
+            pos = eol + 1;
+        }
+        while ((last > line) && ('\r' == last[-1])) {
+            --last;
+        }
+
+        if (last == line) {
+            if (block->num_lines > 0) {
+                break; /* End of the header block */
+            }
+            continue; /* Leading empty lines are skipped */
+        }
+        ++block->num_lines;
+
+        /* Lines without a colon, e.g. the request line, can't be headers */
+        if ((colon < eol) && (colon > line) && (block->lengths & key_block_length_bit(colon - line))) {
+            size_t name_len = colon - line;
+            key_block_slot_t *slot = key_block_slot(block, line, name_len, key_block_hash(line, name_len));
+
+            if (slot) {
+                const char *value = colon + 1;
+
+                while ((value < last) && key_block_space(*value)) {
+                    ++value;
+                }
+                while ((last > value) && key_block_space(last[-1])) {
+                    --last;
+                }
+                if (0 == slot->count++) {
+                    slot->value = value;
+                    slot->value_len = last - value;
+                } else if (!key_block_repeat(block, slot - block->slots, value, last - value)) {
+                    return 0;
+                }
+            }
+        }
+    }
+
+    if ((block->num_repeats > 0) && !key_block_join(block)) {
+        return 0;
+    }
+
+    return pos - data;
+}
+
+const char *
+http_key_block_get(void *data, const char *header, size_t header_len, size_t *value_len)
+{
+    key_block_t *block = (key_block_t *)data;
+    key_block_slot_t *slot = NULL;
+
+    /* The Keys pass the very same header strings the slots were made from */
+    for (size_t i = 0; i < block->num_slots; ++i) {
+        if ((block->slots[i].name == header) && (block->slots[i].name_len == header_len)) {
+            slot = &block->slots[i];
+            break;
+        }
+    }
+    if (!slot) {
+        slot = key_block_slot(block, header, header_len, key_block_hash(header, header_len));
+    }
+
+    if (slot && slot->count) {
+        *value_len = slot->value_len;
+        return slot->value;
+    }
+    *value_len = 0;
+
+    return NULL;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
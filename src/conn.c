@@ -0,0 +1,210 @@
+/** @file
+
+    Evaluation memoized per connection, on the HPACK / QPACK table entries of the header values. On
+    HTTP/2 and HTTP/3, a header value repeated on a connection is sent as an index into the dynamic
+    table, so the decoder can tell us that it's the very same value as before, without comparing any
+    bytes. The output of the parameters for that header is then simply copied from the memo.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <assert.h>
+
+#include "include/conn.h"
+#include "include/normalize.h"
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif
+
+http_key_conn_t
+http_key_conn_create(http_key_t *key, size_t num_entries)
+{
+    size_t entries = 1;
+    key_conn_t *conn;
+
+    assert(key);
+
+    if (0 == num_entries) {
+        return NULL;
+    }
+    while (entries < num_entries) {
+        entries <<= 1;
+    }
+    if (!(conn = (key_conn_t *)key->malloc(sizeof(key_conn_t) + entries * sizeof(key_conn_entry_t)))) {
+        return NULL;
+    }
+    conn->key = key;
+    conn->num_entries = entries;
+    conn->hits = 0;
+    conn->misses = 0;
+    memset(conn->entries, 0, entries * sizeof(key_conn_entry_t));
+
+    return conn;
+}
+
+/* This gives up the references to all the Keys in the memo */
+void
+http_key_conn_destroy(http_key_conn_t conn)
+{
+    if (conn) {
+        for (size_t i = 0; i < conn->num_entries; ++i) {
+            http_key_release((http_key_params_t)conn->entries[i].param);
+        }
+        conn->key->free(conn);
+    }
+}
+
+void
+http_key_conn_stats(http_key_conn_t conn, size_t *hits, size_t *misses)
+{
+    *hits = conn ? conn->hits : 0;
+    *misses = conn ? conn->misses : 0;
+}
+
+static inline key_conn_entry_t *
+key_conn_entry(key_conn_t *conn, const key_common_t *param, uint64_t id)
+{
+    uint64_t hash = ((uint64_t)(uintptr_t)param ^ id) * 0x9e3779b97f4a7c15ULL;
+
+    return &conn->entries[(hash ^ (hash >> 29)) & (conn->num_entries - 1)];
+}
+
+/* Evaluate the run of parameters for the same header, starting at param, on the already checked value.
+   Returns the new position in the buffer, or 0 on errors. */
+static size_t
+key_conn_eval_run(key_common_t *param, const key_common_t *end, const char *value, size_t value_len, char *buf, size_t pos,
+                  size_t buf_size)
+{
+    for (; param != end; param = param->next) {
+        if (value && (value_len > 0)) {
+            size_t len;
+
+            if ((pos < buf_size) && ((len = param->evaluator(param, value, value_len, buf, pos, buf_size)) > 0)) {
+                pos += len;
+            } else {
+                return 0;
+            }
+        } else if ((buf_size - pos) >= 4) {
+            memcpy(buf + pos, "none", 4);
+            pos += 4;
+        } else {
+            return 0;
+        }
+    }
+
+    return pos;
+}
+
+/* This is key_eval_params(), one run of parameters for the same header at a time. The budget is
+   charged exactly as it would be, but a value is only normalized and evaluated on a miss. */
+size_t
+http_key_eval_conn(http_key_t *key, http_key_conn_t conn, http_key_header_id_t get_header_id, void *header_data,
+                   http_key_params_t params, char *buf, size_t buf_size)
+{
+    key_common_t *param = (key_common_t *)params;
+    size_t pos = 0;
+    size_t used = 0;
+    key_scratch_t scratch;
+
+    assert(key);
+    assert(conn);
+    assert(get_header_id);
+
+    if (!param) {
+        return 0;
+    }
+
+    scratch.pos = 0;
+    while (param) {
+        key_common_t *end = param->next;
+        size_t run = 1, value_len = 0, start = pos;
+        uint64_t id = 0;
+        const char *value = get_header_id(header_data, param->header, param->header_len, &value_len, &id);
+        key_conn_entry_t *entry = NULL;
+
+        while (end && (end->header_len == param->header_len) && (end->header == param->header)) {
+            end = end->next;
+            ++run;
+        }
+
+        if (value && (value_len > 0) && id) {
+            entry = key_conn_entry(conn, param, id);
+            if ((entry->param == param) && (entry->id == id)) {
+                /* A hit skips the normalization, but not the budget */
+                if ((key->budget.max_value_len || key->budget.max_tokens) &&
+                    (key_budget_exceeded == key_budget_value(key, value, value_len))) {
+                    return 0;
+                }
+                ++conn->hits;
+                for (size_t i = 0; i < run; ++i) {
+                    if (!key_budget_ok(key, value, entry->value_len, &used)) {
+                        return 0;
+                    }
+                }
+                if ((buf_size - pos) < entry->output_len) {
+                    return 0; /* The evaluation would fail as well */
+                }
+                memcpy(buf + pos, entry->output, entry->output_len);
+                pos += entry->output_len;
+                param = end;
+                continue;
+            }
+        }
+        value = key_check_value(key, param->header, param->header_len, value, &value_len, &scratch);
+        if (entry && (value != key_budget_exceeded)) {
+            ++conn->misses; /* A value over the budget is neither a hit nor a miss */
+        }
+
+        for (size_t i = 0; i < run; ++i) {
+            if (!key_budget_ok(key, value, value_len, &used)) {
+                return 0;
+            }
+        }
+        if (!(pos = key_conn_eval_run(param, end, value, value_len, buf, pos, buf_size))) {
+            return 0;
+        }
+
+        /* Store the output, replacing whatever was there. The entry keeps the Key alive, such that a
+           new Key can never be allocated at the same address, and hit on the stale output. */
+        if (entry && ((pos - start) <= KEY_CONN_MAX_OUTPUT) && (value_len <= UINT32_MAX)) {
+            if (entry->param != param) {
+                http_key_release((http_key_params_t)entry->param);
+                entry->param = (key_common_t *)http_key_retain((http_key_params_t)param);
+            }
+            entry->id = id;
+            entry->value_len = (uint32_t)value_len;
+            entry->output_len = (uint32_t)(pos - start);
+            memcpy(entry->output, buf + start, pos - start);
+        }
+        param = end;
+    }
+
+    return pos;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
@@ -21,6 +21,7 @@
     limitations under the License.
 */
 #include <assert.h>
+#include <ctype.h>
 #include <stdio.h>
 
 #include "include/parser.h"
@@ -32,6 +33,32 @@
 #include <string.h>
 #endif
 
+#if HAVE_STRINGS_H
+#include <strings.h>
+#endif
+
+/* Print an unsigned value in decimal, without NULL termination. Returns 0 if it does not fit in the buffer. */
+size_t
+key_print_uint(uint64_t value, char *buf, size_t buf_len)
+{
+    char digits[20]; /* UINT64_MAX is 20 digits */
+    size_t len = 0;
+
+    do {
+        digits[len++] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+
+    if (len > buf_len) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        buf[i] = digits[len - i - 1];
+    }
+
+    return len;
+}
+
 size_t
 key_eval_div(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size)
 {
@@ -42,6 +69,10 @@ key_eval_div(key_common_t *param, const char *value, size_t value_len, char *buf
 
     assert(div->c.type == KEY_PARAM_DIV);
 
+    if (0 == div->divider) {
+        return 0;
+    }
+
     /* 2.3.1:
        ------
        1)  If "parameter_value" is "0", fail parameter processing
@@ -58,16 +89,34 @@ key_eval_div(key_common_t *param, const char *value, size_t value_len, char *buf
 
     if ((token_len = key_strsep(value, value_len, &token_start, &token_next, ',')) > 0) {
         uint64_t p = key_memtoll(token_start, token_len);
-        int ret = snprintf(buf + start, buf_size - start, "%" PRIu64 "", (uint64_t)(p / div->divider));
 
-        /* ToDo: This doesn't deal with the buffer being too small, which is an error case */
-        return ret;
+        /* This returns 0 if the quotient does not fit, which is an error */
+        return key_print_uint(p / div->divider, buf + start, buf_size - start);
     }
 
     /* ToDo: error ! */
     return 0;
 }
 
+/* Specialized DIV, for power of two dividers */
+size_t
+key_eval_div_shift(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size)
+{
+    const char *token_start = value;
+    const char *token_next = NULL;
+    size_t token_len;
+    key_param_div_t *div = (key_param_div_t *)param;
+
+    assert(div->c.type == KEY_PARAM_DIV);
+    assert(div->divider == (1ULL << div->shift));
+
+    if ((token_len = key_strsep(value, value_len, &token_start, &token_next, ',')) > 0) {
+        return key_print_uint(key_memtoll(token_start, token_len) >> div->shift, buf + start, buf_size - start);
+    }
+
+    return 0;
+}
+
 size_t
 key_eval_partition(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size)
 {
@@ -138,6 +187,33 @@ key_eval_match(key_common_t *param, const char *value, size_t value_len, char *b
     return 1;
 }
 
+/* Specialized MATCH, for match strings of up to 8 bytes, compared as one word */
+size_t
+key_eval_match_word(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size)
+{
+    const char *token_start = value;
+    const char *token_next = NULL;
+    const char *end = value + value_len;
+    size_t token_len;
+    key_param_match_t *match = (key_param_match_t *)param;
+
+    assert(match->c.type == KEY_PARAM_MATCH);
+    assert(match->match_len <= 8);
+    assert(value && (value_len > 0));
+    assert(start < buf_size);
+
+    while ((token_len = key_strsep(value, value_len, &token_start, &token_next, ',')) > 0) {
+        if ((token_len == match->match_len) && (key_load_word(token_start, token_len, end) == match->word)) {
+            *(buf + start) = '1';
+            return 1;
+        }
+        token_start = token_next;
+    }
+
+    *(buf + start) = '0';
+    return 1;
+}
+
 size_t
 key_eval_substr(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size)
 {
@@ -173,6 +249,66 @@ key_eval_substr(key_common_t *param, const char *value, size_t value_len, char *
     return 1;
 }
 
+/* Does an empty list item precede pos? key_strsep() returns 0 for an empty item, which ends the
+   evaluation of the list, so the specializations below must not look past it either. */
+static inline int
+key_empty_item_before(const char *value, const char *pos)
+{
+    const char *item = value;
+
+    while (item < pos) {
+        while ((item < pos) && isspace(*item)) {
+            ++item;
+        }
+        if ((item < pos) && (',' == *item)) {
+            return 1;
+        }
+        if (!(item = memchr(item, ',', pos - item))) {
+            return 0;
+        }
+        ++item;
+    }
+
+    return 0;
+}
+
+/* Specialized SUBSTR, for substrings without a "," and without leading or trailing whitespace. Such a
+   substring can never span two items, nor include the whitespace stripped from an item, so we can
+   search the entire header value in one go, as long as no empty item precedes the first match. */
+size_t
+key_eval_substr_value(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size)
+{
+    key_param_substr_t *substr = (key_param_substr_t *)param;
+    const char *match = NULL;
+
+    assert(substr->c.type == KEY_PARAM_SUBSTR);
+    assert(value && (value_len > 0));
+    assert(start < buf_size);
+
+    match = memmem(value, value_len, substr->substr, substr->substr_len);
+    *(buf + start) = (match && !key_empty_item_before(value, match)) ? '1' : '0';
+
+    return 1;
+}
+
+/* Same as above, for a single character substring */
+size_t
+key_eval_substr_char(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size)
+{
+    key_param_substr_t *substr = (key_param_substr_t *)param;
+    const char *match = NULL;
+
+    assert(substr->c.type == KEY_PARAM_SUBSTR);
+    assert(substr->substr_len == 1);
+    assert(value && (value_len > 0));
+    assert(start < buf_size);
+
+    match = memchr(value, *substr->substr, value_len);
+    *(buf + start) = (match && !key_empty_item_before(value, match)) ? '1' : '0';
+
+    return 1;
+}
+
 size_t
 key_eval_param(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size)
 {
@@ -206,6 +342,142 @@ key_eval_param(key_common_t *param, const char *value, size_t value_len, char *b
     return 0;
 }
 
+/* Parse a qvalue ("0", "0.5", "1.000" etc.) into an integer in the range 0 - 1000, returning -1 if
+   the qvalue is malformed. */
+static int
+key_qvalue(const char *str, size_t len)
+{
+    int q, scale = 1000;
+
+    if ((len == 0) || ((*str != '0') && (*str != '1'))) {
+        return -1;
+    }
+    q = (*str++ - '0') * 1000;
+    if (--len > 0) {
+        if (*str++ != '.') {
+            return -1;
+        }
+        --len;
+        while ((len > 0) && (scale > 1) && isdigit(*str)) {
+            scale /= 10;
+            q += (*str++ - '0') * scale;
+            --len;
+        }
+        if (len > 0) {
+            return -1;
+        }
+    }
+
+    return q > 1000 ? 1000 : q;
+}
+
+size_t
+key_eval_prefer(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size)
+{
+    const char *token_start = value;
+    const char *token_next = NULL;
+    size_t token_len;
+    key_param_prefer_t *prefer = (key_param_prefer_t *)param;
+    int qvalues[HTTP_KEY_MAX_PREFER];
+    int star = -1, best_q = 0;
+    size_t best = 0;
+
+    assert(prefer->c.type == KEY_PARAM_PREFER);
+    assert(value && (value_len > 0));
+
+    /* This is an extension to the draft, for Accept-Encoding style headers:
+       ------
+       1)  If "header_value" is the empty string, return "none".
+       2)  Create "header_list" by splitting "header_value" on ","
+           characters.
+       3)  For each "header_item" in "header_list", let "coding" be the
+           string before any ";", and "q" the value of a "q" parameter
+           (default 1). Items with malformed "q" values are ignored.
+       4)  For each "coding_value" in the ":" separated "parameter_value",
+           in order, let its "q" be that of a case-insensitively identical
+           "coding", or that of a "*" item if there is no such "coding".
+       5)  Return the 1-based position of the first "coding_value" with the
+           highest non-zero "q", or "0" if there is no such "coding_value".
+    */
+    for (size_t i = 0; i < prefer->num_codings; ++i) {
+        qvalues[i] = -1;
+    }
+
+    while ((token_len = key_strsep(value, value_len, &token_start, &token_next, ',')) > 0) {
+        const char *semi = memchr(token_start, ';', token_len);
+        size_t coding_len = semi ? (size_t)(semi - token_start) : token_len;
+        int q = 1000;
+
+        while ((coding_len > 0) && isspace(token_start[coding_len - 1])) {
+            --coding_len;
+        }
+
+        if (semi) {
+            const char *qparam_start = semi + 1;
+            const char *qparam_next = NULL;
+            size_t qparams_len = token_len - (qparam_start - token_start);
+            size_t qparam_len;
+
+            while ((qparam_len = key_strsep(semi + 1, qparams_len, &qparam_start, &qparam_next, ';')) > 0) {
+                if ((qparam_len > 2) && (tolower(*qparam_start) == 'q') && (qparam_start[1] == '=')) {
+                    q = key_qvalue(qparam_start + 2, qparam_len - 2);
+                }
+                qparam_start = qparam_next;
+            }
+        }
+
+        if (q >= 0) {
+            if ((coding_len == 1) && (*token_start == '*')) {
+                star = q;
+            } else {
+                uint64_t word = coding_len <= 8 ? key_load_word(token_start, coding_len, value + value_len) : 0;
+
+                for (size_t i = 0; i < prefer->num_codings; ++i) {
+                    if ((coding_len == prefer->coding_lens[i]) && (qvalues[i] < 0)) {
+                        /* Case folded compare, as one word for short codings */
+                        if ((coding_len <= 8) ? ((word | prefer->folds[i]) == prefer->words[i])
+                                              : !strncasecmp(token_start, prefer->codings[i], coding_len)) {
+                            qvalues[i] = q;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        token_start = token_next;
+    }
+
+    for (size_t i = 0; i < prefer->num_codings; ++i) {
+        int q = qvalues[i] >= 0 ? qvalues[i] : star;
+
+        if (q > best_q) {
+            best_q = q;
+            best = i + 1;
+        }
+    }
+
+    return key_print_uint(best, buf + start, buf_size - start);
+}
+
+/* The whole header value, for a header listed in Vary. This is length prefixed, e.g. "4:gzip", since
+   the value is arbitrary and would otherwise be ambiguous with the following parameters. */
+size_t
+key_eval_value(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size)
+{
+    size_t len;
+
+    assert(param->type == KEY_PARAM_VALUE);
+    assert(value && (value_len > 0));
+
+    if (!(len = key_print_uint(value_len, buf + start, buf_size - start)) || ((buf_size - start - len) < (value_len + 1))) {
+        return 0;
+    }
+    buf[start + len++] = ':';
+    memcpy(buf + start + len, value, value_len);
+
+    return len + value_len;
+}
+
 /*
   local variables:
   mode: C
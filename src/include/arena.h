@@ -25,23 +25,41 @@
 #ifndef ARENA_H
 #define ARENA_H
 
+#include <stdatomic.h>
+
 #include "http/key.h"
 
 /* ToDo: This might be x64 specific? But regardless, hardcoded to 16 byte alignments for now. */
 #define KEY_ARENA_ALIGN(p) (((p) + (16 - 1L)) & ~(16 - 1L))
 
-/* Thsi holds an arena, which is a sequence of Key parameter objects and strings */
-typedef struct {
+/* Allocate an object on the arena, aligned only as much as its type needs */
+#define KEY_ARENA_NEW(arena, type) ((type *)key_arena_allocate((arena), sizeof(type), _Alignof(type)))
+
+/* Thsi holds an arena, which is a sequence of Key parameter objects and strings. The arena is reference
+   counted, and is destroyed when the last reference is released. The arenas of http_key_parse_many()
+   are carved out of a shared pool arena instead, and hold a reference to the pool. */
+typedef struct _key_arena {
+    atomic_size_t refcount;
     size_t size;
     size_t pos;
     char *last_header;
     size_t last_header_len;
+    size_t bounded_len;   /* Sum of the max output length for all bounded parameters */
+    size_t num_unbounded; /* Number of parameters without a max output length (PARAM) */
+    struct _key_memo *memo; /* Optional memoization of evaluation results */
+    atomic_size_t evals;    /* Number of evaluations, until promoted to a plan */
+    struct _key_plan *_Atomic plan; /* The optimized form of a hot Key */
+    http_key_compiled_t compiled;   /* Registered evaluator for the Key string, see http_key_register() */
+    struct _key_intern *intern;     /* Only while parsing with http_key_parse_many() */
+    struct _key_arena *pool;        /* The pool this arena was carved out of, if any */
+    void *scratch;                  /* Only counting the bytes, see http_key_parse_size() */
     http_key_t *key;
 } key_arena_t;
 
 key_arena_t *key_arena_create(http_key_t *key, void *buffer, size_t size);
 void key_arena_destroy(key_arena_t *arena);
-void *key_arena_allocate(key_arena_t *arena, size_t size);
+void key_arena_release(key_arena_t *arena);
+void *key_arena_allocate(key_arena_t *arena, size_t size, size_t align);
 
 #endif /* ARENA_H */
 
@@ -0,0 +1,73 @@
+/** @file
+
+    Include file for the index of raw HTTP/1.x header blocks, see http_key_block_create().
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#ifndef KEY_BLOCK_H
+#define KEY_BLOCK_H
+
+#include "include/parameters.h"
+
+/* Initial room for repeated header lines, which is grown when needed */
+#define KEY_BLOCK_REPEATS 16
+
+/* One header used by the Keys, and its value in the last block. The name is the lower cased header of
+   the parameters, on the arena of the Key. */
+typedef struct {
+    const char *name;
+    size_t name_len;
+    uint64_t hash;
+    const char *value; /* Into the block data, or the join space for repeated headers */
+    size_t value_len;
+    size_t count; /* Number of lines for the header in the block */
+} key_block_slot_t;
+
+/* The second and later lines for a header, in the order of the block, joined after the scan */
+typedef struct {
+    size_t slot;
+    const char *value;
+    size_t value_len;
+} key_block_repeat_t;
+
+typedef struct _http_key_block {
+    http_key_t *key;    /* For the memory management */
+    uint64_t lengths;   /* Bit for each name length (63 for all longer names), for skipping the other headers */
+    size_t num_lines;   /* Header lines in the last block, used or not */
+    key_block_repeat_t *repeats;
+    size_t num_repeats;
+    size_t repeats_size;
+    char *join;         /* Space for joining repeated headers, only grown when needed */
+    size_t join_size;
+    size_t num_slots;
+    key_block_slot_t slots[];
+} key_block_t;
+
+#endif /* KEY_BLOCK_H */
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
@@ -0,0 +1,90 @@
+/** @file
+
+    Include file for the per evaluation work budget, see http_key_budget().
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#ifndef KEY_BUDGET_H
+#define KEY_BUDGET_H
+
+#include "include/parameters.h"
+
+/* Returned instead of a header value, when the value exceeds the budget */
+extern const char key_budget_exceeded[];
+
+static inline void
+key_budget_count(http_key_t *key)
+{
+    __atomic_fetch_add(&key->budget.exceeded, 1, __ATOMIC_RELAXED);
+}
+
+/* Check a fetched header value against the length and token limits. The commas are only counted up
+   to the limit, so this is bounded by the max value length as well. */
+static inline const char *
+key_budget_value(http_key_t *key, const char *value, size_t value_len)
+{
+    if (key->budget.max_value_len && (value_len > key->budget.max_value_len)) {
+        key_budget_count(key);
+        return key_budget_exceeded;
+    }
+    if (key->budget.max_tokens) {
+        const char *end = value + value_len;
+        const char *comma = value;
+        size_t tokens = 1;
+
+        while ((comma = memchr(comma, ',', end - comma))) {
+            if (++tokens > key->budget.max_tokens) {
+                key_budget_count(key);
+                return key_budget_exceeded;
+            }
+            ++comma;
+        }
+    }
+
+    return value;
+}
+
+/* Check the header value before a parameter evaluates it, and charge its length to the bytes used
+   so far in this evaluation. Returns 0 if the evaluation must be aborted. */
+static inline int
+key_budget_ok(http_key_t *key, const char *value, size_t value_len, size_t *used)
+{
+    if (value == key_budget_exceeded) {
+        return 0;
+    }
+    if (key->budget.max_bytes && value && ((*used += value_len) > key->budget.max_bytes)) {
+        key_budget_count(key);
+        return 0;
+    }
+
+    return 1;
+}
+
+#endif /* KEY_BUDGET_H */
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
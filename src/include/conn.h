@@ -0,0 +1,61 @@
+/** @file
+
+    Include file for the per connection memo, of evaluations on HPACK / QPACK table entries.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#ifndef KEY_CONN_H
+#define KEY_CONN_H
+
+#include "include/parameters.h"
+
+/* Max output of the parameters for one header, that fits in an entry */
+#define KEY_CONN_MAX_OUTPUT 40
+
+/* One entry maps the first parameter of a run of parameters for the same header, and the table entry
+   ID of the header value, to the output of that run. The entry holds a reference to the Key. */
+typedef struct {
+    key_common_t *param; /* NULL means the entry is unused */
+    uint64_t id;
+    uint32_t value_len; /* After normalization, for charging the budget on a hit */
+    uint32_t output_len;
+    char output[KEY_CONN_MAX_OUTPUT];
+} key_conn_entry_t;
+
+/* The memo is a direct mapped table, allocated in one chunk */
+typedef struct _http_key_conn {
+    http_key_t *key; /* For freeing the memo */
+    size_t num_entries; /* Always a power of two */
+    size_t hits;
+    size_t misses;
+    key_conn_entry_t entries[];
+} key_conn_t;
+
+#endif /* KEY_CONN_H */
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
@@ -25,11 +25,23 @@
 
 #include "include/parameters.h"
 
+/* Max output of a non-VALUE parameter that http_key_eval_matches() and the variant index can verify */
+#define KEY_MATCHES_OUTPUT 256
+
+size_t key_print_uint(uint64_t value, char *buf, size_t buf_len);
+
 size_t key_eval_div(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size);
+size_t key_eval_div_shift(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size);
 size_t key_eval_partition(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size);
 size_t key_eval_match(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size);
+size_t key_eval_match_word(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size);
 size_t key_eval_substr(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size);
+size_t key_eval_substr_value(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start,
+                             size_t buf_size);
+size_t key_eval_substr_char(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size);
 size_t key_eval_param(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size);
+size_t key_eval_prefer(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size);
+size_t key_eval_value(key_common_t *param, const char *value, size_t value_len, char *buf, size_t start, size_t buf_size);
 
 #endif /* EVALUATORS_H */
 
@@ -0,0 +1,61 @@
+/** @file
+
+    Include file for the string interning of http_key_parse_many().
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#ifndef KEY_INTERN_H
+#define KEY_INTERN_H
+
+#include "include/parameters.h"
+
+/* Initial number of slots in the table, which doubles when half full */
+#define KEY_INTERN_SLOTS 256
+
+typedef struct {
+    const char *str;
+    size_t len;
+    uint64_t hash;
+} key_intern_slot_t;
+
+/* Open addressing table of the strings on the arenas of one http_key_parse_many(). This only lives
+   for the duration of the parse, the strings are owned by the arenas. */
+typedef struct _key_intern {
+    http_key_t *key;
+    size_t num_slots;
+    size_t num_strings;
+    key_intern_slot_t *slots;
+} key_intern_t;
+
+key_intern_t *key_intern_create(http_key_t *key);
+void key_intern_destroy(key_intern_t *intern);
+const char *key_intern(key_intern_t *intern, key_arena_t *arena, const char *str, size_t len, int lower);
+
+#endif /* KEY_INTERN_H */
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
@@ -0,0 +1,75 @@
+/** @file
+
+    Include file for the (optional) per-Key memoization of evaluation results.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#ifndef KEY_MEMO_H
+#define KEY_MEMO_H
+
+#include <stdatomic.h>
+
+#include "include/parameters.h"
+
+/* Max number of header fetches for a Key using the memoization */
+#define KEY_MEMO_MAX_HEADERS 32
+
+/* One entry in the memo, which is followed by the encoded header values (a 4 byte length, or
+   KEY_MEMO_NO_VALUE, followed by the value) and then the output. These are stored as atomic words,
+   and the version is odd while a thread writes the entry, such that other threads can read it
+   concurrently, and retry as a miss if it changed under them. */
+#define KEY_MEMO_NO_VALUE 0xffffffff
+
+typedef struct {
+    _Atomic uint64_t version;
+    _Atomic uint64_t hash;
+    _Atomic uint32_t values_len; /* 0 means the entry is unused */
+    _Atomic uint32_t output_len;
+} key_memo_entry_t;
+
+/* The memo is a direct mapped table of fixed size entries, allocated in one chunk */
+typedef struct _key_memo {
+    http_key_t *key; /* For freeing the memo */
+    size_t num_entries; /* Always a power of two */
+    size_t entry_size;
+    size_t num_headers; /* Number of header fetches per evaluation */
+    atomic_size_t hits;
+    atomic_size_t misses;
+    unsigned char *entries;
+} key_memo_t;
+
+key_memo_t *key_memo_create(http_key_t *key, key_common_t *params, size_t num_entries, size_t entry_size);
+void key_memo_destroy(key_memo_t *memo);
+size_t key_memo_eval(key_memo_t *memo, http_key_t *key, void *header_data, key_common_t *params, char *buf, size_t buf_size);
+
+/* This is the evaluation without the memoization, in key.c */
+size_t key_eval_params(http_key_t *key, void *header_data, key_common_t *params, char *buf, size_t buf_size);
+
+#endif /* KEY_MEMO_H */
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
@@ -0,0 +1,90 @@
+/** @file
+
+    Include file for the normalization of header values.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#ifndef KEY_NORMALIZE_H
+#define KEY_NORMALIZE_H
+
+#include "include/budget.h"
+#include "include/parameters.h"
+
+/* Size of the scratch area, on the stack, for the normalized values of one evaluation */
+#define KEY_NORMALIZE_SCRATCH 2048
+
+/* Max number of list items in a value that is sorted. A sorted value takes at most half the scratch,
+   and every item but the last takes at least two bytes, so any value that fits is sorted. */
+#define KEY_NORMALIZE_MAX_ITEMS (KEY_NORMALIZE_SCRATCH / 4 + 1)
+
+typedef struct {
+    size_t pos;
+    char buf[KEY_NORMALIZE_SCRATCH];
+} key_scratch_t;
+
+const char *key_normalize(http_key_t *key, const char *header, size_t header_len, const char *value, size_t *value_len,
+                          key_scratch_t *scratch);
+
+/* Check an already fetched header value against the budget, and normalize it if so configured for the
+   header. The scratch area must outlive the use of the value. This returns key_budget_exceeded if the
+   value is over the budget. */
+static inline const char *
+key_check_value(http_key_t *key, const char *header, size_t header_len, const char *value, size_t *value_len,
+                key_scratch_t *scratch)
+{
+    if (value && (*value_len > 0)) {
+        if ((key->budget.max_value_len || key->budget.max_tokens) &&
+            (key_budget_exceeded == key_budget_value(key, value, *value_len))) {
+            return key_budget_exceeded;
+        }
+        if (key->num_normalize) {
+            return key_normalize(key, header, header_len, value, value_len, scratch);
+        }
+    }
+
+    return value;
+}
+
+/* Fetch a header value, and check it as above. A pending value aborts the evaluation like a value over
+   the budget does (without counting it), since only http_key_eval_start() can suspend. */
+static inline const char *
+key_fetch_header(http_key_t *key, void *header_data, const char *header, size_t header_len, size_t *value_len,
+                 key_scratch_t *scratch)
+{
+    const char *value = key->get_header(header_data, header, header_len, value_len);
+
+    if (HTTP_KEY_VALUE_PENDING == value) {
+        return key_budget_exceeded;
+    }
+
+    return key_check_value(key, header, header_len, value, value_len, scratch);
+}
+
+#endif /* KEY_NORMALIZE_H */
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
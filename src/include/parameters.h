@@ -32,6 +32,10 @@
 #include <stdint.h>
 #endif
 
+#if HAVE_STRING_H
+#include <string.h>
+#endif
+
 struct _key_common;
 typedef size_t(key_evaluator_t)(struct _key_common *param, const char *value, size_t value_len, char *buf, size_t start,
                                 size_t buf_size);
@@ -42,6 +46,8 @@ typedef enum {
     KEY_PARAM_MATCH,
     KEY_PARAM_SUBSTR,
     KEY_PARAM_PARAM,
+    KEY_PARAM_PREFER, /* Extension, not part of the draft */
+    KEY_PARAM_VALUE,  /* The whole header value, for headers listed in Vary */
 } key_param_types_t;
 
 typedef struct _key_common {
@@ -49,7 +55,10 @@ typedef struct _key_common {
     key_evaluator_t *evaluator;
     const char *header;
     size_t header_len;
+    size_t max_len; /* Max output length, including "none", or HTTP_KEY_UNBOUNDED */
     const char *debug_name;
+    const char *arg; /* The parameter value, copied unto the arena */
+    size_t arg_len;
     key_arena_t *arena; /* Slightly wasteful, but ce la vie */
     struct _key_common *next;
 } key_common_t;
@@ -57,6 +66,7 @@ typedef struct _key_common {
 typedef struct {
     key_common_t c;
     uint64_t divider;
+    unsigned int shift; /* For power of two dividers */
 } key_param_div_t;
 
 typedef struct {
@@ -69,6 +79,7 @@ typedef struct {
     key_common_t c;
     const char *match;
     size_t match_len;
+    uint64_t word; /* For matches of up to 8 bytes, see key_load_word() */
 } key_param_match_t;
 
 typedef struct {
@@ -83,6 +94,36 @@ typedef struct {
     size_t param_len;
 } key_param_param_t;
 
+typedef struct {
+    key_common_t c;
+    const char *codings[HTTP_KEY_MAX_PREFER];
+    size_t coding_lens[HTTP_KEY_MAX_PREFER];
+    uint64_t words[HTTP_KEY_MAX_PREFER]; /* Lower cased codings of up to 8 bytes, see key_load_word() */
+    uint64_t folds[HTTP_KEY_MAX_PREFER]; /* 0x20 for each letter in the coding, to case fold the header */
+    size_t num_codings;
+} key_param_prefer_t;
+
+/* Load up to 8 bytes of a string into a word, with any unused bytes zeroed. When there are at least 8
+   bytes left before the end of the buffer, this is a single load and mask. This is endian neutral, so
+   a word can only be compared against other words from this function. */
+static inline uint64_t
+key_load_word(const char *str, size_t len, const char *end)
+{
+    static const unsigned char ones[16] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0, 0, 0, 0, 0};
+    uint64_t word = 0;
+
+    if ((end - str) >= 8) {
+        uint64_t mask;
+
+        memcpy(&word, str, 8);
+        memcpy(&mask, ones + 8 - len, 8);
+        return word & mask;
+    }
+    memcpy(&word, str, len);
+
+    return word;
+}
+
 #endif /* KEY_PARAMETERS_H */
 
 /*
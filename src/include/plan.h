@@ -0,0 +1,88 @@
+/** @file
+
+    Include file for the optimized (tiered) representation of hot Keys.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#ifndef KEY_PLAN_H
+#define KEY_PLAN_H
+
+#include <stdatomic.h>
+
+#include "include/parameters.h"
+
+/* Number of evaluations of a parsed Key before it's promoted to an optimized plan. Zero disables it. */
+#ifndef KEY_PLAN_THRESHOLD
+#define KEY_PLAN_THRESHOLD 1000
+#endif
+
+/* Max number of distinct headers in a Key that can be promoted */
+#define KEY_PLAN_MAX_HEADERS 32
+
+/* Number of failures after which a step is evaluated ahead of the others, see key_plan_eval() */
+#ifndef KEY_PLAN_PROBE_FAILURES
+#define KEY_PLAN_PROBE_FAILURES 8
+#endif
+
+/* Only the first 64 steps, with outputs of at most 24 bytes, are evaluated ahead */
+#define KEY_PLAN_MAX_PROBES 64
+#define KEY_PLAN_PROBE_LEN 24
+
+typedef struct {
+    const char *header;
+    size_t header_len;
+} key_plan_header_t;
+
+/* One parameter in the plan; these are laid out in an array, in the same order as the parameters */
+typedef struct {
+    key_evaluator_t *evaluator;
+    key_common_t *param;
+    size_t header; /* Index into the headers of the plan */
+    size_t reserved; /* Sum of the max output length for all bounded parameters after this one */
+    int unbounded;
+    atomic_size_t failures;
+} key_plan_step_t;
+
+/* The plan fetches each distinct header once, and then runs all the steps without bounds checks */
+typedef struct _key_plan {
+    http_key_free_t free; /* The allocating key might not be around when the Key is released, NULL in the arena */
+    size_t bounded_len;
+    size_t num_headers;
+    size_t num_steps;
+    _Atomic uint64_t probe; /* Steps evaluated ahead, one bit per step */
+    key_plan_header_t headers[KEY_PLAN_MAX_HEADERS];
+    key_plan_step_t steps[];
+} key_plan_t;
+
+key_plan_t *key_plan_create(http_key_t *key, key_common_t *params);
+void key_plan_destroy(key_plan_t *plan);
+size_t key_plan_eval(key_plan_t *plan, http_key_t *key, void *header_data, char *buf, size_t buf_size);
+
+#endif /* KEY_PLAN_H */
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
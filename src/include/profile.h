@@ -0,0 +1,118 @@
+/** @file
+
+    Include file for the sampled profile of the parameter evaluations, see http_key_profile().
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#ifndef KEY_PROFILE_H
+#define KEY_PROFILE_H
+
+#include <time.h>
+
+#include "include/parameters.h"
+
+/* Number of (type, header) entries, a power of two. Samples for more than this are dropped. */
+#define KEY_PROFILE_ENTRIES 64
+
+/* Histogram buckets: exact up to 7 ns, then four buckets for each power of two, up to 2^40 ns */
+#define KEY_PROFILE_BUCKETS (8 + 4 * 38)
+
+typedef struct {
+    uint32_t counts[KEY_PROFILE_BUCKETS];
+    size_t samples;
+} key_profile_histogram_t;
+
+/* The samples for one parameter type on one header. The id is claimed first, and the entry is
+   ready for the stats once the type and header are filled in. All the counters are atomic. */
+typedef struct {
+    uint64_t id; /* 0 means the entry is unused */
+    int ready;
+    const char *type;
+    char header[HTTP_KEY_PROFILE_MAX_HEADER];
+    size_t header_len;
+    uint64_t bytes;
+    uint64_t tokens;
+    key_profile_histogram_t eval;
+    key_profile_histogram_t fetch;
+} key_profile_entry_t;
+
+typedef struct {
+    key_profile_entry_t entries[KEY_PROFILE_ENTRIES];
+} key_profile_t;
+
+/* Number of keys per thread with their own countdown to the next sample, as a power of two */
+#define KEY_PROFILE_COUNTDOWN_BITS 4
+#define KEY_PROFILE_COUNTDOWNS (1 << KEY_PROFILE_COUNTDOWN_BITS)
+
+typedef struct {
+    const http_key_t *key;
+    size_t countdown; /* Evaluations left before the next sample */
+} key_profile_countdown_t;
+
+extern _Thread_local key_profile_countdown_t key_profile_countdowns[KEY_PROFILE_COUNTDOWNS];
+
+/* Should this evaluation be sampled? Every thread samples one in every rate evaluations of each key. A
+   key that lands on the slot of another one restarts the countdown, as if it was first used. */
+static inline int
+key_profile_sampled(http_key_t *key)
+{
+    key_profile_countdown_t *slot =
+        &key_profile_countdowns[((uint64_t)(uintptr_t)key * 0x9e3779b97f4a7c15ULL) >> (64 - KEY_PROFILE_COUNTDOWN_BITS)];
+
+    if (slot->key != key) {
+        slot->key = key;
+        slot->countdown = key->profile.rate;
+    }
+    if (slot->countdown > 1) {
+        --slot->countdown;
+        return 0;
+    }
+    slot->countdown = key->profile.rate;
+
+    return 1;
+}
+
+static inline uint64_t
+key_profile_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* The timing hooks of key_eval_from(), for a sampled evaluation. The entry is NULL if the profile is
+   full, and a NULL value is a header that is not present, which takes no time to evaluate. */
+key_profile_entry_t *key_profile_entry(key_profile_t *profile, const key_common_t *param);
+void key_profile_fetched(key_profile_entry_t *entry, uint64_t start);
+void key_profile_evaluated(key_profile_entry_t *entry, uint64_t start, const char *value, size_t value_len);
+
+#endif /* KEY_PROFILE_H */
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
@@ -0,0 +1,227 @@
+/** @file
+
+    The variant index, for finding the matching stored variant among many
+    for one parsed Key. This is a byte trie over the stored secondary keys,
+    with the nodes in one array (first child / next sibling). A lookup
+    evaluates the parameters in order, and walks the trie with the output
+    of each parameter as it's produced, without building the secondary key.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <assert.h>
+
+#include "include/evaluators.h"
+#include "include/normalize.h"
+
+#define KEY_INDEX_NO_NODE 0 /* The root is never a child, so 0 can mark the end of a list */
+#define KEY_INDEX_INITIAL_NODES 64
+
+typedef struct {
+    uint32_t child;
+    uint32_t sibling;
+    size_t variant; /* HTTP_KEY_NO_VARIANT unless a stored key ends here */
+    unsigned char byte;
+} key_index_node_t;
+
+struct _http_key_index {
+    http_key_t *key;
+    key_common_t *params;
+    key_index_node_t *nodes;
+    size_t num_nodes;
+    size_t max_nodes;
+};
+
+http_key_index_t
+http_key_index_create(http_key_t *key, http_key_params_t params)
+{
+    http_key_index_t index;
+
+    assert(key);
+
+    if (!(index = key->malloc(sizeof(struct _http_key_index)))) {
+        return NULL;
+    }
+    if (!(index->nodes = key->malloc(KEY_INDEX_INITIAL_NODES * sizeof(key_index_node_t)))) {
+        key->free(index);
+        return NULL;
+    }
+    index->key = key;
+    index->params = (key_common_t *)http_key_retain(params);
+    index->num_nodes = 1;
+    index->max_nodes = KEY_INDEX_INITIAL_NODES;
+    index->nodes[0].child = KEY_INDEX_NO_NODE;
+    index->nodes[0].sibling = KEY_INDEX_NO_NODE;
+    index->nodes[0].variant = HTTP_KEY_NO_VARIANT;
+    index->nodes[0].byte = 0;
+
+    return index;
+}
+
+void
+http_key_index_destroy(http_key_index_t index)
+{
+    if (index) {
+        http_key_t *key = index->key;
+
+        http_key_release((http_key_params_t)index->params);
+        key->free(index->nodes);
+        key->free(index);
+    }
+}
+
+/* Follow the bytes down from a node, returns KEY_INDEX_NO_NODE if there's no such path */
+static uint32_t
+key_index_walk(const key_index_node_t *nodes, uint32_t node, const char *bytes, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char byte = bytes[i];
+
+        node = nodes[node].child;
+        while ((node != KEY_INDEX_NO_NODE) && (nodes[node].byte != byte)) {
+            node = nodes[node].sibling;
+        }
+        if (node == KEY_INDEX_NO_NODE) {
+            break;
+        }
+    }
+
+    return node;
+}
+
+int
+http_key_index_add(http_key_index_t index, const char *stored, size_t stored_len, size_t variant)
+{
+    uint32_t node = 0;
+
+    if (variant == HTTP_KEY_NO_VARIANT) {
+        return -1;
+    }
+
+    /* Make room for the worst case up front, such that the nodes do not move while adding */
+    if ((index->num_nodes + stored_len) > UINT32_MAX) {
+        return -1;
+    }
+    if ((index->num_nodes + stored_len) > index->max_nodes) {
+        size_t max_nodes = index->max_nodes;
+        key_index_node_t *nodes;
+
+        while ((index->num_nodes + stored_len) > max_nodes) {
+            max_nodes *= 2;
+        }
+        if (!(nodes = index->key->malloc(max_nodes * sizeof(key_index_node_t)))) {
+            return -1;
+        }
+        memcpy(nodes, index->nodes, index->num_nodes * sizeof(key_index_node_t));
+        index->key->free(index->nodes);
+        index->nodes = nodes;
+        index->max_nodes = max_nodes;
+    }
+
+    for (size_t i = 0; i < stored_len; ++i) {
+        key_index_node_t *nodes = index->nodes;
+        uint32_t child = key_index_walk(nodes, node, stored + i, 1);
+
+        if (child == KEY_INDEX_NO_NODE) {
+            child = index->num_nodes++;
+            nodes[child].child = KEY_INDEX_NO_NODE;
+            nodes[child].sibling = nodes[node].child;
+            nodes[child].variant = HTTP_KEY_NO_VARIANT;
+            nodes[child].byte = stored[i];
+            nodes[node].child = child;
+        }
+        node = child;
+    }
+    index->nodes[node].variant = variant;
+
+    return 0;
+}
+
+void
+http_key_index_remove(http_key_index_t index, const char *stored, size_t stored_len)
+{
+    uint32_t node = key_index_walk(index->nodes, 0, stored, stored_len);
+
+    /* The nodes are left in place, they are likely to be used again by a new variant */
+    if ((node != KEY_INDEX_NO_NODE) || (0 == stored_len)) {
+        index->nodes[node].variant = HTTP_KEY_NO_VARIANT;
+    }
+}
+
+size_t
+http_key_index_lookup(http_key_index_t index, void *header_data)
+{
+    const key_index_node_t *nodes = index->nodes;
+    http_key_t *key = index->key;
+    key_common_t *param = index->params;
+    const char *last_header = NULL;
+    size_t last_header_len = 0;
+    const char *value = NULL;
+    size_t val_len = 0;
+    uint32_t node = 0;
+    size_t used = 0;
+    key_scratch_t scratch;
+
+    scratch.pos = 0;
+    while (param) {
+        char out[KEY_MATCHES_OUTPUT];
+        size_t len;
+
+        if ((last_header_len != param->header_len) || (last_header != param->header)) {
+            value = key_fetch_header(key, header_data, param->header, param->header_len, &val_len, &scratch);
+            last_header = param->header;
+            last_header_len = param->header_len;
+        }
+        if (!key_budget_ok(key, value, val_len, &used)) {
+            return HTTP_KEY_NO_VARIANT;
+        }
+
+        if (!value || (0 == val_len)) {
+            node = key_index_walk(nodes, node, "none", 4);
+        } else if (KEY_PARAM_VALUE == param->type) {
+            /* The length prefix, and then the value itself, without copying it */
+            len = key_print_uint(val_len, out, sizeof(out));
+            out[len++] = ':';
+            if ((node = key_index_walk(nodes, node, out, len)) != KEY_INDEX_NO_NODE) {
+                node = key_index_walk(nodes, node, value, val_len);
+            }
+        } else if ((len = param->evaluator(param, value, val_len, out, 0, sizeof(out)))) {
+            node = key_index_walk(nodes, node, out, len);
+        } else {
+            return HTTP_KEY_NO_VARIANT; /* Evaluation failure */
+        }
+
+        if (node == KEY_INDEX_NO_NODE) {
+            return HTTP_KEY_NO_VARIANT;
+        }
+        param = param->next;
+    }
+
+    return nodes[node].variant;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
@@ -0,0 +1,144 @@
+/** @file
+
+    String interning for http_key_parse_many(). All the header names and
+    parameter values of a bulk load are stored once, on the arena of the
+    first Key using them, and shared by all the other Keys.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <ctype.h>
+
+#include "include/intern.h"
+
+key_intern_t *
+key_intern_create(http_key_t *key)
+{
+    key_intern_t *intern = key->malloc(sizeof(key_intern_t));
+
+    if (intern) {
+        intern->key = key;
+        intern->num_slots = KEY_INTERN_SLOTS;
+        intern->num_strings = 0;
+        if (!(intern->slots = key->malloc(KEY_INTERN_SLOTS * sizeof(key_intern_slot_t)))) {
+            key->free(intern);
+            return NULL;
+        }
+        memset(intern->slots, 0, KEY_INTERN_SLOTS * sizeof(key_intern_slot_t));
+    }
+
+    return intern;
+}
+
+void
+key_intern_destroy(key_intern_t *intern)
+{
+    if (intern) {
+        intern->key->free(intern->slots);
+        intern->key->free(intern);
+    }
+}
+
+/* Double the table. If that fails, we carry on with the current table while there's room */
+static void
+key_intern_grow(key_intern_t *intern)
+{
+    size_t num_slots = intern->num_slots * 2;
+    key_intern_slot_t *slots = intern->key->malloc(num_slots * sizeof(key_intern_slot_t));
+
+    if (slots) {
+        memset(slots, 0, num_slots * sizeof(key_intern_slot_t));
+        for (size_t i = 0; i < intern->num_slots; ++i) {
+            if (intern->slots[i].str) {
+                size_t j = intern->slots[i].hash & (num_slots - 1);
+
+                while (slots[j].str) {
+                    j = (j + 1) & (num_slots - 1);
+                }
+                slots[j] = intern->slots[i];
+            }
+        }
+        intern->key->free(intern->slots);
+        intern->slots = slots;
+        intern->num_slots = num_slots;
+    }
+}
+
+/* Find the string, or copy it unto the arena and add it. The strings are always NULL terminated, and
+   lower cased if asked for, in which case the lookup is on the lower cased string as well. */
+const char *
+key_intern(key_intern_t *intern, key_arena_t *arena, const char *str, size_t len, int lower)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL; /* FNV-1a */
+    size_t i;
+    char *copy;
+
+    for (i = 0; i < len; ++i) {
+        hash = (hash ^ (unsigned char)(lower ? tolower(str[i]) : str[i])) * 0x100000001b3ULL;
+    }
+
+    for (i = hash & (intern->num_slots - 1); intern->slots[i].str; i = (i + 1) & (intern->num_slots - 1)) {
+        key_intern_slot_t *slot = &intern->slots[i];
+
+        if ((slot->hash == hash) && (slot->len == len)) {
+            size_t j = 0;
+
+            while ((j < len) && ((lower ? tolower(str[j]) : str[j]) == slot->str[j])) {
+                ++j;
+            }
+            if (j == len) {
+                return slot->str;
+            }
+        }
+    }
+
+    if ((intern->num_strings + 1) * 2 > intern->num_slots) {
+        key_intern_grow(intern);
+        for (i = hash & (intern->num_slots - 1); intern->slots[i].str; i = (i + 1) & (intern->num_slots - 1)) {
+        }
+    }
+    if (intern->num_strings + 2 > intern->num_slots) {
+        return NULL; /* There must always be an empty slot, which ends the probing */
+    }
+
+    if (!(copy = key_arena_allocate(arena, len + 1, 1))) {
+        return NULL;
+    }
+    for (size_t j = 0; j < len; ++j) {
+        copy[j] = lower ? tolower(str[j]) : str[j];
+    }
+    copy[len] = '\0';
+
+    intern->slots[i].str = copy;
+    intern->slots[i].len = len;
+    intern->slots[i].hash = hash;
+    ++intern->num_strings;
+
+    return copy;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
@@ -27,7 +27,14 @@
 #include <stdio.h>
 
 #include "http/key.h"
-#include "include/parameters.h"
+#include "include/budget.h"
+#include "include/evaluators.h"
+#include "include/memo.h"
+#include "include/normalize.h"
+#include "include/parser.h"
+#include "include/plan.h"
+#include "include/profile.h"
+
 #include "include/platform.h"
 
 #if HAVE_STDLIB_H
@@ -38,6 +45,10 @@
 #include <string.h>
 #endif
 
+#if HAVE_STRINGS_H
+#include <strings.h>
+#endif
+
 /* Initialize a Key object. This must be called before usage. */
 http_key_t *
 http_key_init(http_key_t *key, http_key_header_t get_header, http_key_malloc_t mem_alloc, http_key_free_t mem_free,
@@ -65,37 +76,304 @@ http_key_init(http_key_t *key, http_key_header_t get_header, http_key_malloc_t m
     } else {
         memset(&key->cache, 0, sizeof(key->cache));
     }
+    key->num_normalize = 0;
+    memset(&key->budget, 0, sizeof(key->budget));
+    key->num_compiled = 0;
+    memset(&key->profile, 0, sizeof(key->profile));
 
     return key;
 }
 
+/* The sentinel value returned by key_fetch_header() for values that exceed the budget */
+const char key_budget_exceeded[] = "";
+
+/* The sentinel value a header callback returns for a value that is not yet available */
+const char http_key_value_pending[] = "";
+
+int
+http_key_normalize(http_key_t *key, const char *header, unsigned int flags)
+{
+    size_t header_len = strlen(header);
+    size_t i;
+
+    assert(key);
+
+    for (i = 0; i < key->num_normalize; ++i) {
+        if ((key->normalize[i].header_len == header_len) && !strncasecmp(key->normalize[i].header, header, header_len)) {
+            break;
+        }
+    }
+
+    if (!flags) {
+        if (i < key->num_normalize) {
+            key->normalize[i] = key->normalize[--key->num_normalize];
+        }
+        return 0;
+    } else if (i == HTTP_KEY_MAX_NORMALIZE) {
+        return -1;
+    } else if (i == key->num_normalize) {
+        ++key->num_normalize;
+    }
+    key->normalize[i].header = header;
+    key->normalize[i].header_len = header_len;
+    key->normalize[i].flags = flags;
+
+    return 0;
+}
+
+void
+http_key_budget(http_key_t *key, size_t max_value_len, size_t max_tokens, size_t max_bytes)
+{
+    key->budget.max_value_len = max_value_len;
+    key->budget.max_tokens = max_tokens;
+    key->budget.max_bytes = max_bytes;
+}
+
+size_t
+http_key_budget_exceeded(http_key_t *key)
+{
+    return __atomic_load_n(&key->budget.exceeded, __ATOMIC_RELAXED);
+}
+
+int
+http_key_register(http_key_t *key, const char *key_string, http_key_compiled_t eval)
+{
+    assert(key);
+    assert(key_string);
+    assert(eval);
+
+    if (key->num_compiled == HTTP_KEY_MAX_COMPILED) {
+        return -1;
+    }
+    key->compiled[key->num_compiled].key_string = key_string;
+    key->compiled[key->num_compiled].key_string_len = strlen(key_string);
+    key->compiled[key->num_compiled++].eval = eval;
+
+    return 0;
+}
+
+http_key_params_t
+http_key_retain(http_key_params_t params)
+{
+    key_common_t *param = (key_common_t *)params;
+
+    if (param) {
+        atomic_fetch_add_explicit(&param->arena->refcount, 1, memory_order_relaxed);
+    }
+
+    return params;
+}
+
 void
 http_key_release(http_key_params_t params)
 {
     key_common_t *param = (key_common_t *)params;
 
-    if (param && param->arena && param->arena->key) {
+    /* The acquire / release ordering assures that all uses of the Key, in all threads, happens
+       before the arena is destroyed. */
+    if (param && param->arena && (1 == atomic_fetch_sub_explicit(&param->arena->refcount, 1, memory_order_acq_rel))) {
+        key_plan_destroy(atomic_load_explicit(&param->arena->plan, memory_order_acquire));
+        if (param->arena->memo) {
+            key_memo_destroy(param->arena->memo);
+            param->arena->memo = NULL;
+        }
         key_arena_destroy(param->arena);
     }
 }
 
-/* Main evaluation entry point */
+int
+http_key_memo_attach(http_key_t *key, http_key_params_t params, size_t num_entries, size_t entry_size)
+{
+    key_common_t *param = (key_common_t *)params;
+
+    assert(key);
+
+    if (!param || param->arena->memo) {
+        return -1;
+    }
+
+    return (param->arena->memo = key_memo_create(key, param, num_entries, entry_size)) ? 0 : -1;
+}
+
+void
+http_key_memo_stats(http_key_params_t params, size_t *hits, size_t *misses)
+{
+    key_common_t *param = (key_common_t *)params;
+    key_memo_t *memo = param ? param->arena->memo : NULL;
+
+    *hits = memo ? atomic_load_explicit(&memo->hits, memory_order_relaxed) : 0;
+    *misses = memo ? atomic_load_explicit(&memo->misses, memory_order_relaxed) : 0;
+}
+
 size_t
-http_key_eval(http_key_t *key, void *header_data, http_key_params_t params, char *buf, size_t buf_size)
+http_key_max_output_len(http_key_params_t params)
+{
+    key_common_t *param = (key_common_t *)params;
+
+    if (!param) {
+        return 0;
+    }
+
+    return param->arena->num_unbounded ? HTTP_KEY_UNBOUNDED : param->arena->bounded_len;
+}
+
+/* Number of distinct outputs of a single parameter, including "none" */
+static size_t
+key_param_cardinality(const key_common_t *param)
+{
+    switch (param->type) {
+        case KEY_PARAM_MATCH:
+        case KEY_PARAM_SUBSTR:
+            return 3;
+        case KEY_PARAM_PARTITION:
+            return ((const key_param_partition_t *)param)->num_partitions + 2;
+        case KEY_PARAM_PREFER:
+            return ((const key_param_prefer_t *)param)->num_codings + 2;
+        default:
+            return HTTP_KEY_UNBOUNDED;
+    }
+}
+
+size_t
+http_key_cardinality(http_key_params_t params)
+{
+    key_common_t *param = (key_common_t *)params;
+    size_t total = 1;
+
+    while (param) {
+        size_t card = key_param_cardinality(param);
+
+        if ((HTTP_KEY_UNBOUNDED == card) || (total > (HTTP_KEY_UNBOUNDED - 1) / card)) {
+            return HTTP_KEY_UNBOUNDED;
+        }
+        total *= card;
+        param = param->next;
+    }
+
+    return total;
+}
+
+http_key_params_t
+http_key_param_info(http_key_params_t params, http_key_param_info_t *info)
 {
     key_common_t *param = (key_common_t *)params;
+
+    assert(param);
+    assert(info);
+
+    info->type = param->debug_name;
+    info->header = param->header;
+    info->header_len = param->header_len;
+    info->max_len = param->max_len;
+    info->cardinality = key_param_cardinality(param);
+    info->arg = param->arg;
+    info->arg_len = param->arg_len;
+
+    return (http_key_params_t)param->next;
+}
+
+/* Evaluation fast path, used when the buffer has room for the max output of all bounded parameters.
+   Those need no bounds checks at all. The unbounded parameters (PARAM) are evaluated against a
+   smaller buffer size, which keeps enough room for the bounded parameters that follows. */
+static size_t
+key_eval_unchecked(http_key_t *key, void *header_data, key_common_t *param, char *buf, size_t buf_size)
+{
+    size_t reserved = param->arena->bounded_len;
     size_t pos = 0;
     const char *last_header = NULL;
     size_t last_header_len = 0;
     const char *value = NULL;
     size_t val_len = 0;
+    size_t used = 0;
+    key_scratch_t scratch;
 
+    scratch.pos = 0;
     while (param) {
+        size_t len;
+
         if ((last_header_len != param->header_len) || (last_header != param->header)) {
+            value = key_fetch_header(key, header_data, param->header, param->header_len, &val_len, &scratch);
+            last_header = param->header;
+            last_header_len = param->header_len;
+        }
+        if (!key_budget_ok(key, value, val_len, &used)) {
+            return 0;
+        }
+
+        if (HTTP_KEY_UNBOUNDED != param->max_len) {
+            if (value && (val_len > 0)) {
+                if (!(len = param->evaluator(param, value, val_len, buf, pos, buf_size))) {
+                    return 0; /* Error. We choose to abort the entire evaluation, as per the RFC. */
+                }
+                pos += len;
+            } else {
+                memcpy(buf + pos, "none", 4);
+                pos += 4;
+            }
+            reserved -= param->max_len;
+        } else {
+            size_t limit = buf_size - reserved;
+
+            if (value && (val_len > 0)) {
+                if ((pos >= limit) || !(len = param->evaluator(param, value, val_len, buf, pos, limit))) {
+                    return 0;
+                }
+                pos += len;
+            } else if ((limit - pos) >= 4) {
+                memcpy(buf + pos, "none", 4);
+                pos += 4;
+            } else {
+                return 0;
+            }
+        }
+        param = param->next;
+    }
+
+    return pos;
+}
+
+/* The checked evaluation, from param on, with pos bytes of output already in the buffer. When pending
+   is given, this stops at a header whose value is HTTP_KEY_VALUE_PENDING, and sets *pending to the
+   parameter to resume from. Otherwise a pending value is an error. A sampled evaluation also passes the
+   profile, which times the header lookups and the evaluators. Returns the output length, or 0 on
+   errors, with *pending set to NULL. */
+static size_t
+key_eval_from(http_key_t *key, void *header_data, key_common_t *param, char *buf, size_t pos, size_t buf_size, size_t *used,
+              key_common_t **pending, key_profile_t *profile)
+{
+    const char *last_header = NULL;
+    size_t last_header_len = 0;
+    const char *value = NULL;
+    size_t val_len = 0;
+    key_scratch_t scratch;
+
+    scratch.pos = 0;
+    while (param) {
+        key_profile_entry_t *entry = profile ? key_profile_entry(profile, param) : NULL;
+        uint64_t start = 0;
+
+        if ((last_header_len != param->header_len) || (last_header != param->header)) {
+            if (entry) {
+                start = key_profile_now();
+            }
             value = key->get_header(header_data, param->header, param->header_len, &val_len);
+            if (HTTP_KEY_VALUE_PENDING == value) {
+                if (!pending) {
+                    return 0;
+                }
+                *pending = param; /* Nothing is charged or produced for this header until it's resumed */
+                return pos;
+            }
+            value = key_check_value(key, param->header, param->header_len, value, &val_len, &scratch);
+            if (entry) {
+                key_profile_fetched(entry, start);
+            }
             last_header = param->header;
             last_header_len = param->header_len;
         }
+        if (!key_budget_ok(key, value, val_len, used)) {
+            return 0;
+        }
 
         if (value && (val_len > 0)) {
             size_t len;
@@ -103,12 +381,21 @@ http_key_eval(http_key_t *key, void *header_data, http_key_params_t params, char
             /* In this case, the header can not be NULL, and we'll assure that there's room for at
                least one result character in the buffer. Neither of those conditions needs to be
                checked for in the individual evaluators. */
+            if (entry) {
+                start = key_profile_now();
+            }
             if ((pos < buf_size) && ((len = param->evaluator(param, value, val_len, buf, pos, buf_size)) > 0)) {
                 pos += len;
             } else {
                 return 0; /* Error. We choose to abort the entire evaluation, as per the RFC. */
             }
+            if (entry) {
+                key_profile_evaluated(entry, start, value, val_len);
+            }
         } else {
+            if (entry) {
+                key_profile_evaluated(entry, 0, NULL, 0);
+            }
             /* This deals with step 1 in all evaluators; header is not present. */
             if ((buf_size - pos) >= 4) {
                 memcpy(buf + pos, "none", 4);
@@ -123,6 +410,173 @@ http_key_eval(http_key_t *key, void *header_data, http_key_params_t params, char
     return pos;
 }
 
+/* The evaluation of the parameters, without any memoization */
+size_t
+key_eval_params(http_key_t *key, void *header_data, key_common_t *param, char *buf, size_t buf_size)
+{
+    size_t used = 0;
+
+    if (param && (param->arena->bounded_len <= buf_size)) {
+        return key_eval_unchecked(key, header_data, param, buf, buf_size);
+    }
+
+    return key_eval_from(key, header_data, param, buf, 0, buf_size, &used, NULL, NULL);
+}
+
+/* Evaluate from where the state left off, until done or the next pending header */
+static size_t
+key_eval_continue(http_key_t *key, http_key_eval_state_t *state, void *header_data)
+{
+    key_common_t *pending = NULL;
+    size_t pos = key_eval_from(key, header_data, (key_common_t *)state->next, state->buf, state->pos, state->buf_size, &state->used,
+                               &pending, NULL);
+
+    state->next = (http_key_params_t)pending;
+    state->pos = pos;
+    if (pending) {
+        return HTTP_KEY_PENDING;
+    }
+
+    return pos;
+}
+
+size_t
+http_key_eval_start(http_key_t *key, http_key_eval_state_t *state, void *header_data, http_key_params_t params, char *buf,
+                    size_t buf_size)
+{
+    assert(key);
+    assert(state);
+
+    state->next = params;
+    state->buf = buf;
+    state->buf_size = buf_size;
+    state->pos = 0;
+    state->used = 0;
+    if (!params) {
+        return 0;
+    }
+
+    return key_eval_continue(key, state, header_data);
+}
+
+size_t
+http_key_eval_resume(http_key_t *key, http_key_eval_state_t *state, void *header_data)
+{
+    assert(key);
+    assert(state);
+
+    if (!state->next) {
+        return 0; /* Not pending, it already finished or failed */
+    }
+
+    return key_eval_continue(key, state, header_data);
+}
+
+/* Main evaluation entry point. Keys start out interpreted from the parameter list, and the thread
+   doing the KEY_PLAN_THRESHOLD'th evaluation builds the plan and publishes it. After that, all
+   threads use the plan, and the counting stops. A memoized Key stays on the parameter list, since
+   the memo replays the header fetches in the same order as key_eval_params(). A registered
+   precompiled evaluator replaces all of this, unless the values must be normalized or budgeted. A
+   sampled evaluation is always done on the parameter list, see http_key_profile(). */
+size_t
+http_key_eval(http_key_t *key, void *header_data, http_key_params_t params, char *buf, size_t buf_size)
+{
+    key_common_t *param = (key_common_t *)params;
+    key_plan_t *plan;
+    size_t used = 0;
+
+    if (!param) {
+        return 0;
+    } else if (key->profile.rate && key_profile_sampled(key)) {
+        return key_eval_from(key, header_data, param, buf, 0, buf_size, &used, NULL, (key_profile_t *)key->profile.data);
+    } else if (param->arena->memo) {
+        return key_memo_eval(param->arena->memo, key, header_data, param, buf, buf_size);
+    } else if (param->arena->compiled && !key->num_normalize &&
+               !(key->budget.max_value_len || key->budget.max_tokens || key->budget.max_bytes)) {
+        return param->arena->compiled(key, header_data, buf, buf_size);
+    } else if ((plan = atomic_load_explicit(&param->arena->plan, memory_order_acquire))) {
+        return key_plan_eval(plan, key, header_data, buf, buf_size);
+    }
+
+    /* A Key that did not get a plan stops counting as well, rather than writing the shared counter forever */
+    if (KEY_PLAN_THRESHOLD && (atomic_load_explicit(&param->arena->evals, memory_order_relaxed) < KEY_PLAN_THRESHOLD) &&
+        (KEY_PLAN_THRESHOLD == atomic_fetch_add_explicit(&param->arena->evals, 1, memory_order_relaxed) + 1)) {
+        atomic_store_explicit(&param->arena->plan, key_plan_create(key, param), memory_order_release);
+    }
+
+    return key_eval_params(key, header_data, param, buf, buf_size);
+}
+
+/* Compare one VALUE parameter against the stored key, without producing the output */
+static size_t
+key_matches_value(const char *value, size_t val_len, const char *stored, size_t stored_len)
+{
+    size_t len = 0;
+    size_t n = val_len;
+
+    do {
+        ++len;
+        n /= 10;
+    } while (n);
+
+    if ((stored_len < len + 1 + val_len) || (key_memtoll(stored, len) != val_len) || (stored[len] != ':') ||
+        memcmp(stored + len + 1, value, val_len)) {
+        return 0;
+    }
+
+    return len + 1 + val_len;
+}
+
+int
+http_key_eval_matches(http_key_t *key, void *header_data, http_key_params_t params, const char *stored, size_t stored_len)
+{
+    key_common_t *param = (key_common_t *)params;
+    const char *last_header = NULL;
+    size_t last_header_len = 0;
+    const char *value = NULL;
+    size_t val_len = 0;
+    size_t pos = 0;
+    size_t used = 0;
+    key_scratch_t scratch;
+
+    scratch.pos = 0;
+    while (param) {
+        char out[KEY_MATCHES_OUTPUT];
+        size_t len;
+
+        if ((last_header_len != param->header_len) || (last_header != param->header)) {
+            value = key_fetch_header(key, header_data, param->header, param->header_len, &val_len, &scratch);
+            last_header = param->header;
+            last_header_len = param->header_len;
+        }
+        if (!key_budget_ok(key, value, val_len, &used)) {
+            return 0;
+        }
+
+        if (!value || (0 == val_len)) {
+            if (((stored_len - pos) < 4) || memcmp(stored + pos, "none", 4)) {
+                return 0;
+            }
+            len = 4;
+        } else if (KEY_PARAM_VALUE == param->type) {
+            if (!(len = key_matches_value(value, val_len, stored + pos, stored_len - pos))) {
+                return 0;
+            }
+        } else {
+            /* The output can't match if it's longer than what's left of the stored key, so that's the limit */
+            size_t limit = (stored_len - pos) < sizeof(out) ? (stored_len - pos) : sizeof(out);
+
+            if (!limit || !(len = param->evaluator(param, value, val_len, out, 0, limit)) || memcmp(stored + pos, out, len)) {
+                return 0;
+            }
+        }
+        pos += len;
+        param = param->next;
+    }
+
+    return pos == stored_len;
+}
+
 /*
   local variables:
   mode: C
@@ -0,0 +1,366 @@
+/** @file
+
+    The (optional) per-Key memoization of evaluation results. Header values
+    repeat a lot in real traffic, so a small table mapping a hash of the
+    fetched header values to the previous output saves re-evaluating all
+    the parameters. The header values are kept in the table as well, to
+    verify a hit against hash collisions.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <assert.h>
+
+#include "include/budget.h"
+#include "include/memo.h"
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif
+
+/* The header values fetched for one evaluation */
+typedef struct {
+    const char *value;
+    size_t len;
+} key_memo_value_t;
+
+typedef struct {
+    key_memo_value_t *values;
+    size_t pos;
+} key_memo_replay_t;
+
+/* Number of header fetches a single evaluation of the params does, see key_eval_params() */
+static size_t
+key_memo_count_headers(key_common_t *param)
+{
+    const char *last_header = NULL;
+    size_t last_header_len = 0;
+    size_t num = 0;
+
+    while (param) {
+        if ((last_header_len != param->header_len) || (last_header != param->header)) {
+            last_header = param->header;
+            last_header_len = param->header_len;
+            ++num;
+        }
+        param = param->next;
+    }
+
+    return num;
+}
+
+static inline uint64_t
+key_memo_mix(uint64_t hash, uint64_t word)
+{
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+
+    return hash ^ (hash >> 29);
+}
+
+/* A fast, word at a time, hash of a header value */
+static uint64_t
+key_memo_hash(uint64_t hash, const char *value, size_t len)
+{
+    const char *end = value + len;
+
+    hash = key_memo_mix(hash, len);
+    while ((end - value) >= 8) {
+        uint64_t word;
+
+        memcpy(&word, value, 8);
+        hash = key_memo_mix(hash, word);
+        value += 8;
+    }
+    if (value < end) {
+        hash = key_memo_mix(hash, key_load_word(value, end - value, end));
+    }
+
+    return hash;
+}
+
+/* A position in the words of a memo entry, following the entry header */
+typedef struct {
+    _Atomic uint64_t *words;
+    size_t pos; /* In bytes */
+} key_memo_cursor_t;
+
+static inline key_memo_cursor_t
+key_memo_cursor(key_memo_entry_t *entry)
+{
+    key_memo_cursor_t cursor = {(_Atomic uint64_t *)(entry + 1), 0};
+
+    return cursor;
+}
+
+/* Copy the next len bytes out of the entry. This may be a torn read of an entry being written, which
+   the version check in key_memo_lookup() catches. */
+static void
+key_memo_get(key_memo_cursor_t *cursor, void *dst, size_t len)
+{
+    unsigned char *out = (unsigned char *)dst;
+
+    while (len > 0) {
+        uint64_t word = atomic_load_explicit(&cursor->words[cursor->pos / 8], memory_order_relaxed);
+        size_t offset = cursor->pos % 8;
+        size_t n = (len < 8 - offset) ? len : 8 - offset;
+
+        memcpy(out, (unsigned char *)&word + offset, n);
+        out += n;
+        cursor->pos += n;
+        len -= n;
+    }
+}
+
+/* Compare the next len bytes of the entry to the value, a chunk at a time */
+static int
+key_memo_equal(key_memo_cursor_t *cursor, const char *value, size_t len)
+{
+    char chunk[64];
+
+    while (len > 0) {
+        size_t n = (len < sizeof(chunk)) ? len : sizeof(chunk);
+
+        key_memo_get(cursor, chunk, n);
+        if (memcmp(chunk, value, n)) {
+            return 0;
+        }
+        value += n;
+        len -= n;
+    }
+
+    return 1;
+}
+
+/* Append len bytes to the entry, only while holding it (odd version) */
+static void
+key_memo_put(key_memo_cursor_t *cursor, const void *src, size_t len)
+{
+    const unsigned char *in = (const unsigned char *)src;
+
+    while (len > 0) {
+        size_t offset = cursor->pos % 8;
+        size_t n = (len < 8 - offset) ? len : 8 - offset;
+        uint64_t word = offset ? atomic_load_explicit(&cursor->words[cursor->pos / 8], memory_order_relaxed) : 0;
+
+        memcpy((unsigned char *)&word + offset, in, n);
+        atomic_store_explicit(&cursor->words[cursor->pos / 8], word, memory_order_relaxed);
+        in += n;
+        cursor->pos += n;
+        len -= n;
+    }
+}
+
+/* Look the values up in the entry, and copy the output into the buffer on a hit. Returns 1 on a hit,
+   with *len set to the output length, or 0 if the buffer is too small (the evaluation would fail as
+   well). An entry that is being written, or that was replaced while reading it, is a miss. */
+static int
+key_memo_lookup(key_memo_t *memo, key_memo_entry_t *entry, const key_memo_value_t *values, size_t num, size_t values_len,
+                uint64_t hash, char *buf, size_t buf_size, size_t *len)
+{
+    uint64_t version = atomic_load_explicit(&entry->version, memory_order_acquire);
+    key_memo_cursor_t cursor = key_memo_cursor(entry);
+    size_t output_len;
+
+    if ((version & 1) || (atomic_load_explicit(&entry->hash, memory_order_relaxed) != hash) ||
+        (atomic_load_explicit(&entry->values_len, memory_order_relaxed) != values_len)) {
+        return 0;
+    }
+    output_len = atomic_load_explicit(&entry->output_len, memory_order_relaxed);
+    if ((sizeof(key_memo_entry_t) + values_len + output_len) > memo->entry_size) {
+        return 0; /* Torn */
+    }
+
+    /* Verify the hit, to make sure it's not a hash collision */
+    for (size_t i = 0; i < num; ++i) {
+        uint32_t stored_len;
+
+        key_memo_get(&cursor, &stored_len, 4);
+        if (!values[i].value) {
+            if (stored_len != KEY_MEMO_NO_VALUE) {
+                return 0;
+            }
+        } else if ((stored_len != values[i].len) || !key_memo_equal(&cursor, values[i].value, values[i].len)) {
+            return 0;
+        }
+    }
+    if (output_len <= buf_size) {
+        key_memo_get(&cursor, buf, output_len);
+        *len = output_len;
+    } else {
+        *len = 0;
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+
+    return atomic_load_explicit(&entry->version, memory_order_relaxed) == version;
+}
+
+/* Store the values and the output in the entry, unless another thread is writing it */
+static void
+key_memo_store(key_memo_entry_t *entry, const key_memo_value_t *values, size_t num, size_t values_len, uint64_t hash,
+               const char *output, size_t output_len)
+{
+    uint64_t version = atomic_load_explicit(&entry->version, memory_order_relaxed);
+    key_memo_cursor_t cursor = key_memo_cursor(entry);
+
+    if ((version & 1) ||
+        !atomic_compare_exchange_strong_explicit(&entry->version, &version, version + 1, memory_order_acquire,
+                                                 memory_order_relaxed)) {
+        return;
+    }
+    atomic_thread_fence(memory_order_release);
+
+    for (size_t i = 0; i < num; ++i) {
+        uint32_t stored_len = values[i].value ? (uint32_t)values[i].len : KEY_MEMO_NO_VALUE;
+
+        key_memo_put(&cursor, &stored_len, 4);
+        if (values[i].value) {
+            key_memo_put(&cursor, values[i].value, values[i].len);
+        }
+    }
+    key_memo_put(&cursor, output, output_len);
+    atomic_store_explicit(&entry->hash, hash, memory_order_relaxed);
+    atomic_store_explicit(&entry->values_len, (uint32_t)values_len, memory_order_relaxed);
+    atomic_store_explicit(&entry->output_len, (uint32_t)output_len, memory_order_relaxed);
+
+    atomic_store_explicit(&entry->version, version + 2, memory_order_release);
+}
+
+/* The header lookup callback used on a miss, which hands out the already fetched values in order */
+static const char *
+key_memo_replay(void *data, const char *header, size_t header_len, size_t *value_len)
+{
+    key_memo_replay_t *replay = (key_memo_replay_t *)data;
+    key_memo_value_t *v = &replay->values[replay->pos++];
+
+    *value_len = v->len;
+    return v->value;
+}
+
+key_memo_t *
+key_memo_create(http_key_t *key, key_common_t *params, size_t num_entries, size_t entry_size)
+{
+    size_t num_headers = key_memo_count_headers(params);
+    size_t entries = 1;
+    key_memo_t *memo;
+
+    if ((num_headers > KEY_MEMO_MAX_HEADERS) || (entry_size <= sizeof(key_memo_entry_t)) || (num_entries == 0)) {
+        return NULL;
+    }
+    while (entries < num_entries) {
+        entries <<= 1;
+    }
+    entry_size = KEY_ARENA_ALIGN(entry_size);
+
+    if (!(memo = (key_memo_t *)key->malloc(sizeof(key_memo_t) + entries * entry_size))) {
+        return NULL;
+    }
+    memo->key = key;
+    memo->num_entries = entries;
+    memo->entry_size = entry_size;
+    memo->num_headers = num_headers;
+    atomic_init(&memo->hits, 0);
+    atomic_init(&memo->misses, 0);
+    memo->entries = (unsigned char *)(memo + 1);
+    memset(memo->entries, 0, entries * entry_size);
+
+    return memo;
+}
+
+void
+key_memo_destroy(key_memo_t *memo)
+{
+    assert(memo);
+
+    memo->key->free(memo);
+}
+
+size_t
+key_memo_eval(key_memo_t *memo, http_key_t *key, void *header_data, key_common_t *params, char *buf, size_t buf_size)
+{
+    key_memo_value_t values[KEY_MEMO_MAX_HEADERS];
+    key_memo_replay_t replay = {values, 0};
+    const char *last_header = NULL;
+    size_t last_header_len = 0;
+    size_t num = 0, values_len = 0, len;
+    uint64_t hash = 0;
+    key_memo_entry_t *entry;
+    http_key_t replay_key;
+
+    /* Fetch all the headers up front, exactly like the evaluation would */
+    for (key_common_t *param = params; param; param = param->next) {
+        if ((last_header_len != param->header_len) || (last_header != param->header)) {
+            key_memo_value_t *v = &values[num++];
+
+            v->value = key->get_header(header_data, param->header, param->header_len, &v->len);
+            if (v->value && (key->budget.max_value_len || key->budget.max_tokens) &&
+                (key_budget_exceeded == key_budget_value(key, v->value, v->len))) {
+                return 0;
+            }
+            if (!v->value) {
+                v->len = 0;
+                hash = key_memo_mix(hash, KEY_MEMO_NO_VALUE);
+            } else {
+                hash = key_memo_hash(hash, v->value, v->len);
+                values_len += v->len;
+            }
+            values_len += 4;
+            last_header = param->header;
+            last_header_len = param->header_len;
+        }
+    }
+    assert(num == memo->num_headers);
+
+    entry = (key_memo_entry_t *)(memo->entries + (hash & (memo->num_entries - 1)) * memo->entry_size);
+    if (key_memo_lookup(memo, entry, values, num, values_len, hash, buf, buf_size, &len)) {
+        atomic_fetch_add_explicit(&memo->hits, 1, memory_order_relaxed);
+        return len;
+    }
+
+    /* Miss, evaluate with the already fetched header values */
+    atomic_fetch_add_explicit(&memo->misses, 1, memory_order_relaxed);
+    replay_key = *key;
+    replay_key.get_header = &key_memo_replay;
+    replay_key.budget.max_value_len = 0; /* Already checked above */
+    replay_key.budget.max_tokens = 0;
+    replay_key.budget.exceeded = 0;
+    len = key_eval_params(&replay_key, &replay, params, buf, buf_size);
+    if (replay_key.budget.exceeded) {
+        key_budget_count(key);
+        return 0; /* Not stored, such that every evaluation over the budget is counted */
+    }
+
+    /* Store the result, if it fits in an entry, replacing whatever was there. A failed evaluation is
+       not stored, since it may only have failed on a buffer too small for the output. */
+    if ((len > 0) && ((sizeof(key_memo_entry_t) + values_len + len) <= memo->entry_size)) {
+        key_memo_store(entry, values, num, values_len, hash, buf, len);
+    }
+
+    return len;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
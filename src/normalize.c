@@ -0,0 +1,184 @@
+/** @file
+
+    Normalization of header values before evaluation, such that values which
+    mean the same (e.g. "GZIP , deflate" and "deflate,gzip") produce the same
+    output. This is configured per header with http_key_normalize(). The
+    normalized value is written into a scratch area provided by the caller,
+    there are no allocations, and values that do not fit are used as is.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <assert.h>
+#include <ctype.h>
+
+#include "include/normalize.h"
+#include "include/parser.h"
+
+#if HAVE_STRINGS_H
+#include <strings.h>
+#endif
+
+/* A list item in the scratch, as an offset and length, to keep the array of items small */
+typedef struct {
+    uint16_t pos;
+    uint16_t len;
+} key_normalize_item_t;
+
+/* The gaps of the Shell sort (Ciura), enough for KEY_NORMALIZE_MAX_ITEMS */
+static const size_t g_gaps[] = {301, 132, 57, 23, 10, 4, 1};
+
+/* Normalize one (already trimmed) list item, returns the new length, which is never longer */
+static size_t
+key_normalize_item(const char *item, size_t len, unsigned int flags, char *out)
+{
+    size_t pos = 0;
+    int space = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        char c = item[i];
+
+        if ((flags & HTTP_KEY_NORMALIZE_SPACE) && isspace((unsigned char)c)) {
+            space = 1;
+            continue;
+        }
+        if (space) {
+            out[pos++] = ' ';
+            space = 0;
+        }
+        out[pos++] = (flags & HTTP_KEY_NORMALIZE_LOWER) ? tolower((unsigned char)c) : c;
+    }
+
+    return pos;
+}
+
+static int
+key_normalize_cmp(const char *out, const key_normalize_item_t *a, const key_normalize_item_t *b)
+{
+    int cmp = memcmp(out + a->pos, out + b->pos, a->len < b->len ? a->len : b->len);
+
+    return cmp ? cmp : (a->len > b->len) - (a->len < b->len);
+}
+
+const char *
+key_normalize(http_key_t *key, const char *header, size_t header_len, const char *value, size_t *value_len,
+              key_scratch_t *scratch)
+{
+    key_normalize_item_t items[KEY_NORMALIZE_MAX_ITEMS];
+    const char *start = value;
+    const char *next = NULL;
+    unsigned int flags = 0;
+    size_t num = 0, pos = 0, len;
+    char *out = scratch->buf + scratch->pos;
+    char *joined;
+
+    for (size_t i = 0; i < key->num_normalize; ++i) {
+        if ((key->normalize[i].header_len == header_len) && !strncasecmp(key->normalize[i].header, header, header_len)) {
+            flags = key->normalize[i].flags;
+            break;
+        }
+    }
+
+    /* Sorting needs room for the items, and then for the sorted list */
+    if (!flags || ((KEY_NORMALIZE_SCRATCH - scratch->pos) / ((flags & HTTP_KEY_NORMALIZE_SORT) ? 2 : 1) < *value_len)) {
+        return value;
+    }
+
+    if (!(flags & (HTTP_KEY_NORMALIZE_SPACE | HTTP_KEY_NORMALIZE_SORT))) {
+        for (size_t i = 0; i < *value_len; ++i) {
+            out[i] = tolower((unsigned char)value[i]);
+        }
+        scratch->pos += *value_len;
+        return out;
+    }
+
+    /* The items are joined with a single ",", so the result is never longer than the value. Empty
+       items are dropped, and the items after them are kept. */
+    while (start < value + *value_len) {
+        if (0 == (len = key_strsep(value, *value_len, &start, &next, ','))) {
+            if (start >= value + *value_len) {
+                break; /* Trailing whitespace */
+            }
+            start = next;
+            continue;
+        }
+        if (flags & HTTP_KEY_NORMALIZE_SORT) {
+            assert(num < KEY_NORMALIZE_MAX_ITEMS);
+            items[num].pos = (uint16_t)pos;
+            items[num].len = (uint16_t)key_normalize_item(start, len, flags, out + pos);
+            pos += items[num++].len;
+        } else {
+            if (pos > 0) {
+                out[pos++] = ',';
+            }
+            pos += key_normalize_item(start, len, flags, out + pos);
+        }
+        start = next;
+    }
+
+    if (!(flags & HTTP_KEY_NORMALIZE_SORT)) {
+        scratch->pos += pos;
+        *value_len = pos;
+        return out;
+    }
+
+    /* Shell sort, which is an insertion sort for the usual short lists */
+    for (size_t g = 0; g < sizeof(g_gaps) / sizeof(g_gaps[0]); ++g) {
+        size_t gap = g_gaps[g];
+
+        for (size_t i = gap; i < num; ++i) {
+            key_normalize_item_t item = items[i];
+            size_t j = i;
+
+            while ((j >= gap) && (key_normalize_cmp(out, &items[j - gap], &item) > 0)) {
+                items[j] = items[j - gap];
+                j -= gap;
+            }
+            items[j] = item;
+        }
+    }
+
+    joined = out + pos;
+    len = 0;
+    for (size_t i = 0; i < num; ++i) {
+        if ((i > 0) && !key_normalize_cmp(out, &items[i - 1], &items[i])) {
+            continue; /* Duplicate */
+        }
+        if (len > 0) {
+            joined[len++] = ',';
+        }
+        memcpy(joined + len, out + items[i].pos, items[i].len);
+        len += items[i].len;
+    }
+    assert(len <= *value_len);
+    scratch->pos += pos + len;
+    *value_len = len;
+
+    return joined;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
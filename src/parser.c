@@ -27,6 +27,7 @@
 #include <stdio.h>
 
 #include "include/evaluators.h"
+#include "include/intern.h"
 
 #if HAVE_STRING_H
 #include <string.h>
@@ -36,16 +37,48 @@
 #include <strings.h>
 #endif
 
+/* Size of the pools that http_key_parse_many() carves the Key arenas out of */
+#define KEY_POOL_SIZE (64 * 1024)
+
+/* Room for any one parameter object, the scratch memory of a measuring arena */
+typedef union {
+    key_common_t value;
+    key_param_div_t div;
+    key_param_partition_t partition;
+    key_param_match_t match;
+    key_param_substr_t substr;
+    key_param_param_t param;
+    key_param_prefer_t prefer;
+} key_param_any_t;
+
+/* The size and alignment of each parameter type, for copying parameters in http_key_compact() */
+static const struct {
+    size_t size;
+    size_t align;
+} g_layouts[] = {
+    [KEY_PARAM_DIV] = {sizeof(key_param_div_t), _Alignof(key_param_div_t)},
+    [KEY_PARAM_PARTITION] = {sizeof(key_param_partition_t), _Alignof(key_param_partition_t)},
+    [KEY_PARAM_MATCH] = {sizeof(key_param_match_t), _Alignof(key_param_match_t)},
+    [KEY_PARAM_SUBSTR] = {sizeof(key_param_substr_t), _Alignof(key_param_substr_t)},
+    [KEY_PARAM_PARAM] = {sizeof(key_param_param_t), _Alignof(key_param_param_t)},
+    [KEY_PARAM_PREFER] = {sizeof(key_param_prefer_t), _Alignof(key_param_prefer_t)},
+    [KEY_PARAM_VALUE] = {sizeof(key_common_t), _Alignof(key_common_t)},
+};
+
 /* These are the template structures for each of the supported parameter evaluator types */
 static const key_param_div_t g_div = {
     .c.type = KEY_PARAM_DIV,
     .c.evaluator = &key_eval_div,
     .c.header = NULL,
     .c.header_len = 0,
+    .c.max_len = 0,
     .c.debug_name = "DIV",
+    .c.arg = NULL,
+    .c.arg_len = 0,
     .c.arena = NULL,
     .c.next = NULL,
     .divider = 0,
+    .shift = 0,
 };
 
 static const key_param_partition_t g_partition = {
@@ -53,7 +86,10 @@ static const key_param_partition_t g_partition = {
     .c.evaluator = &key_eval_partition,
     .c.header = NULL,
     .c.header_len = 0,
+    .c.max_len = 0,
     .c.debug_name = "PARTITION",
+    .c.arg = NULL,
+    .c.arg_len = 0,
     .c.arena = NULL,
     .c.next = NULL,
     .partitions = {0},
@@ -65,11 +101,15 @@ static const key_param_match_t g_match = {
     .c.evaluator = &key_eval_match,
     .c.header = NULL,
     .c.header_len = 0,
+    .c.max_len = 0,
     .c.debug_name = "MATCH",
+    .c.arg = NULL,
+    .c.arg_len = 0,
     .c.arena = NULL,
     .c.next = NULL,
     .match = NULL,
     .match_len = 0,
+    .word = 0,
 };
 
 static const key_param_substr_t g_substr = {
@@ -77,7 +117,10 @@ static const key_param_substr_t g_substr = {
     .c.evaluator = &key_eval_substr,
     .c.header = NULL,
     .c.header_len = 0,
+    .c.max_len = 0,
     .c.debug_name = "SUBSTR",
+    .c.arg = NULL,
+    .c.arg_len = 0,
     .c.arena = NULL,
     .c.next = NULL,
     .substr = NULL,
@@ -89,13 +132,47 @@ static const key_param_param_t g_param = {
     .c.evaluator = &key_eval_param,
     .c.header = NULL,
     .c.header_len = 0,
-    .c.debug_name = "param",
+    .c.max_len = 0,
+    .c.debug_name = "PARAM",
+    .c.arg = NULL,
+    .c.arg_len = 0,
     .c.arena = NULL,
     .c.next = NULL,
     .param = NULL,
     .param_len = 0,
 };
 
+static const key_common_t g_value = {
+    .type = KEY_PARAM_VALUE,
+    .evaluator = &key_eval_value,
+    .header = NULL,
+    .header_len = 0,
+    .max_len = 0,
+    .debug_name = "VALUE",
+    .arg = NULL,
+    .arg_len = 0,
+    .arena = NULL,
+    .next = NULL,
+};
+
+static const key_param_prefer_t g_prefer = {
+    .c.type = KEY_PARAM_PREFER,
+    .c.evaluator = &key_eval_prefer,
+    .c.header = NULL,
+    .c.header_len = 0,
+    .c.max_len = 0,
+    .c.debug_name = "PREFER",
+    .c.arg = NULL,
+    .c.arg_len = 0,
+    .c.arena = NULL,
+    .c.next = NULL,
+    .codings = {NULL},
+    .coding_lens = {0},
+    .words = {0},
+    .folds = {0},
+    .num_codings = 0,
+};
+
 /* This is an specialized implementation of strsep(), obviously not compatible, but useful
    for us since it does the following:
 
@@ -155,6 +232,155 @@ key_memtoll(const char *str, size_t len)
     return ret;
 }
 
+/* Number of decimal digits needed to print a value */
+static size_t
+key_digits(uint64_t value)
+{
+    size_t digits = 1;
+
+    while (value >= 10) {
+        value /= 10;
+        ++digits;
+    }
+
+    return digits;
+}
+
+/* The max number of bytes a parameter can produce, including the "none" result. This is
+   HTTP_KEY_UNBOUNDED for parameters where the output is (part of) the header value. */
+static size_t
+key_max_len(const key_common_t *param)
+{
+    size_t len;
+
+    switch (param->type) {
+        case KEY_PARAM_DIV: {
+            uint64_t divider = ((const key_param_div_t *)param)->divider;
+
+            len = key_digits(divider ? UINT64_MAX / divider : UINT64_MAX);
+        } break;
+        case KEY_PARAM_PARTITION:
+            len = key_digits(((const key_param_partition_t *)param)->num_partitions);
+            break;
+        case KEY_PARAM_MATCH:
+        case KEY_PARAM_SUBSTR:
+            len = 1;
+            break;
+        case KEY_PARAM_PREFER:
+            len = key_digits(((const key_param_prefer_t *)param)->num_codings);
+            break;
+        default:
+            return HTTP_KEY_UNBOUNDED;
+    }
+
+    return len > 4 ? len : 4;
+}
+
+/* Pick a specialized evaluator based on the shape of the parameter argument, where possible. The
+   templates above always have the generic evaluators. */
+static void
+key_specialize(key_common_t *param)
+{
+    switch (param->type) {
+        case KEY_PARAM_DIV: {
+            key_param_div_t *div = (key_param_div_t *)param;
+
+            if (div->divider && !(div->divider & (div->divider - 1))) {
+                while ((1ULL << div->shift) != div->divider) {
+                    ++div->shift;
+                }
+                param->evaluator = &key_eval_div_shift;
+            }
+        } break;
+        case KEY_PARAM_MATCH: {
+            key_param_match_t *match = (key_param_match_t *)param;
+
+            if (match->match_len <= 8) {
+                match->word = key_load_word(match->match, match->match_len, match->match + match->match_len);
+                param->evaluator = &key_eval_match_word;
+            }
+        } break;
+        case KEY_PARAM_SUBSTR: {
+            key_param_substr_t *substr = (key_param_substr_t *)param;
+            size_t len = substr->substr_len;
+
+            if ((len > 0) && !memchr(substr->substr, ',', len) && !isspace(substr->substr[0]) &&
+                !isspace(substr->substr[len - 1])) {
+                param->evaluator = (1 == len) ? &key_eval_substr_char : &key_eval_substr_value;
+            }
+        } break;
+        case KEY_PARAM_PREFER: {
+            key_param_prefer_t *prefer = (key_param_prefer_t *)param;
+
+            for (size_t i = 0; i < prefer->num_codings; ++i) {
+                const char *coding = prefer->codings[i]; /* Lower cased by key_factory() */
+                char folds[8] = {0};
+
+                for (size_t j = 0; j < prefer->coding_lens[i]; ++j) {
+                    if ((j < 8) && isalpha(coding[j])) {
+                        folds[j] = 0x20;
+                    }
+                }
+                if (prefer->coding_lens[i] <= 8) {
+                    prefer->words[i] = key_load_word(coding, prefer->coding_lens[i], coding + prefer->coding_lens[i]);
+                    prefer->folds[i] = key_load_word(folds, prefer->coding_lens[i], folds + prefer->coding_lens[i]);
+                }
+            }
+        } break;
+        default:
+            break;
+    }
+}
+
+/* Copy a string unto the arena, NULL terminated and optionally lower cased. While parsing with
+   http_key_parse_many(), the string is interned instead, and might be on the arena of another Key. A
+   measuring arena only counts the bytes, and uses the original string. */
+static const char *
+key_arena_string(key_arena_t *arena, const char *str, size_t len, int lower)
+{
+    char *copy;
+
+    if (arena->intern) {
+        return key_intern(arena->intern, arena, str, len, lower);
+    } else if (arena->scratch) {
+        return key_arena_allocate(arena, len + 1, 1) ? str : NULL;
+    } else if ((copy = (char *)key_arena_allocate(arena, len + 1, 1))) {
+        for (size_t i = 0; i < len; ++i) {
+            copy[i] = lower ? tolower(str[i]) : str[i];
+        }
+        copy[len] = '\0';
+    }
+
+    return copy;
+}
+
+/* Finish up a newly created parameter: the header string is dup'ed unto the arena, unless it's the
+   same as the previous header, and the evaluator is specialized. */
+static key_common_t *
+key_param_setup(key_arena_t *arena, key_common_t *param, const char *header, size_t header_len)
+{
+    char *hdr = arena->last_header;
+
+    param->arena = arena;
+    if (!hdr || (arena->last_header_len != header_len) || strncasecmp(hdr, header, header_len)) {
+        hdr = (char *)key_arena_string(arena, header, header_len, 1);
+
+        if (hdr) {
+            arena->last_header = hdr;
+            arena->last_header_len = header_len;
+        } else {
+            /* Memory allocation failed, return fast for now: ToDo: Something better? */
+            return NULL;
+        }
+    }
+    param->header = hdr;
+    param->header_len = header_len;
+    param->max_len = key_max_len(param);
+    key_specialize(param);
+
+    return param;
+}
+
 /* This is the main factory for creating new objects. */
 static key_common_t *
 key_factory(key_arena_t *arena, const char *param_str, size_t param_len, const char *header, size_t header_len)
@@ -163,35 +389,39 @@ key_factory(key_arena_t *arena, const char *param_str, size_t param_len, const c
     /* ToDo: Do we need to deal with WS's around the ='s ? */
     const char *delim = memchr(param_str, '=', param_len);
     size_t type_len, arg_len;
-    void *arg;
+    const char *arg;
 
     if (!delim) {
         return NULL;
     }
 
-    /* Setup the parameter argument, which must be copied unto the arena */
+    /* Setup the parameter argument, which is copied unto the arena */
     type_len = (delim - param_str);
     arg_len = (param_str + param_len - delim - 1);
 
     if (0 == header_len) {
         header_len = strlen(header);
     }
+    /* The PREFER codings are compared case insensitively, and kept lower cased */
+    if (!(arg = key_arena_string(arena, delim + 1, arg_len, (6 == type_len) && !strncasecmp(param_str, "prefer", 6)))) {
+        return NULL;
+    }
 
     switch (type_len) {
         case 3: /* DIV */
             if (!strncasecmp(param_str, "div", 3)) {
-                key_param_div_t *p = (key_param_div_t *)key_arena_allocate(arena, sizeof(key_param_div_t));
+                key_param_div_t *p = KEY_ARENA_NEW(arena, key_param_div_t);
 
                 if (p) {
                     memcpy(p, &g_div, sizeof(g_div)); /* Copy the Div template */
-                    p->divider = key_memtoll(delim + 1, arg_len);
+                    p->divider = key_memtoll(arg, arg_len);
                     param = &p->c;
                 }
             }
             break;
         case 9: /* PARTITION */
             if (!strncasecmp(param_str, "partition", 9)) {
-                key_param_partition_t *p = (key_param_partition_t *)key_arena_allocate(arena, sizeof(key_param_partition_t));
+                key_param_partition_t *p = KEY_ARENA_NEW(arena, key_param_partition_t);
 
                 if (p) {
                     memcpy(p, &g_partition, sizeof(g_partition)); /* Copy the template */
@@ -204,14 +434,10 @@ key_factory(key_arena_t *arena, const char *param_str, size_t param_len, const c
                 case 'm':
                 case 'M':
                     if (!strncasecmp(param_str, "match", 5)) {
-                        key_param_match_t *p = (key_param_match_t *)key_arena_allocate(arena, sizeof(key_param_match_t));
+                        key_param_match_t *p = KEY_ARENA_NEW(arena, key_param_match_t);
 
                         if (p) {
                             memcpy(p, &g_match, sizeof(g_match)); /* Copy the Matcher template */
-                            if (!(arg = key_arena_allocate(arena, arg_len))) {
-                                return NULL;
-                            }
-                            memcpy(arg, delim + 1, arg_len);
                             p->match = arg;
                             p->match_len = arg_len;
                             param = &p->c;
@@ -221,7 +447,7 @@ key_factory(key_arena_t *arena, const char *param_str, size_t param_len, const c
                 case 'p':
                 case 'P':
                     if (!strncasecmp(param_str, "param", 5)) {
-                        key_param_param_t *p = (key_param_param_t *)key_arena_allocate(arena, sizeof(key_param_param_t));
+                        key_param_param_t *p = KEY_ARENA_NEW(arena, key_param_param_t);
 
                         if (p) {
                             memcpy(p, &g_param, sizeof(g_param)); /* Copy the Param template */
@@ -231,56 +457,89 @@ key_factory(key_arena_t *arena, const char *param_str, size_t param_len, const c
                     break;
             }
             break;
-        case 6: /* SUBSTR */
-            if (!strncasecmp(param_str, "substr", 6)) {
-                key_param_substr_t *p = (key_param_substr_t *)key_arena_allocate(arena, sizeof(key_param_substr_t));
+        case 6: /* SUBSTR and PREFER */
+            switch (*param_str) {
+                case 's':
+                case 'S':
+                    if (!strncasecmp(param_str, "substr", 6)) {
+                        key_param_substr_t *p = KEY_ARENA_NEW(arena, key_param_substr_t);
 
-                if (p) {
-                    memcpy(p, &g_substr, sizeof(g_substr)); /* Copy the Substr template */
-                    if (!(arg = key_arena_allocate(arena, arg_len))) {
-                        return NULL;
+                        if (p) {
+                            memcpy(p, &g_substr, sizeof(g_substr)); /* Copy the Substr template */
+                            p->substr = arg;
+                            p->substr_len = arg_len;
+                            param = &p->c;
+                        }
                     }
-                    memcpy(arg, delim + 1, arg_len);
-                    p->substr = arg;
-                    p->substr_len = arg_len;
-                    param = &p->c;
-                }
+                    break;
+                case 'p':
+                case 'P':
+                    if (!strncasecmp(param_str, "prefer", 6)) {
+                        key_param_prefer_t *p = KEY_ARENA_NEW(arena, key_param_prefer_t);
+
+                        if (p) {
+                            const char *coding_start;
+                            const char *coding_next = NULL;
+                            size_t coding_len;
+
+                            memcpy(p, &g_prefer, sizeof(g_prefer)); /* Copy the Prefer template */
+                            coding_start = arg;
+                            while ((coding_len = key_strsep(arg, arg_len, &coding_start, &coding_next, ':')) > 0) {
+                                if (p->num_codings >= HTTP_KEY_MAX_PREFER) {
+                                    return NULL;
+                                }
+                                p->codings[p->num_codings] = coding_start;
+                                p->coding_lens[p->num_codings++] = coding_len;
+                                coding_start = coding_next;
+                            }
+                            if (0 == p->num_codings) {
+                                return NULL;
+                            }
+                            param = &p->c;
+                        }
+                    }
+                    break;
             }
             break;
         default: /* Unknown */
             break;
     }
 
-    /* Dup the header string unto the arena */
     if (param) {
-        char *hdr = arena->last_header;
-
-        param->arena = arena;
-        if (!hdr || strncasecmp(hdr, header, header_len)) {
-            hdr = (char *)key_arena_allocate(arena, header_len + 1); /* We do NULL terminate this header string */
+        param->arg = arg;
+        param->arg_len = arg_len;
+        return key_param_setup(arena, param, header, header_len);
+    }
 
-            if (hdr) {
-                for (int i = 0; i < header_len; ++i) {
-                    hdr[i] = tolower(header[i]);
-                }
-                hdr[header_len] = '\0';
-                arena->last_header = hdr;
-                arena->last_header_len = header_len;
-            } else {
-                /* Memory allocation failed, return fast for now: ToDo: Something better? */
-                return NULL;
-            }
-        }
-        param->header = hdr;
-        param->header_len = header_len;
+    return NULL; /* Could be memory allocation issue, *or* a bad string, we don't really care. */
+}
 
-        return param;
+/* Append a parameter to the end of the parameter list. On a measuring arena, every parameter is in
+   the same scratch memory, so there's no list, just the count. */
+static void
+key_chain_param(key_arena_t *arena, http_key_params_t *params, size_t *num_params, key_common_t *param)
+{
+    if (HTTP_KEY_UNBOUNDED == param->max_len) {
+        ++arena->num_unbounded;
+    } else {
+        arena->bounded_len += param->max_len;
     }
+    if (!*params || arena->scratch) {
+        *params = (http_key_params_t)param;
+    } else {
+        key_common_t *p = (key_common_t *)*params;
 
-    return NULL; /* Could be memory allocation issue, *or* a bad string, we don't really care. */
+        /* Chain into the linked list of parameters */
+        while (p->next) {
+            p = p->next;
+        }
+        p->next = param;
+    }
+    ++*num_params;
 }
 
-/* This is the primary, internal parser, it is not a public interface. */
+/* This is the primary, internal parser, it is not a public interface. The parameters are appended to
+   any already parsed parameters (e.g. from a Vary header). */
 static http_key_parse_status
 key_parse_arena(key_arena_t *arena, const char *key_string, size_t key_string_len, http_key_params_t *params, size_t *num_params)
 {
@@ -291,7 +550,6 @@ key_parse_arena(key_arena_t *arena, const char *key_string, size_t key_string_le
     if (!arena) {
         return HTTP_KEY_PARSE_ERROR;
     }
-    *params = NULL; /* Make sure we start with a fresh entry */
 
     while ((comma_len = key_strsep(key_string, key_string_len, &comma_start, &comma_next, ',')) > 0) {
         key_common_t *param = NULL;
@@ -310,17 +568,7 @@ key_parse_arena(key_arena_t *arena, const char *key_string, size_t key_string_le
                     key_arena_destroy(arena);
                     return HTTP_KEY_PARSE_ERROR;
                 }
-                if (!*params) {
-                    *params = (http_key_params_t)param;
-                } else {
-                    key_common_t *p = (key_common_t *)*params;
-
-                    /* Chain into the linked list of parameters */
-                    while (p->next) {
-                        p = p->next;
-                    }
-                    p->next = param;
-                }
+                key_chain_param(arena, params, num_params, param);
                 /* Reset for next parameter */
                 param = NULL;
             } else {
@@ -337,6 +585,69 @@ key_parse_arena(key_arena_t *arena, const char *key_string, size_t key_string_le
     return HTTP_KEY_PARSE_OK;
 }
 
+/* Parse a Vary header into VALUE parameters. A header listed more than once is only used once, and
+   "*" can never be matched by a cache, so that's an error. */
+static http_key_parse_status
+key_parse_vary_arena(key_arena_t *arena, const char *vary_string, size_t vary_string_len, http_key_params_t *params,
+                     size_t *num_params)
+{
+    const char *comma_start = vary_string;
+    const char *comma_next = NULL;
+    size_t comma_len;
+
+    if (!arena) {
+        return HTTP_KEY_PARSE_ERROR;
+    }
+
+    while ((comma_len = key_strsep(vary_string, vary_string_len, &comma_start, &comma_next, ',')) > 0) {
+        key_common_t *param = (key_common_t *)*params;
+
+        if ((1 == comma_len) && ('*' == *comma_start)) {
+            key_arena_destroy(arena);
+            return HTTP_KEY_PARSE_ERROR;
+        }
+        while (param && ((param->header_len != comma_len) || strncasecmp(param->header, comma_start, comma_len))) {
+            param = param->next;
+        }
+        if (!param) {
+            if (!(param = KEY_ARENA_NEW(arena, key_common_t)) ||
+                !key_param_setup(arena, memcpy(param, &g_value, sizeof(g_value)), comma_start, comma_len)) {
+                key_arena_destroy(arena);
+                return HTTP_KEY_PARSE_ERROR;
+            }
+            key_chain_param(arena, params, num_params, param);
+        }
+        comma_start = comma_next;
+    }
+
+    return HTTP_KEY_PARSE_OK;
+}
+
+/* Parse the Vary header first, and then the Key header into the same parameter list */
+static http_key_parse_status
+key_parse_vary_key(key_arena_t *arena, const char *vary_string, size_t vary_string_len, const char *key_string,
+                   size_t key_string_len, http_key_params_t *params, size_t *num_params)
+{
+    *params = NULL; /* Make sure we start with a fresh entry */
+    *num_params = 0;
+
+    if ((vary_string_len > 0) &&
+        (HTTP_KEY_PARSE_OK != key_parse_vary_arena(arena, vary_string, vary_string_len, params, num_params))) {
+        return HTTP_KEY_PARSE_ERROR;
+    }
+
+    if ((key_string_len > 0) && (HTTP_KEY_PARSE_OK != key_parse_arena(arena, key_string, key_string_len, params, num_params))) {
+        return HTTP_KEY_PARSE_ERROR;
+    }
+
+    /* Without any parameters there's nothing to release the arena later, e.g. for an empty Key */
+    if (!*params && arena) {
+        key_arena_destroy(arena);
+    }
+
+    return HTTP_KEY_PARSE_OK;
+}
+
 /* The two main Key parser entry point. */
 http_key_parse_status
 http_key_parse(void *buffer, size_t buffer_size, const char *key_string, size_t key_string_len, http_key_params_t *params,
@@ -345,19 +656,260 @@ http_key_parse(void *buffer, size_t buffer_size, const char *key_string, size_t
     key_arena_t *arena;
 
     assert(buffer);
-    assert(buffer_size > HTTP_KEY_MIN_ARENA);
+    assert(buffer_size >= HTTP_KEY_MIN_ARENA);
 
     arena = key_arena_create(NULL, buffer, buffer_size);
 
-    return key_parse_arena(arena, key_string, key_string_len, params, num_params);
+    return key_parse_vary_key(arena, NULL, 0, key_string, key_string_len, params, num_params);
+}
+
+/* Setup an arena which only counts the bytes needed, without allocating anything. The result is the
+   size that http_key_parse() etc. needs for the same allocations. */
+static key_arena_t *
+key_measure_arena(key_arena_t *arena, key_param_any_t *scratch)
+{
+    key_arena_create(NULL, arena, SIZE_MAX);
+    arena->scratch = scratch;
+
+    return arena;
+}
+
+static size_t
+key_measured_size(const key_arena_t *arena)
+{
+    return arena->pos > HTTP_KEY_MIN_ARENA ? arena->pos : HTTP_KEY_MIN_ARENA;
+}
+
+size_t
+http_key_parse_size(const char *key_string, size_t key_string_len)
+{
+    key_param_any_t scratch;
+    key_arena_t arena;
+    http_key_params_t params = NULL;
+    size_t num_params = 0;
+
+    key_measure_arena(&arena, &scratch);
+    if (HTTP_KEY_PARSE_OK != key_parse_arena(&arena, key_string, key_string_len, &params, &num_params)) {
+        return 0;
+    }
+
+    return key_measured_size(&arena);
+}
+
+/* Use a precompiled evaluator for this exact Key string, if one is registered */
+static void
+key_use_compiled(http_key_t *key, const char *key_string, size_t key_string_len, http_key_params_t params)
+{
+    for (size_t i = 0; params && (i < key->num_compiled); ++i) {
+        if ((key->compiled[i].key_string_len == key_string_len) &&
+            !memcmp(key->compiled[i].key_string, key_string, key_string_len)) {
+            ((key_common_t *)params)->arena->compiled = key->compiled[i].eval;
+            break;
+        }
+    }
 }
 
 http_key_parse_status
 http_key_parse_alloc(http_key_t *key, const char *key_string, size_t key_string_len, http_key_params_t *params, size_t *num_params)
 {
+    void *buffer;
+
+    assert(key);
+
+    if (!(buffer = key->malloc(key->arena_size))) {
+        return HTTP_KEY_PARSE_ERROR;
+    }
+
+    /* The arena owns the buffer, and frees it when the last reference is released */
+    if (HTTP_KEY_PARSE_OK != key_parse_vary_key(key_arena_create(key, buffer, key->arena_size), NULL, 0, key_string, key_string_len,
+                                                params, num_params)) {
+        return HTTP_KEY_PARSE_ERROR;
+    }
+    key_use_compiled(key, key_string, key_string_len, *params);
+
+    return HTTP_KEY_PARSE_OK;
+}
+
+/* Start a new pool for http_key_parse_many(). This holds a reference to the previous pool, since the
+   Keys on the new pool can use strings interned on the previous ones. */
+static key_arena_t *
+key_pool_create(http_key_t *key, key_arena_t *previous)
+{
+    size_t size = KEY_ARENA_ALIGN(sizeof(key_arena_t)) + (key->arena_size > KEY_POOL_SIZE ? key->arena_size : KEY_POOL_SIZE);
+    key_arena_t *pool = key_arena_create(key, key->malloc(size), size);
+
+    if (pool) {
+        pool->pool = previous;
+    }
+
+    return pool;
+}
+
+http_key_parse_status
+http_key_parse_many(http_key_t *key, const char *const *key_strings, const size_t *key_string_lens, size_t num_keys,
+                    http_key_params_t *params)
+{
+    key_intern_t *intern;
+    key_arena_t *pool = NULL;
+    http_key_parse_status status = HTTP_KEY_PARSE_OK;
+
     assert(key);
 
-    return http_key_parse(key->malloc(key->arena_size), key->arena_size, key_string, key_string_len, params, num_params);
+    if ((intern = key_intern_create(key))) {
+        pool = key_pool_create(key, NULL);
+    }
+
+    for (size_t i = 0; i < num_keys; ++i) {
+        size_t len = key_string_lens ? key_string_lens[i] : strlen(key_strings[i]);
+        key_arena_t *arena;
+        size_t num_params;
+
+        /* Each Key gets as much room as http_key_parse_alloc() would give it, and only uses what it needs */
+        if (pool && ((pool->pos > pool->size) || ((pool->size - pool->pos) < key->arena_size))) {
+            key_arena_t *next = key_pool_create(key, pool);
+
+            if (!next) {
+                key_arena_release(pool);
+            }
+            pool = next;
+        }
+
+        params[i] = NULL;
+        if (!pool) {
+            status = HTTP_KEY_PARSE_ERROR;
+            continue;
+        }
+
+        arena = key_arena_create(NULL, (unsigned char *)pool + pool->pos, key->arena_size);
+        arena->intern = intern;
+        if (HTTP_KEY_PARSE_OK != key_parse_vary_key(arena, NULL, 0, key_strings[i], len, &params[i], &num_params)) {
+            params[i] = NULL;
+            status = HTTP_KEY_PARSE_ERROR;
+        }
+
+        /* The strings interned by this Key stay on the pool, even if it failed to parse */
+        arena->intern = NULL;
+        arena->size = arena->pos;
+        pool->pos += KEY_ARENA_ALIGN(arena->pos);
+        if (params[i]) {
+            arena->pool = pool;
+            atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
+            key_use_compiled(key, key_strings[i], len, params[i]);
+        }
+    }
+
+    if (pool) {
+        key_arena_release(pool);
+    }
+    key_intern_destroy(intern);
+
+    return status;
+}
+
+/* Copy the parameters unto the arena, in the same order and with the same alignments as the parser
+   would. The strings are copied as is, since the parser already lower cased them where needed. */
+static http_key_parse_status
+key_compact_arena(key_arena_t *arena, http_key_params_t params, http_key_params_t *compacted)
+{
+    size_t num_params = 0;
+
+    *compacted = NULL;
+    for (const key_common_t *param = (const key_common_t *)params; param; param = param->next) {
+        const char *arg = NULL;
+        key_common_t *copy;
+
+        /* The argument first, as in key_factory() */
+        if ((param->arg && !(arg = key_arena_string(arena, param->arg, param->arg_len, 0))) ||
+            !(copy = key_arena_allocate(arena, g_layouts[param->type].size, g_layouts[param->type].align))) {
+            return HTTP_KEY_PARSE_ERROR;
+        }
+        memcpy(copy, param, g_layouts[param->type].size);
+        copy->arg = arg;
+        copy->next = NULL;
+
+        /* The type specific strings all point into the argument */
+        switch (param->type) {
+            case KEY_PARAM_MATCH:
+                ((key_param_match_t *)copy)->match = arg + (((const key_param_match_t *)param)->match - param->arg);
+                break;
+            case KEY_PARAM_SUBSTR:
+                ((key_param_substr_t *)copy)->substr = arg + (((const key_param_substr_t *)param)->substr - param->arg);
+                break;
+            case KEY_PARAM_PREFER: {
+                key_param_prefer_t *prefer = (key_param_prefer_t *)copy;
+
+                for (size_t i = 0; i < prefer->num_codings; ++i) {
+                    prefer->codings[i] = arg + (((const key_param_prefer_t *)param)->codings[i] - param->arg);
+                }
+            } break;
+            default:
+                break;
+        }
+
+        if (!key_param_setup(arena, copy, param->header, param->header_len)) {
+            return HTTP_KEY_PARSE_ERROR;
+        }
+        key_chain_param(arena, compacted, &num_params, copy);
+    }
+
+    return HTTP_KEY_PARSE_OK;
+}
+
+size_t
+http_key_compact(http_key_params_t params, void *buffer, size_t buffer_size, http_key_params_t *compacted)
+{
+    key_param_any_t scratch;
+    key_arena_t measure;
+    http_key_params_t copy = NULL;
+    size_t size = 0;
+
+    if (params && (HTTP_KEY_PARSE_OK == key_compact_arena(key_measure_arena(&measure, &scratch), params, &copy))) {
+        size = key_measured_size(&measure);
+        copy = NULL;
+
+        /* The copy is owned by the caller, as with http_key_parse(), and starts out without a memo or plan */
+        if (buffer && (buffer_size >= size)) {
+            key_arena_t *arena = key_arena_create(NULL, buffer, size);
+
+            arena->compiled = ((const key_common_t *)params)->arena->compiled;
+            if (HTTP_KEY_PARSE_OK != key_compact_arena(arena, params, &copy)) {
+                copy = NULL;
+                size = 0;
+            }
+        }
+    }
+    if (compacted) {
+        *compacted = copy;
+    }
+
+    return size;
+}
+
+http_key_parse_status
+http_key_parse_vary(void *buffer, size_t buffer_size, const char *vary_string, size_t vary_string_len, const char *key_string,
+                    size_t key_string_len, http_key_params_t *params, size_t *num_params)
+{
+    assert(buffer);
+    assert(buffer_size >= HTTP_KEY_MIN_ARENA);
+
+    return key_parse_vary_key(key_arena_create(NULL, buffer, buffer_size), vary_string, vary_string_len, key_string,
+                              key_string_len, params, num_params);
+}
+
+http_key_parse_status
+http_key_parse_vary_alloc(http_key_t *key, const char *vary_string, size_t vary_string_len, const char *key_string,
+                          size_t key_string_len, http_key_params_t *params, size_t *num_params)
+{
+    void *buffer;
+
+    assert(key);
+
+    if (!(buffer = key->malloc(key->arena_size))) {
+        return HTTP_KEY_PARSE_ERROR;
+    }
+
+    return key_parse_vary_key(key_arena_create(key, buffer, key->arena_size), vary_string, vary_string_len, key_string,
+                              key_string_len, params, num_params);
 }
 
 /*
@@ -0,0 +1,224 @@
+/** @file
+
+    The optimized representation of hot Keys. A parsed Key is a linked list
+    of parameters, which is cheap to build and good enough for the many Keys
+    that are only evaluated a few times. Once a Key has been evaluated often
+    enough, it's promoted to a plan: the parameters are flattened into an
+    array, each distinct header is fetched once (even when not adjacent in
+    the Key), and the output space reserved for the trailing parameters is
+    precomputed per step. Steps that keep failing are evaluated ahead of
+    the others, such that aborted evaluations are cheap.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <assert.h>
+
+#include "include/memo.h"
+#include "include/normalize.h"
+#include "include/plan.h"
+
+#if HAVE_STRINGS_H
+#include <strings.h>
+#endif
+
+/* Find the header in the plan, or add it. Returns KEY_PLAN_MAX_HEADERS if there's no more room */
+static size_t
+key_plan_header(key_plan_t *plan, key_common_t *param)
+{
+    size_t i;
+
+    for (i = 0; i < plan->num_headers; ++i) {
+        key_plan_header_t *h = &plan->headers[i];
+
+        if ((h->header_len == param->header_len) &&
+            ((h->header == param->header) || !strncasecmp(h->header, param->header, param->header_len))) {
+            return i;
+        }
+    }
+
+    if (i < KEY_PLAN_MAX_HEADERS) {
+        plan->headers[i].header = param->header;
+        plan->headers[i].header_len = param->header_len;
+        ++plan->num_headers;
+    }
+
+    return i;
+}
+
+key_plan_t *
+key_plan_create(http_key_t *key, key_common_t *params)
+{
+    key_arena_t *arena = params->arena;
+    size_t num_steps = 0, reserved, size;
+    key_plan_step_t *step;
+    key_plan_t *plan;
+
+    for (key_common_t *param = params; param; param = param->next) {
+        ++num_steps;
+    }
+    if (!num_steps) {
+        return NULL;
+    }
+
+    /* The plan goes into the spare room of the arena if there is any, and goes away with it. Otherwise
+       it's only allocated for an arena the library owns, which frees the plan on the last release; a Key
+       parsed into a caller buffer with http_key_parse() might never be released. */
+    size = sizeof(key_plan_t) + num_steps * sizeof(key_plan_step_t);
+    if ((plan = key_arena_allocate(arena, size, _Alignof(key_plan_t)))) {
+        plan->free = NULL;
+    } else if ((arena->key || arena->pool) && (plan = key->malloc(size))) {
+        plan->free = key->free;
+    } else {
+        return NULL;
+    }
+
+    plan->bounded_len = params->arena->bounded_len;
+    plan->num_headers = 0;
+    plan->num_steps = num_steps;
+    atomic_init(&plan->probe, 0);
+
+    reserved = plan->bounded_len;
+    step = plan->steps;
+    for (key_common_t *param = params; param; param = param->next, ++step) {
+        if (KEY_PLAN_MAX_HEADERS == (step->header = key_plan_header(plan, param))) {
+            key_plan_destroy(plan);
+            return NULL;
+        }
+        step->evaluator = param->evaluator;
+        step->param = param;
+        step->unbounded = (HTTP_KEY_UNBOUNDED == param->max_len);
+        if (!step->unbounded) {
+            reserved -= param->max_len;
+        }
+        step->reserved = reserved;
+        atomic_init(&step->failures, 0);
+    }
+
+    return plan;
+}
+
+void
+key_plan_destroy(key_plan_t *plan)
+{
+    if (plan && plan->free) {
+        plan->free(plan);
+    }
+}
+
+/* Count a failure of the step, and have it evaluated ahead once it's failed often enough. Only cheap
+   steps qualify, since their output is kept on the stack until it's copied into place. */
+static void
+key_plan_failed(key_plan_t *plan, key_plan_step_t *step)
+{
+    size_t i = step - plan->steps;
+
+    if (!step->unbounded && (step->param->max_len <= KEY_PLAN_PROBE_LEN) && (i < KEY_PLAN_MAX_PROBES) &&
+        (KEY_PLAN_PROBE_FAILURES == atomic_fetch_add_explicit(&step->failures, 1, memory_order_relaxed) + 1)) {
+        atomic_fetch_or_explicit(&plan->probe, (uint64_t)1 << i, memory_order_relaxed);
+    }
+}
+
+/* This produces exactly the same output as key_eval_params(). The steps that have failed before are
+   evaluated first, in declared order, and the evaluation is aborted as soon as one of them fails. The
+   output of those that succeed is kept aside, and copied into place when their turn comes. */
+size_t
+key_plan_eval(key_plan_t *plan, http_key_t *key, void *header_data, char *buf, size_t buf_size)
+{
+    const char *values[KEY_PLAN_MAX_HEADERS];
+    size_t lens[KEY_PLAN_MAX_HEADERS];
+    key_plan_step_t *step = plan->steps;
+    key_plan_step_t *end = step + plan->num_steps;
+    size_t pos = 0;
+    size_t used = 0;
+    key_scratch_t scratch;
+    char probed[KEY_PLAN_MAX_PROBES][KEY_PLAN_PROBE_LEN];
+    size_t probed_lens[KEY_PLAN_MAX_PROBES];
+    uint64_t probe = atomic_load_explicit(&plan->probe, memory_order_relaxed);
+
+    /* The plan is only for the common case; a buffer this small takes the checked path */
+    if (plan->bounded_len > buf_size) {
+        return key_eval_params(key, header_data, step->param, buf, buf_size);
+    }
+
+    scratch.pos = 0;
+    for (size_t i = 0; i < plan->num_headers; ++i) {
+        values[i] = key_fetch_header(key, header_data, plan->headers[i].header, plan->headers[i].header_len, &lens[i], &scratch);
+        if (!values[i]) {
+            lens[i] = 0;
+        } else if (values[i] == key_budget_exceeded) {
+            return 0;
+        }
+    }
+
+    /* The bytes budget is counted in declared order, which evaluating ahead would change */
+    if (key->budget.max_bytes) {
+        probe = 0;
+    }
+    for (uint64_t bits = probe; bits; bits &= bits - 1) {
+        size_t i = __builtin_ctzll(bits);
+        key_plan_step_t *ahead = &plan->steps[i];
+
+        if ((probed_lens[i] = lens[ahead->header]) > 0) {
+            if (!(probed_lens[i] = ahead->evaluator(ahead->param, values[ahead->header], probed_lens[i], probed[i], 0,
+                                                    KEY_PLAN_PROBE_LEN))) {
+                key_plan_failed(plan, ahead);
+                return 0;
+            }
+        }
+    }
+
+    for (; step < end; ++step) {
+        size_t limit = step->unbounded ? buf_size - step->reserved : buf_size;
+        size_t len = lens[step->header];
+        size_t i = step - plan->steps;
+
+        if (!key_budget_ok(key, values[step->header], len, &used)) {
+            return 0;
+        }
+        if (len > 0) {
+            if ((i < KEY_PLAN_MAX_PROBES) && ((probe >> i) & 1)) {
+                /* Evaluated ahead, and bounded, so there's room for it */
+                memcpy(buf + pos, probed[i], probed_lens[i]);
+                len = probed_lens[i];
+            } else if ((pos >= limit) || !(len = step->evaluator(step->param, values[step->header], len, buf, pos, limit))) {
+                key_plan_failed(plan, step);
+                return 0; /* Error. We choose to abort the entire evaluation, as per the RFC. */
+            }
+            pos += len;
+        } else if ((limit - pos) >= 4) {
+            memcpy(buf + pos, "none", 4);
+            pos += 4;
+        } else {
+            return 0;
+        }
+    }
+
+    return pos;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
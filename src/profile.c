@@ -0,0 +1,251 @@
+/** @file
+
+    Sampled profile of the parameter evaluations. A sampled evaluation runs key_eval_from() on the
+    parameter list, whose hooks time each header lookup and each evaluator, into a log-linear
+    histogram for the parameter
+    type and header, such that the one expensive parameter of a long Key stands out. Everything
+    else about the evaluation, the budget and the normalization included, is as key_eval_params().
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <assert.h>
+
+#include "include/profile.h"
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif
+
+#if HAVE_STRINGS_H
+#include <strings.h>
+#endif
+
+_Thread_local key_profile_countdown_t key_profile_countdowns[KEY_PROFILE_COUNTDOWNS];
+
+/* The percentiles of HTTP_KEY_PROFILE_QUANTILES, in tenths of a percent */
+static const unsigned int g_quantiles[HTTP_KEY_PROFILE_QUANTILES] = {500, 900, 990, 999};
+
+int
+http_key_profile(http_key_t *key, size_t sample_rate)
+{
+    assert(key);
+
+    if (key->profile.data) {
+        key->free(key->profile.data);
+        key->profile.data = NULL;
+    }
+    key->profile.rate = 0;
+
+    if (sample_rate > 0) {
+        if (!(key->profile.data = key->malloc(sizeof(key_profile_t)))) {
+            return 1;
+        }
+        memset(key->profile.data, 0, sizeof(key_profile_t));
+        key->profile.rate = sample_rate;
+    }
+
+    return 0;
+}
+
+/* The bucket for a time, as a 3 bit mantissa of which the top bit is implied */
+static inline size_t
+key_profile_bucket(uint64_t ns)
+{
+    unsigned int exp;
+
+    if (ns < 8) {
+        return (size_t)ns;
+    }
+    exp = 63 - __builtin_clzll(ns);
+    if (exp > 40) {
+        return KEY_PROFILE_BUCKETS - 1;
+    }
+
+    return 8 + 4 * (exp - 3) + ((ns >> (exp - 2)) & 3);
+}
+
+/* The highest time in a bucket */
+static inline uint64_t
+key_profile_bucket_max(size_t bucket)
+{
+    unsigned int exp;
+
+    if (bucket < 8) {
+        return bucket;
+    }
+    exp = 3 + (bucket - 8) / 4;
+
+    return (((uint64_t)(4 + (bucket - 8) % 4) + 1) << (exp - 2)) - 1;
+}
+
+static inline void
+key_profile_record(key_profile_histogram_t *histogram, uint64_t ns)
+{
+    __atomic_fetch_add(&histogram->counts[key_profile_bucket(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->samples, 1, __ATOMIC_RELAXED);
+}
+
+/* The entry for the type and header of the parameter, claimed if it's the first sample. Returns NULL
+   if the table is full. */
+key_profile_entry_t *
+key_profile_entry(key_profile_t *profile, const key_common_t *param)
+{
+    uint64_t id = 0xcbf29ce484222325ULL ^ (uint64_t)param->type;
+
+    for (size_t i = 0; i < param->header_len; ++i) {
+        id = (id ^ (unsigned char)(param->header[i] | 0x20)) * 0x100000001b3ULL;
+    }
+    id |= 1;
+
+    for (size_t i = 0; i < KEY_PROFILE_ENTRIES; ++i) {
+        key_profile_entry_t *entry = &profile->entries[(id + i) & (KEY_PROFILE_ENTRIES - 1)];
+        uint64_t current = __atomic_load_n(&entry->id, __ATOMIC_RELAXED);
+
+        if (current == id) {
+            return entry;
+        }
+        if ((0 == current) && __atomic_compare_exchange_n(&entry->id, &current, id, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            entry->type = param->debug_name;
+            entry->header_len = (param->header_len < HTTP_KEY_PROFILE_MAX_HEADER) ? param->header_len : HTTP_KEY_PROFILE_MAX_HEADER;
+            memcpy(entry->header, param->header, entry->header_len);
+            __atomic_store_n(&entry->ready, 1, __ATOMIC_RELEASE);
+            return entry;
+        }
+        if (current == id) {
+            return entry; /* Claimed by another thread in the meantime */
+        }
+    }
+
+    return NULL;
+}
+
+static size_t
+key_profile_tokens(const char *value, size_t value_len)
+{
+    const char *end = value + value_len;
+    size_t tokens = 1;
+
+    while ((value = memchr(value, ',', end - value))) {
+        ++tokens;
+        ++value;
+    }
+
+    return tokens;
+}
+
+void
+key_profile_fetched(key_profile_entry_t *entry, uint64_t start)
+{
+    key_profile_record(&entry->fetch, key_profile_now() - start);
+}
+
+void
+key_profile_evaluated(key_profile_entry_t *entry, uint64_t start, const char *value, size_t value_len)
+{
+    if (!value) {
+        key_profile_record(&entry->eval, 0);
+        return;
+    }
+    key_profile_record(&entry->eval, key_profile_now() - start);
+    __atomic_fetch_add(&entry->bytes, value_len, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->tokens, key_profile_tokens(value, value_len), __ATOMIC_RELAXED);
+}
+
+static void
+key_profile_quantiles(const key_profile_histogram_t *histogram, size_t samples, uint64_t *ns)
+{
+    size_t bucket = 0, count = 0;
+
+    for (size_t q = 0; q < HTTP_KEY_PROFILE_QUANTILES; ++q) {
+        /* The rank of the quantile, rounded up */
+        size_t rank = (samples * g_quantiles[q] + 999) / 1000;
+
+        if (0 == samples) {
+            ns[q] = 0;
+            continue;
+        }
+        while ((bucket < KEY_PROFILE_BUCKETS - 1) && (count + histogram->counts[bucket] < rank)) {
+            count += histogram->counts[bucket++];
+        }
+        ns[q] = key_profile_bucket_max(bucket);
+    }
+}
+
+static void
+key_profile_fill(const key_profile_entry_t *entry, http_key_profile_stats_t *stats)
+{
+    stats->type = entry->type;
+    stats->header = entry->header;
+    stats->header_len = entry->header_len;
+    stats->samples = __atomic_load_n(&entry->eval.samples, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&entry->bytes, __ATOMIC_RELAXED);
+    stats->tokens = __atomic_load_n(&entry->tokens, __ATOMIC_RELAXED);
+    key_profile_quantiles(&entry->eval, stats->samples, stats->eval_ns);
+    stats->fetches = __atomic_load_n(&entry->fetch.samples, __ATOMIC_RELAXED);
+    key_profile_quantiles(&entry->fetch, stats->fetches, stats->fetch_ns);
+}
+
+size_t
+http_key_profile_stats(http_key_t *key, http_key_profile_stats_t *stats, size_t max_stats)
+{
+    key_profile_t *profile = (key_profile_t *)key->profile.data;
+    size_t num = 0;
+
+    for (size_t i = 0; profile && (i < KEY_PROFILE_ENTRIES) && (num < max_stats); ++i) {
+        if (__atomic_load_n(&profile->entries[i].ready, __ATOMIC_ACQUIRE)) {
+            key_profile_fill(&profile->entries[i], &stats[num++]);
+        }
+    }
+
+    return num;
+}
+
+int
+http_key_profile_param(http_key_t *key, http_key_params_t params, http_key_profile_stats_t *stats)
+{
+    key_common_t *param = (key_common_t *)params;
+    key_profile_t *profile = (key_profile_t *)key->profile.data;
+    size_t header_len;
+
+    assert(param);
+
+    header_len = (param->header_len < HTTP_KEY_PROFILE_MAX_HEADER) ? param->header_len : HTTP_KEY_PROFILE_MAX_HEADER;
+    for (size_t i = 0; profile && (i < KEY_PROFILE_ENTRIES); ++i) {
+        key_profile_entry_t *entry = &profile->entries[i];
+
+        if (__atomic_load_n(&entry->ready, __ATOMIC_ACQUIRE) && (entry->type == param->debug_name) &&
+            (entry->header_len == header_len) && !strncasecmp(entry->header, param->header, header_len)) {
+            key_profile_fill(entry, stats);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
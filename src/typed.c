@@ -0,0 +1,295 @@
+/** @file
+
+    Typed evaluation of a Key, where each parameter produces a typed result
+    rather than ASCII output, and a compact binary encoding of those results.
+    For Keys with many MATCH / SUBSTR parameters, the encoded cache key is a
+    fraction of the size of the ASCII output.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <assert.h>
+
+#include "include/evaluators.h"
+#include "include/normalize.h"
+
+/* The 2 bit tags of the binary encoding */
+#define KEY_TAG_NONE 0
+#define KEY_TAG_FALSE 1
+#define KEY_TAG_TRUE 2
+#define KEY_TAG_VALUE 3
+
+static http_key_result_type
+key_result_type(const key_common_t *param)
+{
+    switch (param->type) {
+        case KEY_PARAM_MATCH:
+        case KEY_PARAM_SUBSTR:
+            return HTTP_KEY_RESULT_BOOL;
+        case KEY_PARAM_DIV:
+        case KEY_PARAM_PARTITION:
+        case KEY_PARAM_PREFER:
+            return HTTP_KEY_RESULT_UINT;
+        default:
+            return HTTP_KEY_RESULT_BYTES;
+    }
+}
+
+size_t
+http_key_eval_typed(http_key_t *key, void *header_data, http_key_params_t params, http_key_result_t *results,
+                    size_t num_results, char *buf, size_t buf_size)
+{
+    key_common_t *param = (key_common_t *)params;
+    const char *last_header = NULL;
+    size_t last_header_len = 0;
+    const char *value = NULL;
+    size_t val_len = 0;
+    size_t num = 0, pos = 0;
+    size_t used = 0;
+    key_scratch_t scratch;
+
+    scratch.pos = 0;
+    while (param) {
+        http_key_result_t *res;
+
+        if (num == num_results) {
+            return 0;
+        }
+        res = &results[num++];
+        if ((last_header_len != param->header_len) || (last_header != param->header)) {
+            value = key_fetch_header(key, header_data, param->header, param->header_len, &val_len, &scratch);
+            last_header = param->header;
+            last_header_len = param->header_len;
+        }
+        if (!key_budget_ok(key, value, val_len, &used)) {
+            return 0;
+        }
+
+        res->type = (value && (val_len > 0)) ? key_result_type(param) : HTTP_KEY_RESULT_NONE;
+        res->value = 0;
+        res->bytes = NULL;
+        res->len = 0;
+
+        switch (res->type) {
+            case HTTP_KEY_RESULT_NONE:
+                break;
+            case HTTP_KEY_RESULT_BYTES:
+                /* The whole value needs no evaluator; the others produce their output straight into buf */
+                if (KEY_PARAM_VALUE == param->type) {
+                    if ((buf_size - pos) < val_len) {
+                        return 0;
+                    }
+                    memcpy(buf + pos, value, val_len);
+                    res->len = val_len;
+                } else if ((pos >= buf_size) || !(res->len = param->evaluator(param, value, val_len, buf, pos, buf_size))) {
+                    return 0;
+                }
+                res->bytes = buf + pos;
+                pos += res->len;
+                break;
+            default: {
+                /* Bounded parameters, which produce at most 20 digits */
+                char digits[24];
+                size_t len = param->evaluator(param, value, val_len, digits, 0, sizeof(digits));
+
+                if (!len) {
+                    return 0;
+                }
+                for (size_t i = 0; i < len; ++i) {
+                    res->value = res->value * 10 + digits[i] - '0';
+                }
+            } break;
+        }
+        param = param->next;
+    }
+
+    return num;
+}
+
+/* The constant results, laid out such that "none0" and "01" are contiguous as well */
+static const char g_iov_constants[] = "none01";
+
+/* Append a segment, merging it into the previous segment when the bytes are contiguous */
+static inline int
+key_iov_add(struct iovec *iov, size_t iov_len, size_t *num, const char *bytes, size_t len)
+{
+    if ((*num > 0) && ((const char *)iov[*num - 1].iov_base + iov[*num - 1].iov_len == bytes)) {
+        iov[*num - 1].iov_len += len;
+    } else if (*num < iov_len) {
+        iov[*num].iov_base = (void *)bytes;
+        iov[(*num)++].iov_len = len;
+    } else {
+        return 0;
+    }
+
+    return 1;
+}
+
+size_t
+http_key_eval_iov(http_key_t *key, void *header_data, http_key_params_t params, struct iovec *iov, size_t iov_len,
+                  char *buf, size_t buf_size)
+{
+    key_common_t *param = (key_common_t *)params;
+    const char *last_header = NULL;
+    size_t last_header_len = 0;
+    const char *value = NULL;
+    size_t val_len = 0;
+    size_t num = 0, pos = 0;
+    size_t used = 0;
+    key_scratch_t scratch;
+
+    scratch.pos = 0;
+    while (param) {
+        const char *bytes;
+        size_t len;
+
+        if ((last_header_len != param->header_len) || (last_header != param->header)) {
+            value = key_fetch_header(key, header_data, param->header, param->header_len, &val_len, &scratch);
+            last_header = param->header;
+            last_header_len = param->header_len;
+        }
+        if (!key_budget_ok(key, value, val_len, &used)) {
+            return 0;
+        }
+
+        if (!value || (0 == val_len)) {
+            bytes = g_iov_constants;
+            len = 4;
+        } else if (HTTP_KEY_UNBOUNDED != param->max_len) {
+            /* Bounded parameters, which produce at most 20 digits */
+            char digits[24];
+
+            if (!(len = param->evaluator(param, value, val_len, digits, 0, sizeof(digits)))) {
+                return 0;
+            } else if ((KEY_PARAM_MATCH == param->type) || (KEY_PARAM_SUBSTR == param->type)) {
+                bytes = g_iov_constants + 4 + (digits[0] - '0');
+            } else if ((buf_size - pos) < len) {
+                return 0;
+            } else {
+                memcpy(buf + pos, digits, len);
+                bytes = buf + pos;
+                pos += len;
+            }
+        } else if (KEY_PARAM_VALUE == param->type) {
+            /* The length prefix goes to buf, the value itself is referenced unless it was normalized
+               into the scratch area, which does not outlive this call. */
+            if (!(len = key_print_uint(val_len, buf + pos, buf_size - pos)) || ((buf_size - pos - len) < 1)) {
+                return 0;
+            }
+            buf[pos + len++] = ':';
+            if (!key_iov_add(iov, iov_len, &num, buf + pos, len)) {
+                return 0;
+            }
+            pos += len;
+            if (((uintptr_t)value - (uintptr_t)scratch.buf) < sizeof(scratch.buf)) {
+                if ((buf_size - pos) < val_len) {
+                    return 0;
+                }
+                memcpy(buf + pos, value, val_len);
+                value = buf + pos;
+                pos += val_len;
+            }
+            bytes = value;
+            len = val_len;
+        } else if ((pos >= buf_size) || !(len = param->evaluator(param, value, val_len, buf, pos, buf_size))) {
+            return 0;
+        } else {
+            bytes = buf + pos;
+            pos += len;
+        }
+
+        if (!key_iov_add(iov, iov_len, &num, bytes, len)) {
+            return 0;
+        }
+        param = param->next;
+    }
+
+    return num;
+}
+
+/* LEB128 style varint, returns 0 if it does not fit */
+static size_t
+key_encode_varint(uint64_t value, unsigned char *buf, size_t buf_size)
+{
+    size_t len = 0;
+
+    do {
+        if (len == buf_size) {
+            return 0;
+        }
+        buf[len++] = (value & 0x7f) | ((value > 0x7f) ? 0x80 : 0);
+        value >>= 7;
+    } while (value);
+
+    return len;
+}
+
+size_t
+http_key_encode(const http_key_result_t *results, size_t num_results, unsigned char *buf, size_t buf_size)
+{
+    size_t pos = (num_results + 3) / 4;
+
+    if (pos > buf_size) {
+        return 0;
+    }
+    memset(buf, 0, pos);
+
+    for (size_t i = 0; i < num_results; ++i) {
+        const http_key_result_t *res = &results[i];
+        unsigned int tag;
+        size_t len;
+
+        switch (res->type) {
+            case HTTP_KEY_RESULT_NONE:
+                tag = KEY_TAG_NONE;
+                break;
+            case HTTP_KEY_RESULT_BOOL:
+                tag = res->value ? KEY_TAG_TRUE : KEY_TAG_FALSE;
+                break;
+            case HTTP_KEY_RESULT_UINT:
+                tag = KEY_TAG_VALUE;
+                if (!(len = key_encode_varint(res->value, buf + pos, buf_size - pos))) {
+                    return 0;
+                }
+                pos += len;
+                break;
+            default:
+                tag = KEY_TAG_VALUE;
+                if (!(len = key_encode_varint(res->len, buf + pos, buf_size - pos)) || ((buf_size - pos - len) < res->len)) {
+                    return 0;
+                }
+                memcpy(buf + pos + len, res->bytes, res->len);
+                pos += len + res->len;
+                break;
+        }
+        buf[i / 4] |= tag << ((i % 4) * 2);
+    }
+
+    return pos;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
@@ -0,0 +1,34 @@
+#! /usr/bin/env bash
+#
+# Test cases for the static variant analysis
+#
+#  Licensed to the Apache Software Foundation (ASF) under one
+#  or more contributor license agreements.  See the NOTICE file
+#  distributed with this work for additional information
+#  regarding copyright ownership.  The ASF licenses this file
+#  to you under the Apache License, Version 2.0 (the
+#  "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+set -e # exit on error
+
+CMD="../cmd/key-cmd -a -t"
+
+[ "3,0" != $($CMD "Abc;substr=bennet") ] && exit -1
+[ "9,0" != $($CMD "Abc;substr=bennet,Baz;match=charlie") ] && exit -1
+[ "5,0" != $($CMD "Accept-Encoding;prefer=br:gzip:deflate") ] && exit -1
+[ "15,0" != $($CMD "Accept-Encoding;prefer=br:gzip:deflate,Baz;match=charlie") ] && exit -1
+
+# DIV can produce any number of variants
+[ "unbounded,1" != $($CMD "Bar;div=5") ] && exit -1
+[ "unbounded,1" != $($CMD "Bar;div=5,Baz;match=charlie") ] && exit -1
+
+exit 0
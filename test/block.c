@@ -0,0 +1,200 @@
+/** @file
+
+    Test for http_key_block_index() and http_key_block_get(). The Keys evaluated on an indexed raw
+    header block must produce exactly what they do with a plain lookup of the same headers, for
+    names and values on either side of the 16 byte chunks of the scan, repeated headers, and blocks
+    that arrive a few bytes at a time.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include "common.h"
+
+#define MAX_HEADERS 8
+
+static const char *g_keys[] = {
+    "Accept-Encoding;prefer=br:gzip, User-Agent;substr=Mobile",
+    "X-A-Rather-Long-Header-Name;match=value:with:colons, X-Num;div=10",
+    "Accept-Encoding;substr=deflate, Cookie;substr=session, X-Num;match=42",
+};
+
+static const char *g_vary = "Accept-Language";
+
+/* The headers of a block, already joined, for the plain lookup */
+typedef struct {
+    const char *block;
+    const char *expected[2 * MAX_HEADERS + 1];
+} block_test_t;
+
+static const block_test_t g_blocks[] = {
+    {"GET / HTTP/1.1\r\nHost: example.com\r\nAccept-Encoding: gzip, br\r\nUser-Agent: Mozilla/5.0 Mobile\r\n\r\n",
+     {"Accept-Encoding", "gzip, br", "User-Agent", "Mozilla/5.0 Mobile"}},
+    {"GET / HTTP/1.1\nACCEPT-encoding:gzip\nX-Num:   42  \t\nAccept-Language: en\n\n",
+     {"Accept-Encoding", "gzip", "X-Num", "42", "Accept-Language", "en"}},
+    {"GET / HTTP/1.1\r\nX-A-Rather-Long-Header-Name: value:with:colons\r\nX-A-Rather-Long-Header-Nam: no\r\n"
+     "X-A-Rather-Long-Header-Name-Too: no\r\nX-Num: 1234\r\n\r\n",
+     {"X-A-Rather-Long-Header-Name", "value:with:colons", "X-Num", "1234"}},
+    {"GET / HTTP/1.1\r\nAccept-Encoding: br\r\nCookie: a=1\r\naccept-encoding: deflate\r\nCookie: session=2\r\n"
+     "Accept-Encoding:\r\nAccept-Encoding: gzip\r\n\r\n",
+     {"Accept-Encoding", "br, deflate, , gzip", "Cookie", "a=1, session=2"}},
+    {"GET / HTTP/1.1\r\nX Num: 42\r\nX-Num : 42\r\n: 42\r\nUser-Agent:\r\nCookie:   \r\n"
+     "X-Cookie-Is-Not-The-Cookie: session\r\n\r\n",
+     {"User-Agent", "", "Cookie", ""}},
+    {"GET / HTTP/1.1\r\n\r\n", {NULL}},
+};
+
+static int
+check_block(http_key_t *key, http_key_block_t block, const http_key_params_t *params, size_t b)
+{
+    http_key_t plain = *key;
+    int failures = 0;
+
+    plain.get_header = &test_get_header;
+    for (size_t k = 0; k < sizeof(g_keys) / sizeof(g_keys[0]); ++k) {
+        char out[128], expected[128];
+        size_t len = http_key_eval(key, block, params[k], out, sizeof(out));
+        size_t expected_len = http_key_eval(&plain, (void *)g_blocks[b].expected, params[k], expected, sizeof(expected));
+
+        if ((len != expected_len) || memcmp(out, expected, len)) {
+            fprintf(stderr, "FAIL: %s: \"%.*s\" != \"%.*s\" (block %zu)\n", g_keys[k], (int)len, out, (int)expected_len, expected,
+                    b);
+            ++failures;
+        }
+    }
+
+    return failures;
+}
+
+int
+main(int argc, const char *argv[])
+{
+    http_key_params_t params[sizeof(g_keys) / sizeof(g_keys[0])];
+    http_key_t key;
+    http_key_block_t block;
+    int failures = 0;
+
+    http_key_init(&key, &http_key_block_get, &test_malloc, &test_free, 1024, NULL, NULL, NULL);
+    for (size_t k = 0; k < sizeof(g_keys) / sizeof(g_keys[0]); ++k) {
+        size_t num_params;
+
+        if (HTTP_KEY_PARSE_OK != http_key_parse_vary_alloc(&key, g_vary, strlen(g_vary), g_keys[k], strlen(g_keys[k]), &params[k],
+                                                           &num_params)) {
+            fprintf(stderr, "FAIL: %s: failed to parse\n", g_keys[k]);
+            return 1;
+        }
+    }
+    block = http_key_block_create(&key, params, sizeof(g_keys) / sizeof(g_keys[0]));
+
+    for (size_t b = 0; b < sizeof(g_blocks) / sizeof(g_blocks[0]); ++b) {
+        const char *data = g_blocks[b].block;
+        size_t len = strlen(data);
+
+        /* At every offset, such that the lines straddle the chunks of the scan in every way */
+        for (size_t offset = 0; offset < 16; ++offset) {
+            char *copy = malloc(offset + len + 32);
+
+            memset(copy, ':', offset + len + 32);
+            memcpy(copy + offset, data, len);
+            memcpy(copy + offset + len, "\nX-Num: 1\r\n\r\n", 13);
+            if (http_key_block_index(block, copy + offset, len, 0) != len) {
+                fprintf(stderr, "FAIL: block %zu: not indexed at offset %zu\n", b, offset);
+                ++failures;
+            } else {
+                failures += check_block(&key, block, params, b);
+            }
+            free(copy);
+        }
+
+        /* Incomplete until the empty line is in, but complete at the end of the data */
+        for (size_t partial = 0; partial < len - 1; ++partial) {
+            if (http_key_block_index(block, data, partial, 0)) {
+                fprintf(stderr, "FAIL: block %zu: indexed with only %zu of %zu bytes\n", b, partial, len);
+                ++failures;
+                break;
+            }
+        }
+        if (http_key_block_index(block, data, len - 2, 1) != len - 2) {
+            fprintf(stderr, "FAIL: block %zu: not indexed at the end of the data\n", b);
+            ++failures;
+        } else {
+            failures += check_block(&key, block, params, b);
+        }
+    }
+
+    /* Concatenated blocks, with the empty lines before the next block skipped */
+    {
+        static const char *data = "HTTP/1.1 200 OK\r\nX-Num: 1\r\n\r\n\r\n\r\nHTTP/1.1 200 OK\r\nX-Num: 2\r\n\r\n\r\n";
+        size_t len = strlen(data), pos = 0, consumed, blocks = 0;
+        size_t value_len;
+
+        while ((consumed = http_key_block_index(block, data + pos, len - pos, 1)) > 0) {
+            const char *value = http_key_block_get(block, "x-num", 5, &value_len);
+
+            if (http_key_block_lines(block) && (!value || (value_len != 1) || (value[0] != '1' + (char)blocks++))) {
+                fprintf(stderr, "FAIL: concatenated block %zu\n", blocks);
+                ++failures;
+            }
+            pos += consumed;
+        }
+        if ((blocks != 2) || (pos != len) || http_key_block_lines(block)) {
+            fprintf(stderr, "FAIL: %zu concatenated blocks, %zu of %zu bytes\n", blocks, pos, len);
+            ++failures;
+        }
+        if (http_key_block_get(block, "Host", 4, &value_len)) {
+            fprintf(stderr, "FAIL: a header not used by the Keys was indexed\n");
+            ++failures;
+        }
+    }
+
+    /* More repeated lines than the index starts out with room for */
+    {
+        char data[1024], expected[1024];
+        size_t len = 0, expected_len = 0, value_len;
+        const char *value;
+
+        for (int i = 0; i < 40; ++i) {
+            len += snprintf(data + len, sizeof(data) - len, "Cookie: c%d\r\nHost: h%d\r\n", i, i);
+            expected_len += snprintf(expected + expected_len, sizeof(expected) - expected_len, "%sc%d", i ? ", " : "", i);
+        }
+        len += snprintf(data + len, sizeof(data) - len, "\r\n");
+        value = (http_key_block_index(block, data, len, 0) == len) ? http_key_block_get(block, "Cookie", 6, &value_len) : NULL;
+        if (!value || (value_len != expected_len) || memcmp(value, expected, value_len) || (http_key_block_lines(block) != 80)) {
+            fprintf(stderr, "FAIL: 40 Cookie lines: \"%.*s\"\n", value ? (int)value_len : 0, value ? value : "");
+            ++failures;
+        }
+    }
+
+    http_key_block_destroy(block);
+    for (size_t k = 0; k < sizeof(g_keys) / sizeof(g_keys[0]); ++k) {
+        http_key_release(params[k]);
+    }
+    failures += test_check_frees();
+
+    return failures ? 1 : 0;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
@@ -0,0 +1,54 @@
+#! /usr/bin/env bash
+#
+# Test cases for the per evaluation work budget
+#
+#  Licensed to the Apache Software Foundation (ASF) under one
+#  or more contributor license agreements.  See the NOTICE file
+#  distributed with this work for additional information
+#  regarding copyright ownership.  The ASF licenses this file
+#  to you under the Apache License, Version 2.0 (the
+#  "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+set -e # exit on error
+
+CMD="../cmd/key-cmd -t"
+
+# Within the budget, nothing changes
+[ "1,1" != "$($CMD -l 16,4,64 -H "Accept-Encoding: gzip, br" "Accept-Encoding;substr=br")" ] && exit -1
+[ "1,1" != "$($CMD -l 0,2 -H "Accept-Encoding: a, br" "Accept-Encoding;substr=br")" ] && exit -1
+
+# Each limit on its own fails the evaluation
+[ ",0" != "$($CMD -l 4 -H "Accept-Encoding: gzip, br" "Accept-Encoding;substr=br" 2>/dev/null)" ] && exit -1
+[ ",0" != "$($CMD -l 0,2 -H "Accept-Encoding: a, b, br" "Accept-Encoding;substr=br" 2>/dev/null)" ] && exit -1
+[ ",0" != "$($CMD -l 0,0,10 -H "Accept-Encoding: gzip, br" "Accept-Encoding;substr=br;substr=gzip" 2>/dev/null)" ] && exit -1
+[ "1,1" != "$($CMD -l 0,0,10 -H "Accept-Encoding: gzip, br" "Accept-Encoding;substr=br")" ] && exit -1
+
+# The other evaluation modes
+[ "0" != "$($CMD -l 4 -e 1 -H "Accept-Encoding: gzip, br" "Accept-Encoding;substr=br" 2>/dev/null)" ] && exit -1
+[ ",0" != "$($CMD -l 4 -c -H "Accept-Encoding: gzip, br" "Accept-Encoding;substr=br" 2>/dev/null)" ] && exit -1
+echo "1" > budget.tmp
+[ "0" != "$($CMD -i budget.tmp -H "Accept-Encoding: gzip, br" "Accept-Encoding;substr=br")" ] && exit -1
+[ "none" != "$($CMD -l 4 -i budget.tmp -H "Accept-Encoding: gzip, br" "Accept-Encoding;substr=br" 2>/dev/null)" ] && exit -1
+
+# Every aborted evaluation is counted, also after the Key is promoted to a plan
+[ "2001 evaluations exceeded the budget" != "$($CMD -l 4 -n 2000 -H "Accept-Encoding: gzip, br" "Accept-Encoding;substr=br" 2>&1 >/dev/null | tail -1)" ] && exit -1
+[ "2001 evaluations exceeded the budget" != "$($CMD -l 0,0,10 -n 2000 -H "Accept-Encoding: gzip, br" "Accept-Encoding;substr=br;substr=gzip" 2>&1 >/dev/null | tail -1)" ] && exit -1
+
+# Streaming, with and without a memo
+for i in $(seq 1000); do printf "Accept-Encoding: gzip, br\n\nAccept-Encoding: gzip, deflate, br\n\n"; done > budget.tmp
+for memo in 0 16; do
+    [ "1000 evaluations exceeded the budget" != "$($CMD -q -s -m $memo -l 0,2 "Accept-Encoding;substr=br" < budget.tmp 2>&1 | tail -1)" ] && exit -1
+    [ ",0 1,1" != "$($CMD -s -m $memo -l 0,2 "Accept-Encoding;substr=br" < budget.tmp 2>/dev/null | LC_ALL=C sort -u | xargs)" ] && exit -1
+done
+rm -f budget.tmp
+
+exit 0
@@ -0,0 +1,154 @@
+/** @file
+
+    Test for http_key_parse_many(). The Keys parsed in bulk must evaluate exactly like the Keys
+    parsed one by one, share their interned strings, take a fraction of the memory, and free all
+    of it once every Key is released, in any order.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include "common.h"
+
+#define NUM_KEYS 5000
+#define BAD_KEY 1234
+
+static const char *g_headers[] = {"Accept-Encoding", "gzip, br", "User-Agent", "Mozilla/5.0 Mobile7", "X-Tenant-3", "v3, 4321",
+                                  "X-Tenant-12",     "v1",       NULL};
+
+/* The same header for a lot of Keys, since these are the ones interned */
+static const char *
+param_header(http_key_params_t params, size_t n)
+{
+    http_key_param_info_t info;
+
+    while (n-- > 0) {
+        params = http_key_param_info(params, &info);
+    }
+    http_key_param_info(params, &info);
+
+    return info.header;
+}
+
+int
+main(int argc, const char *argv[])
+{
+    static char strings[NUM_KEYS][128];
+    static const char *key_strings[NUM_KEYS];
+    static http_key_params_t bulk[NUM_KEYS];
+    static http_key_params_t single[NUM_KEYS];
+    http_key_t key;
+    size_t bulk_bytes, single_bytes;
+    int failures = 0;
+
+    http_key_init(&key, &test_get_header, &test_malloc, &test_free, 4096, NULL, NULL, NULL);
+    for (size_t i = 0; i < NUM_KEYS; ++i) {
+        if (BAD_KEY == i) {
+            snprintf(strings[i], sizeof(strings[i]), "X-Tenant-%zu;bar=%zu", i % 50, i);
+        } else {
+            snprintf(strings[i], sizeof(strings[i]),
+                     "Accept-Encoding;prefer=BR:gzip, X-Tenant-%zu;match=v%zu;div=%zu, User-Agent;substr=Mobile%zu", i % 50, i % 7,
+                     i % 11 + 1, i % 10);
+        }
+        key_strings[i] = strings[i];
+    }
+
+    if (HTTP_KEY_PARSE_OK == http_key_parse_many(&key, key_strings, NULL, NUM_KEYS, bulk) || bulk[BAD_KEY]) {
+        fprintf(stderr, "FAIL: the bad Key parsed\n");
+        return 1;
+    }
+    bulk_bytes = g_bytes;
+
+    g_bytes = 0;
+    for (size_t i = 0; i < NUM_KEYS; ++i) {
+        size_t num_params;
+
+        single[i] = NULL;
+        if ((HTTP_KEY_PARSE_OK != http_key_parse_alloc(&key, key_strings[i], strlen(key_strings[i]), &single[i], &num_params)) !=
+            (BAD_KEY == i)) {
+            fprintf(stderr, "FAIL: %s: parsed differently\n", key_strings[i]);
+            return 1;
+        }
+    }
+    single_bytes = g_bytes;
+
+    if (bulk_bytes * 3 > single_bytes) {
+        fprintf(stderr, "FAIL: %zu bytes in bulk, %zu bytes one by one\n", bulk_bytes, single_bytes);
+        ++failures;
+    }
+
+    for (size_t i = 0; i < NUM_KEYS; ++i) {
+        char out[64], expected[64];
+        size_t len, expected_len;
+
+        if (BAD_KEY == i) {
+            continue;
+        }
+        len = http_key_eval(&key, g_headers, bulk[i], out, sizeof(out));
+        expected_len = http_key_eval(&key, g_headers, single[i], expected, sizeof(expected));
+        if ((len != expected_len) || memcmp(out, expected, len)) {
+            fprintf(stderr, "FAIL: %s: \"%.*s\" != \"%.*s\"\n", key_strings[i], (int)len, out, (int)expected_len, expected);
+            ++failures;
+            break;
+        }
+
+        /* Interned across all the Keys, even on different pools */
+        if ((param_header(bulk[i], 0) != param_header(bulk[0], 0)) || (param_header(bulk[i], 1) != param_header(bulk[i % 50], 1)) ||
+            (param_header(bulk[i], 3) != param_header(bulk[0], 3))) {
+            fprintf(stderr, "FAIL: %s: headers not interned\n", key_strings[i]);
+            ++failures;
+            break;
+        }
+    }
+
+    /* Released in an order unrelated to the pools, with the first and last Keys outliving the others */
+    for (size_t i = 1; i < NUM_KEYS - 1; i += 2) {
+        http_key_release(bulk[i]);
+    }
+    for (size_t i = 2; i < NUM_KEYS - 1; i += 2) {
+        http_key_release(bulk[i]);
+    }
+    {
+        char out[64];
+        size_t len = http_key_eval(&key, g_headers, bulk[NUM_KEYS - 1], out, sizeof(out));
+
+        if ((len != 10) || memcmp(out, "1nonenone0", 10)) {
+            fprintf(stderr, "FAIL: last Key: \"%.*s\"\n", (int)len, out);
+            ++failures;
+        }
+    }
+    http_key_release(bulk[NUM_KEYS - 1]);
+    http_key_release(bulk[0]);
+    for (size_t i = 0; i < NUM_KEYS; ++i) {
+        http_key_release(single[i]);
+    }
+
+    failures += test_check_frees();
+
+    return failures ? 1 : 0;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
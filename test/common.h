@@ -0,0 +1,95 @@
+/** @file
+
+    Fixtures shared by the C tests: a header callback over a static table of headers, and malloc /
+    free callbacks counting the allocations, to check that everything allocated is freed.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#ifndef TEST_COMMON_H
+#define TEST_COMMON_H
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "http/key.h"
+
+/* Atomic, since some tests allocate from several threads */
+static atomic_size_t g_allocs;
+static atomic_size_t g_frees;
+static atomic_size_t g_bytes;
+
+/* The header data is a table of header name and value pairs, terminated by a NULL name */
+static inline const char *
+test_get_header(void *data, const char *header, size_t header_len, size_t *value_len)
+{
+    const char *const *headers = (const char *const *)data;
+
+    for (size_t i = 0; headers && headers[i]; i += 2) {
+        if ((strlen(headers[i]) == header_len) && !strncasecmp(headers[i], header, header_len)) {
+            *value_len = strlen(headers[i + 1]);
+            return headers[i + 1];
+        }
+    }
+    *value_len = 0;
+
+    return NULL;
+}
+
+static inline void *
+test_malloc(size_t size)
+{
+    ++g_allocs;
+    g_bytes += size;
+    return malloc(size);
+}
+
+static inline void
+test_free(void *ptr)
+{
+    ++g_frees;
+    free(ptr);
+}
+
+/* Returns the number of failures, i.e. 1 if something was not freed */
+static inline int
+test_check_frees(void)
+{
+    if (g_allocs != g_frees) {
+        fprintf(stderr, "FAIL: %zu allocations, %zu frees\n", (size_t)g_allocs, (size_t)g_frees);
+        return 1;
+    }
+
+    return 0;
+}
+
+#endif /* TEST_COMMON_H */
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
@@ -0,0 +1,41 @@
+#! /usr/bin/env bash
+#
+# Test cases for the typed evaluation, and the compact binary encoding
+#
+#  Licensed to the Apache Software Foundation (ASF) under one
+#  or more contributor license agreements.  See the NOTICE file
+#  distributed with this work for additional information
+#  regarding copyright ownership.  The ASF licenses this file
+#  to you under the Apache License, Version 2.0 (the
+#  "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+set -e # exit on error
+
+CMD="../cmd/key-cmd -t -c"
+
+# Two bit tags, four to a byte: none, false, true, or a value following
+[ "00,1" != "$($CMD "Foo;match=x")" ] && exit -1
+[ "01,1" != "$($CMD -H "Foo: y" "Foo;match=x")" ] && exit -1
+[ "02,1" != "$($CMD -H "Foo: x" "Foo;match=x")" ] && exit -1
+[ "9a02,2" != "$($CMD -H "Foo: x, y" "Foo;match=x, Foo;substr=y, Foo;substr=z, Foo;match=y, Foo;substr=x")" ] && exit -1
+
+# UINT as varints, and BYTES with a varint length
+[ "030c,2" != "$($CMD -H "Foo: 12" "Foo;div=1")" ] && exit -1
+[ "03ac02,3" != "$($CMD -H "Foo: 300" "Foo;div=1")" ] && exit -1
+[ "0301,2" != "$($CMD -H "Accept-Encoding: gzip, br" "Accept-Encoding;prefer=br:gzip")" ] && exit -1
+[ "0303616263,5" != "$($CMD -H "Foo: abc" -V "Foo")" ] && exit -1
+[ "eb0108666f6f2c20626172ac02,13" != "$($CMD -H "A: foo, bar" -H "B: 300" -V "A" "A;match=foo, A;substr=bar, B;div=1, A;substr=x, C;div=3")" ] && exit -1
+
+# Too small a buffer
+[ ",0" != "$($CMD -b 5 -H "A: foo, bar" -V "A")" ] && exit -1
+
+exit 0
@@ -0,0 +1,174 @@
+/** @file
+
+    Test for the C++ interface in http/key.hpp. The Programs compiled from literal Key strings must
+    produce exactly the same output as the library does for the same Key strings, for every header
+    set and buffer size, including the failures.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <cstdio>
+
+#include "http/key.hpp"
+
+using http::key::compile;
+
+struct Headers {
+    std::string_view names[4];
+    std::string_view values[4];
+};
+
+struct Getter {
+    constexpr std::string_view
+    operator()(const Headers &headers, std::string_view header) const
+    {
+        for (std::size_t i = 0; i < 4; ++i) {
+            if (http::key::detail::iequals(headers.names[i], header)) {
+                return headers.values[i];
+            }
+        }
+        return {};
+    }
+};
+
+static const Headers g_headers[] = {
+    {{"Accept-Encoding", "User-Agent", "X-Num"}, {"gzip, deflate, br", "Mozilla/5.0 (X11)", "42"}},
+    {{"Accept-Encoding", "X-Num"}, {"br;q=0.5, gzip;q=1.0, *;q=0.1", " 1234 , 5"}},
+    {{"accept-encoding", "User-Agent"}, {"GZIP;q=0, identity", "Foo Mobile"}},
+    {{}, {}},
+    {{"Accept-Encoding", "X-Num", "Foo"}, {",gzip", "abc", "1"}},
+    {{"Accept-Encoding", "X-Num"}, {"  br ,, gzip", "18446744073709551615"}},
+    {{"Accept-Encoding"}, {"deflate;q=0.5;level=1, x-gzip;Q=1, BROTLI-IS-LONG"}},
+};
+
+static http::key::Key<const Headers, Getter> g_key;
+static int g_failures = 0;
+
+/* Evaluated at compile time as well */
+static constexpr auto g_prefer = compile("Accept-Encoding;prefer=br:gzip, X-Num;div=4");
+
+constexpr bool
+prefer_at_compile_time()
+{
+    constexpr Headers headers{{"Accept-Encoding", "X-Num"}, {"gzip;q=0.8, br;q=0.4", "13"}};
+    char buf[g_prefer.max_output_len()] = {};
+
+    return (g_prefer.eval(Getter(), headers, buf, sizeof(buf)) == 2) && (buf[0] == '2') && (buf[1] == '3');
+}
+
+static_assert(g_prefer.valid() && (g_prefer.size() == 2));
+static_assert(g_prefer.max_output_len() == 4 + 19);
+static_assert(prefer_at_compile_time());
+static_assert(compile("").valid() && (compile("").size() == 0));
+static_assert(!compile("Foo;bar=3").valid());
+static_assert(!compile("Foo;div").valid());
+static_assert(!compile("Foo;prefer=").valid());
+static_assert(compile("Foo;param=bar").max_output_len() == HTTP_KEY_UNBOUNDED);
+
+template <std::size_t L>
+static void
+check(const http::key::Program<L> &program, const char *key_string)
+{
+    http::key::Params params = g_key.parse(key_string);
+
+    if (!params || (params.size() != program.size()) || (params.max_output_len() != program.max_output_len())) {
+        fprintf(stderr, "FAIL: %s: parsed differently\n", key_string);
+        ++g_failures;
+        return;
+    }
+
+    for (const Headers &headers : g_headers) {
+        for (std::size_t size = 0; size <= 64; ++size) {
+            char buf[64], expected[64];
+            std::string_view out = g_key.eval(headers, program, buf, size);
+            std::string_view lib = g_key.eval(headers, params, expected, size);
+
+            if (out != lib) {
+                fprintf(stderr, "FAIL: %s: \"%.*s\" != \"%.*s\" (buffer size %zu)\n", key_string, (int)out.size(), out.data(),
+                        (int)lib.size(), lib.data(), size);
+                ++g_failures;
+                return;
+            } else if (!lib.empty() && !g_key.matches(headers, params, lib)) {
+                fprintf(stderr, "FAIL: %s: does not match \"%.*s\"\n", key_string, (int)lib.size(), lib.data());
+                ++g_failures;
+                return;
+            }
+        }
+    }
+}
+
+#define CHECK(key_string)                                          \
+    do {                                                           \
+        static constexpr auto program = compile(key_string);       \
+        static_assert(program.valid(), "invalid Key " key_string); \
+        check(program, key_string);                                \
+    } while (0)
+
+int
+main()
+{
+    CHECK("Accept-Encoding;substr=gzip");
+    CHECK("Accept-Encoding;substr=zip, Accept-Encoding;substr=br");
+    CHECK("Accept-Encoding;match=gzip;match=br");
+    CHECK("Accept-Encoding;prefer=br:gzip:deflate");
+    CHECK("Accept-Encoding;prefer=BR:X-GZip:identity:brotli-is-long, User-Agent;substr=Mobile");
+    CHECK("X-Num;div=10, X-Num;div=8");
+    CHECK("X-Num;div=0");
+    CHECK("Foo;partition=1:2");
+    CHECK("User-Agent;match=Mozilla/5.0 (X11)");
+    CHECK(" accept-encoding ; substr=br , x-num;div=3 ");
+    CHECK("Missing;div=3, Missing;match=x");
+
+    /* Runtime parsing fails where the library does */
+    for (const char *key_string : {"Foo;bar=3", "Foo;div", "Foo;prefer=", "Foo;prefer=a:b:c:d:e:f:g:h:i:j:k:l:m:n:o:p:q"}) {
+        http::key::Program<64> program(key_string);
+
+        if (program.valid() || g_key.parse(key_string)) {
+            fprintf(stderr, "FAIL: %s: should not parse\n", key_string);
+            ++g_failures;
+        }
+    }
+
+    /* Copies share the parsed Key */
+    {
+        http::key::Params params = g_key.parse("X-Num;div=2");
+        http::key::Params copy = params;
+        http::key::Params moved = std::move(params);
+        char buf[16];
+
+        params = copy;
+        if ((g_key.eval(g_headers[0], moved, buf, sizeof(buf)) != "21") ||
+            (g_key.eval(g_headers[0], params, buf, sizeof(buf)) != "21")) {
+            fprintf(stderr, "FAIL: copied Params\n");
+            ++g_failures;
+        }
+    }
+
+    return g_failures ? 1 : 0;
+}
+
+/*
+  local variables:
+  mode: C++
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
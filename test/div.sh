@@ -40,4 +40,16 @@ CMD="../cmd/key-cmd -t"
 [ "10,2" != $($CMD -H "Bar: 54" "Bar;div=5") ] && exit -1
 [ "10,2" != $($CMD -H "Bar:   52  , 100" "Bar;div=5") ] && exit -1
 
+# Evaluation buffer too small for the quotient
+[ ",0" != $($CMD -b 1 -H "Bar: 54" "Bar;div=5") ] && exit -1
+[ "10,2" != $($CMD -b 2 -H "Bar: 54" "Bar;div=5") ] && exit -1
+
+# Division by zero fails the evaluation
+[ ",0" != $($CMD -H "Bar: 54" "Bar;div=0") ] && exit -1
+
+# Power of two dividers
+[ "13,2" != $($CMD -H "Bar: 54" "Bar;div=4") ] && exit -1
+[ "54,2" != $($CMD -H "Bar: 54" "Bar;div=1") ] && exit -1
+[ "0,1" != $($CMD -H "Bar: 54" "Bar;div=64") ] && exit -1
+
 exit 0
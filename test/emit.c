@@ -0,0 +1,156 @@
+/** @file
+
+    Test for the code generated by key-cmd --emit-c, from the Keys in emit.keys. The precompiled
+    evaluators must produce exactly the same output as the library does for the same Key strings,
+    for every header set and buffer size, including the failures.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "http/key.h"
+
+/* Generated, in emit_keys.c */
+int key_compiled_register(http_key_t *key);
+
+typedef struct {
+    const char *headers[8]; /* Name and value pairs */
+} headers_t;
+
+static const headers_t g_headers[] = {
+    {{"Accept-Encoding", "gzip, deflate, br", "User-Agent", "Mozilla/5.0 (X11)", "X-Num", "42"}},
+    {{"Accept-Encoding", "br;q=0.5, gzip;q=1.0, *;q=0.1", "X-Num", " 1234 , 5"}},
+    {{"accept-encoding", "GZIP;q=0, identity", "User-Agent", "Foo Mobile \"quoted\"\?"}},
+    {{NULL}},
+    {{"Accept-Encoding", ",gzip", "X-Num", "abc", "Foo", "1"}},
+    {{"Accept-Encoding", "  br ,, gzip", "X-Num", "18446744073709551615"}},
+    {{"Accept-Encoding", "deflate;q=0.5;level=1, x-gzip;Q=1, BROTLI-IS-LONG, z", "User-Agent", ""}},
+};
+
+static const char *
+get_header(void *data, const char *header, size_t header_len, size_t *value_len)
+{
+    const headers_t *headers = (const headers_t *)data;
+
+    for (size_t i = 0; (i < 8) && headers->headers[i]; i += 2) {
+        if ((strlen(headers->headers[i]) == header_len) && !strncasecmp(headers->headers[i], header, header_len)) {
+            *value_len = strlen(headers->headers[i + 1]);
+            return headers->headers[i + 1];
+        }
+    }
+    *value_len = 0;
+
+    return NULL;
+}
+
+static size_t
+dummy(http_key_t *key, void *header_data, char *buf, size_t buf_size)
+{
+    if (buf_size < 5) {
+        return 0;
+    }
+    memcpy(buf, "dummy", 5);
+
+    return 5;
+}
+
+int
+main(int argc, const char *argv[])
+{
+    http_key_t key_c, key_i;
+    int failures = 0;
+
+    http_key_init(&key_c, &get_header, NULL, NULL, 4096, NULL, NULL, NULL);
+    http_key_init(&key_i, &get_header, NULL, NULL, 4096, NULL, NULL, NULL);
+    if (key_compiled_register(&key_c) || (0 == key_c.num_compiled)) {
+        fprintf(stderr, "FAIL: key_compiled_register()\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < key_c.num_compiled; ++i) {
+        const char *key_string = key_c.compiled[i].key_string;
+        http_key_params_t compiled, interpreted;
+        size_t num_params;
+
+        if ((HTTP_KEY_PARSE_OK != http_key_parse_alloc(&key_c, key_string, strlen(key_string), &compiled, &num_params)) ||
+            (HTTP_KEY_PARSE_OK != http_key_parse_alloc(&key_i, key_string, strlen(key_string), &interpreted, &num_params))) {
+            fprintf(stderr, "FAIL: %s: failed to parse\n", key_string);
+            return 1;
+        }
+
+        for (size_t h = 0; h < sizeof(g_headers) / sizeof(g_headers[0]); ++h) {
+            for (size_t size = 0; size <= 64; ++size) {
+                char out[64], direct[64], expected[64];
+                size_t out_len = http_key_eval(&key_c, (void *)&g_headers[h], compiled, out, size);
+                size_t direct_len = key_c.compiled[i].eval(&key_c, (void *)&g_headers[h], direct, size);
+                size_t len = http_key_eval(&key_i, (void *)&g_headers[h], interpreted, expected, size);
+
+                if ((out_len != len) || (direct_len != len) || memcmp(out, expected, len) || memcmp(direct, expected, len)) {
+                    fprintf(stderr, "FAIL: %s: \"%.*s\" != \"%.*s\" (headers %zu, buffer size %zu)\n", key_string, (int)direct_len,
+                            direct, (int)len, expected, h, size);
+                    ++failures;
+                    break;
+                }
+            }
+        }
+        http_key_release(compiled);
+        http_key_release(interpreted);
+    }
+
+    /* The registered evaluator is what http_key_eval() uses, but only for Keys parsed after registering it */
+    {
+        static const char *key_string = "X-Num;div=2";
+        http_key_params_t before, after;
+        size_t num_params;
+        char buf[16];
+
+        http_key_parse_alloc(&key_i, key_string, strlen(key_string), &before, &num_params);
+        http_key_register(&key_i, key_string, &dummy);
+        http_key_parse_alloc(&key_i, key_string, strlen(key_string), &after, &num_params);
+        if ((http_key_eval(&key_i, (void *)&g_headers[0], before, buf, sizeof(buf)) != 2) ||
+            (http_key_eval(&key_i, (void *)&g_headers[0], after, buf, sizeof(buf)) != 5) || memcmp(buf, "dummy", 5)) {
+            fprintf(stderr, "FAIL: registered evaluator not used\n");
+            ++failures;
+        }
+
+        /* Not while normalizing the header values */
+        http_key_normalize(&key_i, "X-Num", HTTP_KEY_NORMALIZE_SPACE);
+        if (http_key_eval(&key_i, (void *)&g_headers[0], after, buf, sizeof(buf)) != 2) {
+            fprintf(stderr, "FAIL: registered evaluator used while normalizing\n");
+            ++failures;
+        }
+        http_key_release(before);
+        http_key_release(after);
+    }
+
+    return failures ? 1 : 0;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
@@ -0,0 +1,43 @@
+#! /usr/bin/env bash
+#
+# Test cases for comparing the evaluation against a stored secondary key
+#
+#  Licensed to the Apache Software Foundation (ASF) under one
+#  or more contributor license agreements.  See the NOTICE file
+#  distributed with this work for additional information
+#  regarding copyright ownership.  The ASF licenses this file
+#  to you under the Apache License, Version 2.0 (the
+#  "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+set -e # exit on error
+
+CMD="../cmd/key-cmd -t"
+HDRS="-H A:foo,bar -H B:300"
+KEY="A;substr=bar, B;div=1, C;match=x"
+
+# The stored key must be exactly what the evaluation produces
+[ "7:foo,bar1300none,17" != "$($CMD $HDRS -V A "$KEY")" ] && exit -1
+[ 1 != "$($CMD $HDRS -V A -e "7:foo,bar1300none" "$KEY")" ] && exit -1
+[ 0 != "$($CMD $HDRS -V A -e "7:foo,bar1300non" "$KEY")" ] && exit -1
+[ 0 != "$($CMD $HDRS -V A -e "7:foo,bar1300nonee" "$KEY")" ] && exit -1
+[ 0 != "$($CMD $HDRS -V A -e "7:foo,bar130" "$KEY")" ] && exit -1
+[ 0 != "$($CMD $HDRS -V A -e "7:foo,bar1301none" "$KEY")" ] && exit -1
+[ 0 != "$($CMD $HDRS -V A -e "7:foo,baz1300none" "$KEY")" ] && exit -1
+[ 0 != "$($CMD $HDRS -V A -e "8:foo,bar1300none" "$KEY")" ] && exit -1
+[ 0 != "$($CMD $HDRS -V A -e "07:foo,bar1300none" "$KEY")" ] && exit -1
+[ 0 != "$($CMD $HDRS -V A -e "" "$KEY")" ] && exit -1
+
+# Missing headers, and an evaluation failure never matches
+[ 1 != "$($CMD -e "nonenone" "A;substr=bar, B;div=1")" ] && exit -1
+[ 0 != "$($CMD -H "B: 3" -e "" "B;div=0")" ] && exit -1
+
+exit 0
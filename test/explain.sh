@@ -0,0 +1,45 @@
+#! /usr/bin/env bash
+#
+# Test cases for the sampled profile of the parameters, with key-cmd -x. The times vary from run to
+# run, so only the bytes and list items per parameter are checked, and that the times are there.
+#
+#  Licensed to the Apache Software Foundation (ASF) under one
+#  or more contributor license agreements.  See the NOTICE file
+#  distributed with this work for additional information
+#  regarding copyright ownership.  The ASF licenses this file
+#  to you under the Apache License, Version 2.0 (the
+#  "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+set -e # exit on error
+
+CMD="../cmd/key-cmd -x -t -n 100 -H Accept-Encoding:gzip,deflate,br -H User-Agent:curl/8.0 -H X-Num:42"
+
+explain() {
+    $CMD "$@" | cut -d, -f1-3 | tr '\n' ' '
+}
+
+[ "accept-encoding;SUBSTR,15,3 " != "$(explain "Accept-Encoding;substr=gzip")" ] && exit -1
+[ "accept-encoding;PREFER,15,3 user-agent;MATCH,8,1 x-num;DIV,2,1 " != \
+  "$(explain "Accept-Encoding;prefer=br:gzip, User-Agent;match=curl/8.0, X-Num;div=10")" ] && exit -1
+
+# A missing header is evaluated without any bytes
+[ "missing;SUBSTR,0,0 x-num;MATCH,2,1 " != "$(explain "Missing;substr=foo, X-Num;match=42")" ] && exit -1
+
+# Every parameter has a time for the evaluator and the header lookup
+[ -n "$($CMD "Accept-Encoding;substr=gzip, X-Num;div=10" | grep -v '^[^,]*,[0-9]*,[0-9]*,[0-9]*,[0-9]*,[0-9]*$')" ] && exit -1
+[ 2 != $($CMD "Accept-Encoding;substr=gzip, X-Num;div=10" | wc -l) ] && exit -1
+
+# The plain output shows the result, and the parameters
+../cmd/key-cmd -x -H X-Num:42 "X-Num;div=10" | grep -q 'Key: X-Num;div=10 -> "4"' || exit -1
+../cmd/key-cmd -x -H X-Num:42 "X-Num;div=10" | grep -q 'x-num;DIV: .* ns p50, .* ns p99, 2 bytes, 1 tokens' || exit -1
+
+exit 0
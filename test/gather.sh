@@ -0,0 +1,48 @@
+#! /usr/bin/env bash
+#
+# Test cases for the scatter evaluation, http_key_eval_iov()
+#
+#  Licensed to the Apache Software Foundation (ASF) under one
+#  or more contributor license agreements.  See the NOTICE file
+#  distributed with this work for additional information
+#  regarding copyright ownership.  The ASF licenses this file
+#  to you under the Apache License, Version 2.0 (the
+#  "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+set -e # exit on error
+
+CMD="../cmd/key-cmd -t -g"
+
+# Constant results, where "none0" and "01" are contiguous in the static storage
+[ "none,1" != "$($CMD "Foo;match=x")" ] && exit -1
+[ "1,1" != "$($CMD -H "Foo: x" "Foo;match=x")" ] && exit -1
+[ "none0,1" != "$($CMD -H "Foo: y" "Bar;match=x, Foo;match=x")" ] && exit -1
+[ "01,1" != "$($CMD -H "Foo: x, y" "Foo;match=z, Foo;match=x")" ] && exit -1
+[ "1100,4" != "$($CMD -H "Foo: x, y" "Foo;match=y;substr=x;substr=z, Foo;match=z")" ] && exit -1
+
+# Numbers are written to the buffer, and adjacent ones merged
+[ "412,1" != "$($CMD -H "Foo: 12" "Foo;div=3, Foo;div=1")" ] && exit -1
+[ "14none,3" != "$($CMD -H "Foo: 12" "Foo;match=12, Foo;div=3, Bar;div=3")" ] && exit -1
+[ "11,2" != "$($CMD -H "Accept-Encoding: gzip, br" "Accept-Encoding;prefer=gzip:br, Accept-Encoding;substr=br")" ] && exit -1
+
+# Vary values are referenced, with the length prefix in the buffer. Normalized values are copied
+# to the buffer after the prefix, and merged with it.
+[ "8:foo, bar1,3" != "$($CMD -H "A: foo, bar" -V "A" "A;match=bar")" ] && exit -1
+[ "3:abc3:def,4" != "$($CMD -H "A: abc" -H "B: def" -V "A, B")" ] && exit -1
+[ "7:bar,foo,1" != "$($CMD -N A -H "A: BAR , Foo" -V "A")" ] && exit -1
+
+# The same as http_key_eval(), including the failures
+[ "8:foo, bar142none,5" != "$($CMD -H "A: foo, bar" -H "B: 300" -V "A" "A;match=foo, B;div=7, C;div=3")" ] && exit -1
+[ ",0" != "$($CMD -H "Foo: 12" "Foo;div=0")" ] && exit -1
+[ ",0" != "$($CMD -b 1 -H "A: foo" -V "A")" ] && exit -1
+
+exit 0
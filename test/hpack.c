@@ -0,0 +1,242 @@
+/** @file
+
+    Test for http_key_eval_conn(), with a stand-in for an HPACK encoder and decoder. The encoder
+    indexes the header fields it has sent before on the connection, and the decoder hands out the
+    absolute index of each dynamic table entry as the entry ID. The memoized evaluations must produce
+    exactly what http_key_eval() does, for every request, while the table evicts entries.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include "common.h"
+
+/* A small dynamic table, such that entries are evicted during the test */
+#define TABLE_SIZE 6
+#define STATIC_SIZE 61
+#define MAX_FIELDS 8
+
+typedef struct {
+    const char *name;
+    const char *value;
+} field_t;
+
+/* One side of the connection's dynamic table. Entry i (in insertions) is at i % TABLE_SIZE. */
+typedef struct {
+    field_t entries[TABLE_SIZE];
+    uint64_t inserted;
+} table_t;
+
+/* A decoded request, with the entry ID of each field (0 for literals that were not indexed) */
+typedef struct {
+    field_t fields[MAX_FIELDS];
+    uint64_t ids[MAX_FIELDS];
+    size_t num_fields;
+} request_t;
+
+/* Encode a header list: an indexed field is 0x80 and the relative index (most recent is 0), and a
+   literal is 0x40 (added to the table) or 0x00 (never indexed) and the index of the field in the
+   list. The literals refer to the header list instead of carrying the strings. */
+static size_t
+encode(table_t *table, const field_t *fields, size_t num_fields, int never_index, unsigned char *out)
+{
+    for (size_t i = 0; i < num_fields; ++i) {
+        size_t rel;
+
+        for (rel = 0; rel < TABLE_SIZE && rel < table->inserted; ++rel) {
+            const field_t *e = &table->entries[(table->inserted - 1 - rel) % TABLE_SIZE];
+
+            if (!strcmp(e->name, fields[i].name) && !strcmp(e->value, fields[i].value)) {
+                break;
+            }
+        }
+        if ((rel < TABLE_SIZE) && (rel < table->inserted)) {
+            out[i] = 0x80 | (unsigned char)rel;
+        } else if (never_index && !strcasecmp(fields[i].name, "User-Agent")) {
+            out[i] = 0x00 | (unsigned char)i;
+        } else {
+            out[i] = 0x40 | (unsigned char)i;
+            table->entries[table->inserted++ % TABLE_SIZE] = fields[i];
+        }
+    }
+
+    return num_fields;
+}
+
+static void
+decode(table_t *table, const unsigned char *in, size_t len, const field_t *fields, request_t *req)
+{
+    req->num_fields = 0;
+    for (size_t i = 0; i < len; ++i) {
+        size_t n = req->num_fields++;
+
+        if (in[i] & 0x80) {
+            uint64_t abs = table->inserted - 1 - (in[i] & 0x3f);
+
+            req->fields[n] = table->entries[abs % TABLE_SIZE];
+            req->ids[n] = STATIC_SIZE + 1 + abs;
+        } else {
+            req->fields[n] = fields[in[i] & 0x3f];
+            req->ids[n] = 0;
+            if (in[i] & 0x40) {
+                req->ids[n] = STATIC_SIZE + 1 + table->inserted;
+                table->entries[table->inserted++ % TABLE_SIZE] = req->fields[n];
+            }
+        }
+    }
+}
+
+static const char *
+get_header_id(void *data, const char *header, size_t header_len, size_t *value_len, uint64_t *id)
+{
+    const request_t *req = (const request_t *)data;
+
+    for (size_t i = 0; i < req->num_fields; ++i) {
+        if ((strlen(req->fields[i].name) == header_len) && !strncasecmp(req->fields[i].name, header, header_len)) {
+            *value_len = strlen(req->fields[i].value);
+            *id = req->ids[i];
+            return req->fields[i].value;
+        }
+    }
+    *value_len = 0;
+    *id = 0;
+
+    return NULL;
+}
+
+static const char *
+get_header(void *data, const char *header, size_t header_len, size_t *value_len)
+{
+    uint64_t id;
+
+    return get_header_id(data, header, header_len, value_len, &id);
+}
+
+static const char *g_keys[] = {
+    "Accept-Encoding;prefer=br:gzip, Accept-Encoding;substr=deflate",
+    "User-Agent;substr=Mobile, X-Num;div=10, Accept-Encoding;match=gzip",
+    "X-Num;partition=10:100, Cookie;substr=session",
+};
+
+static const char *g_encodings[] = {"gzip, br", "gzip", "deflate, gzip;q=0.5", "identity", "GZIP ,  Br"};
+static const char *g_agents[] = {"Mozilla/5.0 Mobile", "curl/8.0"};
+static const char *g_nums[] = {"5", "42", "12345", " 7 "};
+
+int
+main(int argc, const char *argv[])
+{
+    http_key_params_t params[sizeof(g_keys) / sizeof(g_keys[0])];
+    http_key_t key;
+    int failures = 0;
+
+    http_key_init(&key, &get_header, &test_malloc, &test_free, 1024, NULL, NULL, NULL);
+    for (size_t k = 0; k < sizeof(g_keys) / sizeof(g_keys[0]); ++k) {
+        size_t num_params;
+
+        if (HTTP_KEY_PARSE_OK != http_key_parse_alloc(&key, g_keys[k], strlen(g_keys[k]), &params[k], &num_params)) {
+            fprintf(stderr, "FAIL: %s: failed to parse\n", g_keys[k]);
+            return 1;
+        }
+    }
+
+    /* One connection without any normalization, one with the values lower cased, with the User-Agent
+       never indexed, and one with a budget that the longer values exceed */
+    for (int pass = 0; pass < 3; ++pass) {
+        http_key_conn_t conn = http_key_conn_create(&key, 64);
+        table_t encoder = {{{NULL, NULL}}, 0};
+        table_t decoder = {{{NULL, NULL}}, 0};
+        size_t hits, misses;
+
+        if (1 == pass) {
+            http_key_normalize(&key, "Accept-Encoding", HTTP_KEY_NORMALIZE_LOWER | HTTP_KEY_NORMALIZE_SPACE);
+        } else if (2 == pass) {
+            http_key_budget(&key, 16, 0, 0);
+        }
+        for (size_t r = 0; r < 200; ++r) {
+            field_t fields[MAX_FIELDS] = {
+                {"Accept-Encoding", g_encodings[(r / 3) % 5]},
+                {"User-Agent", g_agents[(r / 7) % 2]},
+                {"X-Num", g_nums[r % 4]},
+            };
+            size_t num_fields = (r % 5) ? 3 : 2;
+            unsigned char block[MAX_FIELDS];
+            size_t len = encode(&encoder, fields, num_fields, 1 == pass, block);
+            request_t req;
+
+            decode(&decoder, block, len, fields, &req);
+            for (size_t k = 0; k < sizeof(g_keys) / sizeof(g_keys[0]); ++k) {
+                for (size_t size = 0; size <= 32; size += (size < 24) ? 8 : 1) {
+                    char out[64], expected[64];
+                    size_t out_len = http_key_eval_conn(&key, conn, &get_header_id, &req, params[k], out, size);
+                    size_t expected_len = http_key_eval(&key, &req, params[k], expected, size);
+
+                    if ((out_len != expected_len) || memcmp(out, expected, out_len)) {
+                        fprintf(stderr, "FAIL: %s: \"%.*s\" != \"%.*s\" (request %zu, buffer size %zu)\n", g_keys[k], (int)out_len,
+                                out, (int)expected_len, expected, r, size);
+                        ++failures;
+                        break;
+                    }
+                }
+            }
+        }
+
+        /* Most values repeat, and are sent as indexes. Over the budget, the evaluations that are
+           aborted early have fewer hits. */
+        http_key_conn_stats(conn, &hits, &misses);
+        if (hits < ((2 == pass) ? 1 : 2) * misses) {
+            fprintf(stderr, "FAIL: %zu hits, %zu misses\n", hits, misses);
+            ++failures;
+        }
+        http_key_conn_destroy(conn);
+        http_key_normalize(&key, "Accept-Encoding", 0);
+        http_key_budget(&key, 0, 0, 0);
+    }
+
+    /* The memo keeps a released Key alive, until the connection is destroyed */
+    {
+        http_key_conn_t conn = http_key_conn_create(&key, 16);
+        request_t req = {{{"Accept-Encoding", "gzip"}}, {STATIC_SIZE + 1}, 1};
+        size_t frees;
+        char out[64];
+
+        http_key_eval_conn(&key, conn, &get_header_id, &req, params[0], out, sizeof(out));
+        frees = g_frees;
+        http_key_release(params[0]);
+        if (g_frees != frees) {
+            fprintf(stderr, "FAIL: the Key was not kept by the memo\n");
+            ++failures;
+        }
+        http_key_conn_destroy(conn);
+    }
+    http_key_release(params[1]);
+    http_key_release(params[2]);
+
+    failures += test_check_frees();
+
+    return failures ? 1 : 0;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
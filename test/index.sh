@@ -0,0 +1,46 @@
+#! /usr/bin/env bash
+#
+# Test cases for the variant index
+#
+#  Licensed to the Apache Software Foundation (ASF) under one
+#  or more contributor license agreements.  See the NOTICE file
+#  distributed with this work for additional information
+#  regarding copyright ownership.  The ASF licenses this file
+#  to you under the Apache License, Version 2.0 (the
+#  "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+set -e # exit on error
+
+CMD="../cmd/key-cmd -t"
+KEY="A;match=x, B;match=x"
+
+printf "10\n01\n11\nnone1\n\n00\n" > index.tmp
+[ 0 != "$($CMD -H A:x -H B:y -i index.tmp "$KEY")" ] && exit -1
+[ 1 != "$($CMD -H A:y -H B:x -i index.tmp "$KEY")" ] && exit -1
+[ 2 != "$($CMD -H A:x -H B:x -i index.tmp "$KEY")" ] && exit -1
+[ 3 != "$($CMD -H B:x -i index.tmp "$KEY")" ] && exit -1
+[ 5 != "$($CMD -H A:y -H B:y -i index.tmp "$KEY")" ] && exit -1
+[ none != "$($CMD -H A:x -i index.tmp "$KEY")" ] && exit -1
+[ 4 != "$($CMD -i index.tmp "")" ] && exit -1
+
+# Many variants, where stored keys are prefixes of each other, and the last of identical keys wins
+for i in $(seq 0 999); do echo "7:foo,bar$i"; done > index.tmp
+echo "7:foo,bar42" >> index.tmp
+[ 1000 != "$($CMD -H A:foo,bar -H B:42 -V A -i index.tmp "B;div=1")" ] && exit -1
+[ 4 != "$($CMD -H A:foo,bar -H B:4 -V A -i index.tmp "B;div=1")" ] && exit -1
+[ 999 != "$($CMD -H A:foo,bar -H B:999 -V A -i index.tmp "B;div=1")" ] && exit -1
+[ none != "$($CMD -H A:foo,bar -H B:1000 -V A -i index.tmp "B;div=1")" ] && exit -1
+[ none != "$($CMD -H A:foo,baz -H B:42 -V A -i index.tmp "B;div=1")" ] && exit -1
+[ none != "$($CMD -H A:foo -H B:42 -V A -i index.tmp "B;div=1")" ] && exit -1
+rm -f index.tmp
+
+exit 0
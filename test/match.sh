@@ -27,4 +27,11 @@ CMD="../cmd/key-cmd -t"
 [ "1,1" != $($CMD -H "Baz: foo, charlie" "Baz;match=charlie") ] && exit -1
 [ "1,1" != $($CMD -H "Baz: bar, charlie      , abc" "Baz;match=charlie") ] && exit -1
 
+# Longer than 8 bytes, and short values at the very end of the header
+[ "1,1" != $($CMD -H "Baz: foo, charlie-brown" "Baz;match=charlie-brown") ] && exit -1
+[ "0,1" != $($CMD -H "Baz: foo, charlie-brow" "Baz;match=charlie-brown") ] && exit -1
+[ "1,1" != $($CMD -H "Baz: a" "Baz;match=a") ] && exit -1
+[ "0,1" != $($CMD -H "Baz: abcdefghijk, ab" "Baz;match=abc") ] && exit -1
+[ "1,1" != $($CMD -H "Baz: abcdefghijk, abc" "Baz;match=abc") ] && exit -1
+
 exit 0
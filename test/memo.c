@@ -0,0 +1,95 @@
+/** @file
+
+    Test for http_key_memo_attach(). A memoized Key must evaluate exactly like the same Key without
+    a memo, for every buffer size, in any order, including after an evaluation failed on a buffer
+    that was too small.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include "common.h"
+
+static const char *g_headers[] = {"Accept-Encoding", "gzip, br", "X-Num", "42", NULL};
+
+static const char *g_keys[] = {
+    "Accept-Encoding;substr=br, Accept-Encoding;prefer=br:gzip",
+    "X-Num;div=3, Missing;match=foo, Accept-Encoding;substr=deflate",
+};
+
+/* Buffer sizes, small ones first, such that the failures are memoized first if they are at all */
+static const size_t g_sizes[] = {0, 1, 2, 64, 1, 3, 64, 5, 6, 2, 64};
+
+int
+main(int argc, const char *argv[])
+{
+    http_key_t key;
+    int failures = 0;
+
+    http_key_init(&key, &test_get_header, &test_malloc, &test_free, 1024, NULL, NULL, NULL);
+
+    for (size_t k = 0; k < sizeof(g_keys) / sizeof(g_keys[0]); ++k) {
+        http_key_params_t memoized, plain;
+        size_t num_params;
+
+        if ((HTTP_KEY_PARSE_OK != http_key_parse_alloc(&key, g_keys[k], strlen(g_keys[k]), &memoized, &num_params)) ||
+            (HTTP_KEY_PARSE_OK != http_key_parse_alloc(&key, g_keys[k], strlen(g_keys[k]), &plain, &num_params)) ||
+            http_key_memo_attach(&key, memoized, 16, 256)) {
+            fprintf(stderr, "FAIL: %s: failed to parse\n", g_keys[k]);
+            return 1;
+        }
+
+        for (size_t i = 0; i < sizeof(g_sizes) / sizeof(g_sizes[0]); ++i) {
+            char out[64], expected[64];
+            size_t len = http_key_eval(&key, g_headers, memoized, out, g_sizes[i]);
+            size_t expected_len = http_key_eval(&key, g_headers, plain, expected, g_sizes[i]);
+
+            if ((len != expected_len) || memcmp(out, expected, len)) {
+                fprintf(stderr, "FAIL: %s: \"%.*s\" != \"%.*s\" (buffer size %zu)\n", g_keys[k], (int)len, out, (int)expected_len,
+                        expected, g_sizes[i]);
+                ++failures;
+            }
+        }
+
+        /* The successful evaluations did hit the memo */
+        {
+            size_t hits, misses;
+
+            http_key_memo_stats(memoized, &hits, &misses);
+            if (0 == hits) {
+                fprintf(stderr, "FAIL: %s: %zu hits, %zu misses\n", g_keys[k], hits, misses);
+                ++failures;
+            }
+        }
+        http_key_release(memoized);
+        http_key_release(plain);
+    }
+    failures += test_check_frees();
+
+    return failures ? 1 : 0;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
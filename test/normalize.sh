@@ -0,0 +1,61 @@
+#! /usr/bin/env bash
+#
+# Test cases for the normalization of header values
+#
+#  Licensed to the Apache Software Foundation (ASF) under one
+#  or more contributor license agreements.  See the NOTICE file
+#  distributed with this work for additional information
+#  regarding copyright ownership.  The ASF licenses this file
+#  to you under the Apache License, Version 2.0 (the
+#  "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+set -e # exit on error
+
+CMD="../cmd/key-cmd -t"
+
+# Values that mean the same produce the same output
+for v in "gzip, deflate" "deflate,gzip" "GZIP , deflate" "deflate, gzip, Gzip"; do
+    [ "12:deflate,gzip,15" != "$($CMD -N Accept-Encoding -H "Accept-Encoding: $v" -V Accept-Encoding)" ] && exit -1
+done
+
+# Each normalization on its own
+[ "13:gzip, deflate,16" != "$($CMD -N Accept-Encoding:l -H "Accept-Encoding: GZIP, Deflate" -V Accept-Encoding)" ] && exit -1
+[ "13:GZIP,a b,GZIP,16" != "$($CMD -N Accept-Encoding:w -H "Accept-Encoding: GZIP , a   b,GZIP" -V Accept-Encoding)" ] && exit -1
+[ "11:GZIP,b,gzip,14" != "$($CMD -N Accept-Encoding:s -H "Accept-Encoding: gzip, GZIP, b,gzip" -V Accept-Encoding)" ] && exit -1
+
+# Empty list items are dropped, without losing the items after them
+[ "7:br,gzip,9" != "$($CMD -N Accept-Encoding -H "Accept-Encoding: gzip,,br" -V Accept-Encoding)" ] && exit -1
+[ "7:gzip,br,9" != "$($CMD -N Accept-Encoding:w -H "Accept-Encoding: gzip, ,br, " -V Accept-Encoding)" ] && exit -1
+[ "4:gzip,6" != "$($CMD -N Accept-Encoding:w -H "Accept-Encoding: ,,gzip,," -V Accept-Encoding)" ] && exit -1
+
+# Long lists are sorted as well, as long as they fit in the scratch area
+UP=$(seq -s, 100 199)
+DOWN=$(seq -s, 199 -1 100)
+[ "$($CMD -N Accept-Encoding -H "Accept-Encoding: $UP" -V Accept-Encoding)" != \
+  "$($CMD -N Accept-Encoding -H "Accept-Encoding: $DOWN" -V Accept-Encoding)" ] && exit -1
+[ "399:$UP,403" != "$($CMD -N Accept-Encoding -H "Accept-Encoding: $DOWN" -V Accept-Encoding)" ] && exit -1
+SORTED=$(seq 1 250 | LC_ALL=C sort | paste -sd, -)
+[ "891:$SORTED,895" != "$($CMD -N Accept-Encoding:s -H "Accept-Encoding: $(seq -s, 250 -1 1)" -V Accept-Encoding)" ] && exit -1
+
+# Other headers, and the Key parameters, see the normalized value
+[ "10:GZIP, A  B,13" != "$($CMD -N Accept-Encoding -H "Bar: GZIP, A  B" -V Bar)" ] && exit -1
+[ "1,1" != "$($CMD -N Accept-Encoding -H "Accept-Encoding: br, GZIP" "Accept-Encoding;match=gzip")" ] && exit -1
+[ "0,1" != "$($CMD -H "Accept-Encoding: br, GZIP" "Accept-Encoding;match=gzip")" ] && exit -1
+
+# Streaming, with a memo and with enough blocks to promote the Key to a plan
+BLOCKS="Accept-Encoding: gzip, br\n\nAccept-Encoding: BR,gzip\n\n"
+for i in $(seq 1000); do printf "$BLOCKS"; done > normalize.tmp
+[ "7:br,gzip1,10" != "$($CMD -s -N Accept-Encoding -V Accept-Encoding "Accept-Encoding;substr=br" < normalize.tmp 2>/dev/null | sort -u | xargs)" ] && exit -1
+[ "7:br,gzip1,10" != "$($CMD -s -m 16 -N Accept-Encoding -V Accept-Encoding "Accept-Encoding;substr=br" < normalize.tmp 2>/dev/null | sort -u | xargs)" ] && exit -1
+rm -f normalize.tmp
+
+exit 0
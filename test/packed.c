@@ -0,0 +1,221 @@
+/** @file
+
+    Test for http_key_parse_size() and http_key_compact(). A Key parsed into a buffer of exactly the
+    size calculated for it, or compacted from another parse, must evaluate exactly like the Key parsed
+    with http_key_parse_alloc(), and the strings must be packed without any padding.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include "common.h"
+
+typedef struct {
+    const char *headers[9]; /* Name and value pairs, terminated by NULL */
+} headers_t;
+
+static const headers_t g_headers[] = {
+    {{"Accept-Encoding", "gzip, deflate, br", "User-Agent", "Mozilla/5.0 (X11)", "X-Num", "42"}},
+    {{"Accept-Encoding", "br;q=0.5, gzip;q=1.0, *;q=0.1", "X-Num", " 1234 , 5", "Cookie", "a=1"}},
+    {{"accept-encoding", "GZIP;q=0, identity", "User-Agent", "Foo Mobile"}},
+    {{NULL}},
+};
+
+static const char *g_keys[] = {
+    "Accept-Encoding;substr=gzip",
+    "X-Num;div=3",
+    "X-Num;div=16, X-Num;match=42, User-Agent;substr=Mobile",
+    "Accept-Encoding;prefer=BR:Gzip:deflate, Accept-Encoding;match=gzip",
+    "User-Agent;match=a-match-string-longer-than-eight, Cookie;substr=a=1",
+    "A;match=x, B;match=y, C;match=z, A;substr=x",
+};
+
+/* The Key must evaluate exactly like the expected one, for all the headers */
+static int
+same_eval(http_key_t *key, const char *key_string, http_key_params_t params, http_key_params_t expected)
+{
+    for (size_t h = 0; h < sizeof(g_headers) / sizeof(g_headers[0]); ++h) {
+        char out[128], buf[128];
+        size_t len = http_key_eval(key, (void *)g_headers[h].headers, params, out, sizeof(out));
+        size_t expected_len = http_key_eval(key, (void *)g_headers[h].headers, expected, buf, sizeof(buf));
+
+        if ((len != expected_len) || memcmp(out, buf, len)) {
+            fprintf(stderr, "FAIL: %s: \"%.*s\" != \"%.*s\" (headers %zu)\n", key_string, (int)len, out, (int)expected_len, buf, h);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int
+main(int argc, const char *argv[])
+{
+    http_key_t key;
+    int failures = 0;
+
+    http_key_init(&key, &test_get_header, NULL, NULL, 4096, NULL, NULL, NULL);
+
+    for (size_t i = 0; i < sizeof(g_keys) / sizeof(g_keys[0]); ++i) {
+        const char *key_string = g_keys[i];
+        size_t len = strlen(key_string);
+        size_t size = http_key_parse_size(key_string, len);
+        http_key_params_t expected, exact, compacted;
+        size_t num_params;
+        void *buffer, *packed;
+
+        if ((0 == size) || (HTTP_KEY_PARSE_OK != http_key_parse_alloc(&key, key_string, len, &expected, &num_params))) {
+            fprintf(stderr, "FAIL: %s: failed to parse\n", key_string);
+            return 1;
+        }
+
+        /* Exactly the size needed, and not a byte less */
+        buffer = malloc(size);
+        if ((size - 1 >= HTTP_KEY_MIN_ARENA) &&
+            (HTTP_KEY_PARSE_OK == http_key_parse(buffer, size - 1, key_string, len, &exact, &num_params))) {
+            fprintf(stderr, "FAIL: %s: parsed into %zu bytes, but needs %zu\n", key_string, size - 1, size);
+            ++failures;
+        }
+        if (HTTP_KEY_PARSE_OK != http_key_parse(buffer, size, key_string, len, &exact, &num_params)) {
+            fprintf(stderr, "FAIL: %s: does not fit in %zu bytes\n", key_string, size);
+            ++failures;
+        } else if (!same_eval(&key, key_string, exact, expected)) {
+            ++failures;
+        }
+
+        /* The compacted copy is the same size, and outlives the original */
+        if (http_key_compact(expected, NULL, 0, NULL) != size) {
+            fprintf(stderr, "FAIL: %s: compacts to %zu bytes, not %zu\n", key_string, http_key_compact(expected, NULL, 0, NULL),
+                    size);
+            ++failures;
+        }
+        packed = malloc(size);
+        if ((http_key_compact(expected, packed, size - 1, &compacted) != size) || compacted ||
+            (http_key_compact(expected, packed, size, &compacted) != size) || !compacted) {
+            fprintf(stderr, "FAIL: %s: http_key_compact()\n", key_string);
+            ++failures;
+        } else {
+            http_key_params_t reparsed;
+
+            http_key_parse_alloc(&key, key_string, len, &reparsed, &num_params);
+            http_key_release(expected);
+            if (!same_eval(&key, key_string, compacted, reparsed)) {
+                ++failures;
+            }
+            expected = reparsed;
+        }
+
+        http_key_release(compacted);
+        http_key_release(exact);
+        http_key_release(expected);
+        free(packed);
+        free(buffer);
+    }
+
+    /* A Key string that fails to parse has no size */
+    if (http_key_parse_size("Foo;bar=1", 9) || http_key_parse_size("Foo;prefer=", 11)) {
+        fprintf(stderr, "FAIL: size of a bad Key\n");
+        ++failures;
+    }
+
+    /* Strings are not padded, so a one byte longer header name takes exactly one more byte */
+    if (http_key_parse_size("Fooo;substr=a", 13) != http_key_parse_size("Foo;substr=a", 12) + 1) {
+        fprintf(stderr, "FAIL: strings are padded, %zu vs %zu bytes\n", http_key_parse_size("Fooo;substr=a", 13),
+                http_key_parse_size("Foo;substr=a", 12));
+        ++failures;
+    }
+
+    /* A hot Key in a caller buffer never allocates a plan, whether or not the plan fits in the buffer */
+    http_key_init(&key, &test_get_header, &test_malloc, &test_free, 4096, NULL, NULL, NULL);
+    for (size_t i = 0; i < sizeof(g_keys) / sizeof(g_keys[0]); ++i) {
+        const char *key_string = g_keys[i];
+        size_t len = strlen(key_string);
+        size_t sizes[] = {http_key_parse_size(key_string, len), 4096};
+        http_key_params_t expected;
+        size_t num_params;
+
+        http_key_parse_alloc(&key, key_string, len, &expected, &num_params);
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+            void *buffer = malloc(sizes[s]);
+            size_t allocs = atomic_load(&g_allocs);
+            http_key_params_t exact;
+
+            if (HTTP_KEY_PARSE_OK != http_key_parse(buffer, sizes[s], key_string, len, &exact, &num_params)) {
+                fprintf(stderr, "FAIL: %s: does not fit in %zu bytes\n", key_string, sizes[s]);
+                ++failures;
+            } else {
+                char out[128];
+
+                for (int n = 0; n < 2000; ++n) { /* Well past the promotion to a plan */
+                    http_key_eval(&key, (void *)g_headers[n % 3].headers, exact, out, sizeof(out));
+                }
+                if (atomic_load(&g_allocs) != allocs) {
+                    fprintf(stderr, "FAIL: %s: %zu allocations for a Key in %zu bytes\n", key_string,
+                            atomic_load(&g_allocs) - allocs, sizes[s]);
+                    ++failures;
+                } else if (!same_eval(&key, key_string, exact, expected)) {
+                    ++failures;
+                }
+                http_key_release(exact);
+            }
+            free(buffer);
+        }
+        http_key_release(expected);
+    }
+    /* A Key with more headers than a plan can fetch is never promoted, and keeps evaluating as before */
+    {
+        char key_string[33 * 16] = "", names[33][8];
+        const char *headers[2 * 33 + 1] = {NULL};
+        char expected[128], out[128];
+        size_t expected_len, num_params;
+        http_key_params_t params;
+
+        for (int h = 0; h < 33; ++h) {
+            snprintf(names[h], sizeof(names[h]), "H%d", h);
+            snprintf(key_string + strlen(key_string), sizeof(key_string) - strlen(key_string), "%sH%d;match=a", h ? ", " : "", h);
+            headers[2 * h] = names[h];
+            headers[2 * h + 1] = (h % 3) ? "a" : "b";
+        }
+        http_key_parse_alloc(&key, key_string, strlen(key_string), &params, &num_params);
+        expected_len = http_key_eval(&key, (void *)headers, params, expected, sizeof(expected));
+        for (int n = 0; n < 3000; ++n) { /* Well past the promotion to a plan */
+            size_t len = http_key_eval(&key, (void *)headers, params, out, sizeof(out));
+
+            if ((33 != expected_len) || (len != expected_len) || memcmp(out, expected, len)) {
+                fprintf(stderr, "FAIL: %s: \"%.*s\" != \"%.*s\" (evaluation %d)\n", key_string, (int)len, out, (int)expected_len,
+                        expected, n);
+                ++failures;
+                break;
+            }
+        }
+        http_key_release(params);
+    }
+    failures += test_check_frees();
+
+    return failures ? 1 : 0;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
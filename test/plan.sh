@@ -0,0 +1,56 @@
+#! /usr/bin/env bash
+#
+# Test cases for promoting hot Keys to an optimized plan
+#
+#  Licensed to the Apache Software Foundation (ASF) under one
+#  or more contributor license agreements.  See the NOTICE file
+#  distributed with this work for additional information
+#  regarding copyright ownership.  The ASF licenses this file
+#  to you under the Apache License, Version 2.0 (the
+#  "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+set -e # exit on error
+
+CMD="../cmd/key-cmd -s -t"
+
+# The same header used by non-adjacent parameters, which the plan fetches only once
+KEY="Abc;substr=bennet, Bar;div=5, Abc;match=foo, Bar;substr=5"
+BLOCKS="Abc: bennet\nBar: 12\n\nAbc: foo\n\nBar: 54\nAbc: Foo\n\n"
+
+[ "1200,4 0none1none,10 01001,5" != "$(printf "$BLOCKS" | $CMD "$KEY" 2>/dev/null | xargs)" ] && exit -1
+
+# Enough blocks that the Key gets promoted part way through, after which the results must not change
+for i in $(seq 2000); do printf "$BLOCKS"; done > plan.tmp
+[ "01001,5 0none1none,10 1200,4" != "$($CMD "$KEY" < plan.tmp 2>/dev/null | LC_ALL=C sort -u | xargs)" ] && exit -1
+[ 6000 != "$($CMD "$KEY" < plan.tmp 2>/dev/null | grep -c .)" ] && exit -1
+
+# Failing parameters are evaluated ahead once the plan has seen them fail, with the same results
+KEY="Abc;substr=bennet, Bar;div=5, Abc;match=foo, Bar;partition=1:2, Bar;div=3"
+BLOCKS="Abc: bennet\nBar: 12\n\nAbc: foo\n\nBar: , 54\nAbc: Foo\n\n"
+
+[ ",0 0none1nonenone,14 ,0" != "$(printf "$BLOCKS" | $CMD "$KEY" 2>/dev/null | xargs)" ] && exit -1
+for i in $(seq 2000); do printf "$BLOCKS"; done > plan.tmp
+[ ",0 0none1nonenone,14" != "$($CMD "$KEY" < plan.tmp 2>/dev/null | LC_ALL=C sort -u | xargs)" ] && exit -1
+[ 4000 != "$($CMD "$KEY" < plan.tmp 2>/dev/null | grep -c '^,0$')" ] && exit -1
+
+KEY="Abc;substr=bennet, Bar;div=5, Abc;match=foo, Bar;div=3"
+[ "1204,4 0none1none,10 ,0" != "$(printf "$BLOCKS" | $CMD "$KEY" 2>/dev/null | xargs)" ] && exit -1
+[ ",0 0none1none,10 1204,4" != "$($CMD "$KEY" < plan.tmp 2>/dev/null | LC_ALL=C sort -u | xargs)" ] && exit -1
+[ 2000 != "$($CMD "$KEY" < plan.tmp 2>/dev/null | grep -c '^1204,4$')" ] && exit -1
+
+# Same with a buffer too small for the plan
+for i in $(seq 2000); do printf "Abc: foo\n\n"; done > plan.tmp
+[ "0none1none,10" != "$($CMD -b 12 "$KEY" < plan.tmp 2>/dev/null | LC_ALL=C sort -u | xargs)" ] && exit -1
+[ ",0" != "$($CMD -b 8 "$KEY" < plan.tmp 2>/dev/null | LC_ALL=C sort -u | xargs)" ] && exit -1
+rm -f plan.tmp
+
+exit 0
@@ -0,0 +1,45 @@
+#! /usr/bin/env bash
+#
+# Test cases for the PREFER extension parameter
+#
+#  Licensed to the Apache Software Foundation (ASF) under one
+#  or more contributor license agreements.  See the NOTICE file
+#  distributed with this work for additional information
+#  regarding copyright ownership.  The ASF licenses this file
+#  to you under the Apache License, Version 2.0 (the
+#  "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+set -e # exit on error
+
+CMD="../cmd/key-cmd -t"
+
+KEY="Accept-Encoding;prefer=br:gzip:deflate"
+
+# Best supported coding, in the order of the parameter
+[ "1,1" != $($CMD -H "Accept-Encoding: gzip, deflate, br" "$KEY") ] && exit -1
+[ "2,1" != $($CMD -H "Accept-Encoding: deflate, gzip" "$KEY") ] && exit -1
+[ "3,1" != $($CMD -H "Accept-Encoding: deflate" "$KEY") ] && exit -1
+[ "2,1" != $($CMD -H "Accept-Encoding: GZIP , deflate" "$KEY") ] && exit -1
+
+# q-values
+[ "2,1" != $($CMD -H "Accept-Encoding: br;q=0.5, gzip;q=0.8" "$KEY") ] && exit -1
+[ "3,1" != $($CMD -H "Accept-Encoding: br;q=0, gzip;q=0, deflate" "$KEY") ] && exit -1
+[ "1,1" != $($CMD -H "Accept-Encoding: br;q=1.0, gzip; q=1" "$KEY") ] && exit -1
+[ "2,1" != $($CMD -H "Accept-Encoding: *;q=0.1, gzip" "$KEY") ] && exit -1
+[ "1,1" != $($CMD -H "Accept-Encoding: *" "$KEY") ] && exit -1
+
+# No supported coding
+[ "0,1" != $($CMD -H "Accept-Encoding: identity" "$KEY") ] && exit -1
+[ "0,1" != $($CMD -H "Accept-Encoding: gzip;q=0, *;q=0" "$KEY") ] && exit -1
+[ "none,4" != $($CMD "$KEY") ] && exit -1
+
+exit 0
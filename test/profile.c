@@ -0,0 +1,167 @@
+/** @file
+
+    Test for http_key_profile(). The sampled evaluations must produce exactly what the others do,
+    one in every sample_rate evaluations must be sampled, whatever path the Key evaluates on
+    otherwise, and the quantiles of the histograms must be in order.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include "common.h"
+
+#define EVALS 5000 /* Past the KEY_PLAN_THRESHOLD, such that the Key also evaluates on a plan */
+#define RATE 10
+
+static const char *g_headers[] = {"Accept-Encoding", "gzip, deflate, br", "User-Agent", "Mozilla/5.0 Mobile", "X-Num", "42", NULL};
+
+static const char *g_keys[] = {
+    "Accept-Encoding;prefer=br:gzip, User-Agent;substr=Mobile, X-Num;div=10",
+    "X-Num;div=3, Missing;match=foo, Accept-Encoding;substr=deflate",
+};
+
+int
+main(int argc, const char *argv[])
+{
+    http_key_t key;
+    int failures = 0;
+
+    http_key_init(&key, &test_get_header, &test_malloc, &test_free, 1024, NULL, NULL, NULL);
+
+    for (size_t k = 0; k < sizeof(g_keys) / sizeof(g_keys[0]); ++k) {
+        http_key_params_t params, param;
+        size_t num_params;
+        char expected[64];
+        size_t expected_len;
+
+        if (HTTP_KEY_PARSE_OK != http_key_parse_alloc(&key, g_keys[k], strlen(g_keys[k]), &params, &num_params)) {
+            fprintf(stderr, "FAIL: %s: failed to parse\n", g_keys[k]);
+            return 1;
+        }
+        expected_len = http_key_eval(&key, g_headers, params, expected, sizeof(expected));
+
+        http_key_profile(&key, RATE);
+        for (size_t n = 0; n < EVALS; ++n) {
+            char out[64];
+            size_t len = http_key_eval(&key, g_headers, params, out, sizeof(out));
+
+            if ((len != expected_len) || memcmp(out, expected, len)) {
+                fprintf(stderr, "FAIL: %s: \"%.*s\" != \"%.*s\" (evaluation %zu)\n", g_keys[k], (int)len, out, (int)expected_len,
+                        expected, n);
+                ++failures;
+                break;
+            }
+        }
+
+        for (param = params; param;) {
+            http_key_profile_stats_t stats;
+            http_key_param_info_t info;
+            char name[64];
+
+            http_key_param_info(param, &info);
+            snprintf(name, sizeof(name), "%.*s;%s", (int)info.header_len, info.header, info.type);
+            if (!http_key_profile_param(&key, param, &stats) || (stats.samples != EVALS / RATE) ||
+                (stats.fetches != EVALS / RATE)) {
+                fprintf(stderr, "FAIL: %s: %s not sampled one in %d\n", g_keys[k], name, RATE);
+                ++failures;
+            } else if ((stats.eval_ns[0] > stats.eval_ns[1]) || (stats.eval_ns[1] > stats.eval_ns[2]) ||
+                       (stats.eval_ns[2] > stats.eval_ns[3]) || (stats.fetch_ns[0] > stats.fetch_ns[3])) {
+                fprintf(stderr, "FAIL: %s: %s quantiles out of order\n", g_keys[k], name);
+                ++failures;
+            } else {
+                size_t value_len = 0;
+                const char *value = test_get_header(g_headers, info.header, info.header_len, &value_len);
+
+                size_t tokens = value ? ((value[0] == 'g') ? 3 : 1) : 0; /* Only Accept-Encoding is a list */
+
+                if ((stats.bytes != stats.samples * value_len) || (stats.tokens != stats.samples * tokens)) {
+                    fprintf(stderr, "FAIL: %s: %s %zu bytes, %zu tokens\n", g_keys[k], name, (size_t)stats.bytes,
+                            (size_t)stats.tokens);
+                    ++failures;
+                }
+            }
+            param = http_key_param_info(param, &info);
+        }
+
+        /* Three parameter types and headers, since the profile starts over for each Key */
+        {
+            http_key_profile_stats_t stats[16];
+
+            if (http_key_profile_stats(&key, stats, 16) != 3) {
+                fprintf(stderr, "FAIL: %s: %zu profile entries\n", g_keys[k], http_key_profile_stats(&key, stats, 16));
+                ++failures;
+            }
+        }
+        http_key_release(params);
+    }
+
+    /* Keys with different rates, evaluated in turn, each keep their own countdown */
+    {
+        static const char *key_string = "X-Num;div=10";
+        static const size_t rates[2] = {RATE, 3};
+        http_key_t keys[2];
+        http_key_params_t params[2];
+        size_t num_params;
+
+        for (size_t i = 0; i < 2; ++i) {
+            http_key_init(&keys[i], &test_get_header, &test_malloc, &test_free, 1024, NULL, NULL, NULL);
+            http_key_parse_alloc(&keys[i], key_string, strlen(key_string), &params[i], &num_params);
+            http_key_profile(&keys[i], rates[i]);
+        }
+        for (size_t n = 0; n < EVALS; ++n) {
+            for (size_t i = 0; i < 2; ++i) {
+                char out[64];
+
+                http_key_eval(&keys[i], g_headers, params[i], out, sizeof(out));
+            }
+        }
+        for (size_t i = 0; i < 2; ++i) {
+            http_key_profile_stats_t stats;
+
+            if (!http_key_profile_param(&keys[i], params[i], &stats)) {
+                stats.samples = 0;
+            }
+            if (stats.samples != EVALS / rates[i]) {
+                fprintf(stderr, "FAIL: %zu samples at a rate of %zu, with two keys\n", stats.samples, rates[i]);
+                ++failures;
+            }
+            http_key_profile(&keys[i], 0);
+            http_key_release(params[i]);
+        }
+    }
+
+    /* Not sampling, and nothing is left allocated */
+    http_key_profile(&key, 0);
+    if (http_key_profile_stats(&key, NULL, 0) || key.profile.data) {
+        fprintf(stderr, "FAIL: still sampling\n");
+        ++failures;
+    }
+    failures += test_check_frees();
+
+    return failures ? 1 : 0;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
@@ -0,0 +1,46 @@
+#! /usr/bin/env bash
+#
+# Test cases for replaying a log of header blocks
+#
+#  Licensed to the Apache Software Foundation (ASF) under one
+#  or more contributor license agreements.  See the NOTICE file
+#  distributed with this work for additional information
+#  regarding copyright ownership.  The ASF licenses this file
+#  to you under the Apache License, Version 2.0 (the
+#  "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+set -e # exit on error
+
+CMD="../cmd/key-cmd replay -j 3 -t"
+LOG=replay.$$.log
+
+trap "rm -f $LOG" EXIT
+
+for i in $(seq 1 100); do
+    printf "GET /$i HTTP/1.1\r\nAccept-Encoding: gzip, br\r\nBar: $i\r\n\r\n"
+    printf "GET /$i HTTP/1.1\r\nAccept-Encoding: deflate\r\n\r\n"
+done > $LOG
+
+# <variants>,<requests>,<failed>
+[ "2,200,0" != "$($CMD $LOG "Accept-Encoding;substr=gzip" 2>/dev/null)" ] && exit -1
+[ "2,200,0" != "$($CMD $LOG "Accept-Encoding;prefer=br:gzip:deflate" 2>/dev/null)" ] && exit -1
+[ "12,200,0" != "$($CMD $LOG "Bar;div=10" 2>/dev/null)" ] && exit -1
+[ "1,200,100" != "$($CMD $LOG "Bar;div=0" 2>/dev/null)" ] && exit -1
+
+# Repeated headers are joined into one list, as by http_key_block_index()
+for i in $(seq 1 100); do
+    printf "GET /$i HTTP/1.1\r\nAccept-Encoding: gzip\r\nX-Foo: 1\r\nAccept-Encoding: br\r\n\r\n"
+done > $LOG
+[ "1,100,0" != "$($CMD $LOG "Accept-Encoding;match=br" 2>/dev/null)" ] && exit -1
+[ "1,100,0" != "$($CMD $LOG "Accept-Encoding;prefer=deflate:br" 2>/dev/null)" ] && exit -1
+
+exit 0
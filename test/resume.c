@@ -0,0 +1,183 @@
+/** @file
+
+    Test for http_key_eval_start() and http_key_eval_resume(). Each header becomes available after
+    some number of resumes, like a lazily decoded header or a trailer would. The suspended evaluation
+    must produce exactly what http_key_eval() does with all the headers available, and must fetch the
+    headers it already has no more than once.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "http/key.h"
+
+#define NUM_HEADERS 4
+
+typedef struct {
+    const char *name;
+    const char *value;
+    int ready; /* The round in which the value is available */
+    int fetches;
+} header_t;
+
+typedef struct {
+    header_t headers[NUM_HEADERS];
+    int round; /* Incremented on each resume */
+} request_t;
+
+static const char *
+get_header(void *data, const char *header, size_t header_len, size_t *value_len)
+{
+    request_t *req = (request_t *)data;
+
+    for (size_t i = 0; i < NUM_HEADERS; ++i) {
+        header_t *h = &req->headers[i];
+
+        if ((strlen(h->name) == header_len) && !strncasecmp(h->name, header, header_len)) {
+            ++h->fetches;
+            if (h->ready > req->round) {
+                *value_len = 0;
+                return HTTP_KEY_VALUE_PENDING;
+            }
+            *value_len = strlen(h->value);
+            return h->value;
+        }
+    }
+    *value_len = 0;
+
+    return NULL;
+}
+
+static const char *g_keys[] = {
+    "Accept-Encoding;substr=gzip",
+    "Accept-Encoding;prefer=br:gzip, User-Agent;substr=Mobile, X-Num;div=10",
+    "X-Num;div=3, X-Num;match=42, Accept-Encoding;match=br, Missing;substr=foo",
+    "User-Agent;substr=Mobile, Accept-Encoding;substr=deflate, User-Agent;match=curl",
+};
+
+int
+main(int argc, const char *argv[])
+{
+    http_key_t key;
+    int failures = 0;
+
+    http_key_init(&key, &get_header, NULL, NULL, 1024, NULL, NULL, NULL);
+
+    for (size_t k = 0; k < sizeof(g_keys) / sizeof(g_keys[0]); ++k) {
+        http_key_params_t params;
+        size_t num_params;
+
+        if (HTTP_KEY_PARSE_OK != http_key_parse_alloc(&key, g_keys[k], strlen(g_keys[k]), &params, &num_params)) {
+            fprintf(stderr, "FAIL: %s: failed to parse\n", g_keys[k]);
+            return 1;
+        }
+
+        /* Every combination of the rounds in which the three headers become available */
+        for (int combo = 0; combo < 27; ++combo) {
+            for (size_t size = 0; size <= 24; ++size) {
+                request_t req = {{{"Accept-Encoding", "gzip, br", combo % 3, 0},
+                                  {"User-Agent", "Mozilla/5.0 Mobile", (combo / 3) % 3, 0},
+                                  {"X-Num", "42", combo / 9, 0},
+                                  {"Empty", "", 0, 0}},
+                                 1000};
+                http_key_eval_state_t state;
+                char out[64], expected[64];
+                size_t expected_len = http_key_eval(&key, &req, params, expected, size);
+                size_t len;
+                int resumes = 0;
+
+                for (size_t i = 0; i < NUM_HEADERS; ++i) {
+                    req.headers[i].fetches = 0;
+                }
+                req.round = 0;
+                len = http_key_eval_start(&key, &state, &req, params, out, size);
+                while ((HTTP_KEY_PENDING == len) && (resumes < 10)) {
+                    ++req.round;
+                    ++resumes;
+                    len = http_key_eval_resume(&key, &state, &req);
+                }
+                if ((len != expected_len) || memcmp(out, expected, len)) {
+                    fprintf(stderr, "FAIL: %s: \"%.*s\" != \"%.*s\" (combination %d, buffer size %zu)\n", g_keys[k], (int)len,
+                            out, (int)expected_len, expected, combo, size);
+                    ++failures;
+                    break;
+                }
+                if (http_key_eval_resume(&key, &state, &req)) {
+                    fprintf(stderr, "FAIL: %s: resumed a finished evaluation\n", g_keys[k]);
+                    ++failures;
+                    break;
+                }
+
+                /* A header is fetched once per run of parameters using it, plus once per round it was pending in */
+                for (size_t i = 0; i < NUM_HEADERS; ++i) {
+                    int max = 2 + req.headers[i].ready;
+
+                    if (req.headers[i].fetches > max) {
+                        fprintf(stderr, "FAIL: %s: %s fetched %d times (combination %d, buffer size %zu)\n", g_keys[k],
+                                req.headers[i].name, req.headers[i].fetches, combo, size);
+                        ++failures;
+                        break;
+                    }
+                }
+            }
+        }
+        http_key_release(params);
+    }
+
+    /* Without any pending headers, this is a plain evaluation */
+    {
+        request_t req = {{{"Accept-Encoding", "gzip", 0, 0}, {"User-Agent", "", 0, 0}, {"X-Num", "", 0, 0}, {"Empty", "", 0, 0}},
+                         0};
+        static const char *key_string = "Accept-Encoding;substr=gzip, Accept-Encoding;substr=br";
+        http_key_eval_state_t state;
+        http_key_params_t params;
+        size_t num_params;
+        char out[16];
+
+        http_key_parse_alloc(&key, key_string, strlen(key_string), &params, &num_params);
+        if ((http_key_eval_start(&key, &state, &req, params, out, sizeof(out)) != 2) || memcmp(out, "10", 2) ||
+            (req.headers[0].fetches != 1)) {
+            fprintf(stderr, "FAIL: %s: evaluation without pending headers\n", key_string);
+            ++failures;
+        }
+
+        /* A pending value can't be waited for by http_key_eval(), so that fails */
+        req.headers[0].ready = 1;
+        if (http_key_eval(&key, &req, params, out, sizeof(out))) {
+            fprintf(stderr, "FAIL: %s: http_key_eval() of a pending value\n", key_string);
+            ++failures;
+        }
+        http_key_release(params);
+    }
+
+    return failures ? 1 : 0;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
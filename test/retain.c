@@ -0,0 +1,168 @@
+/** @file
+
+    Stress test for sharing a parsed Key between threads. Each worker repeatedly retains, evaluates
+    and releases the Key, while the owner drops its reference half way through, like a cache
+    eviction would. Everything allocated for the Key must be freed exactly once, after the last
+    worker is done. The Key also gets promoted to a plan while the workers are evaluating it.
+    The same Key with a small memo attached is then evaluated by all the workers, with header values
+    that keep replacing the memo entries while other workers hit them.
+    Build with ./configure --enable-tsan to run this under ThreadSanitizer.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+#include <pthread.h>
+
+#include "common.h"
+
+#define NUM_THREADS 8
+#define NUM_EVALS 20000
+
+static const char *KEY = "Accept-Encoding;substr=gzip, User-Agent;match=Mozilla, X-Num;div=10";
+static const char *EXPECTED = "104";
+
+static const char *g_headers[] = {"Accept-Encoding", "gzip, br", "User-Agent", "Mozilla/5.0", "X-Num", "42", NULL};
+
+static atomic_int g_failures;
+static atomic_size_t g_started;
+static http_key_t g_key;
+
+/* Every worker holds its own reference for the duration of each evaluation */
+static void *
+worker(void *data)
+{
+    http_key_params_t params = (http_key_params_t)data;
+    char buf[64];
+
+    for (int i = 0; i < NUM_EVALS; ++i) {
+        http_key_params_t mine = http_key_retain(params);
+        size_t len = http_key_eval(&g_key, g_headers, mine, buf, sizeof(buf));
+
+        if ((len != strlen(EXPECTED)) || memcmp(buf, EXPECTED, len)) {
+            atomic_fetch_add(&g_failures, 1);
+        }
+        http_key_release(mine);
+    }
+    http_key_release(params);
+
+    return NULL;
+}
+
+/* The X-Num values of the memo workers, and the expected output for each */
+static const char *g_nums[] = {"42", "7", "1234", "99", "x", "65536"};
+static const char *g_expected[] = {"104", "100", "10123", "109", "100", "106553"};
+
+/* Every worker cycles through the values from its own starting point, so the entries of the small
+   memo are replaced all the time, while the other workers are hitting them */
+static void *
+memo_worker(void *data)
+{
+    http_key_params_t params = (http_key_params_t)data;
+    size_t start = atomic_fetch_add(&g_started, 1);
+    char buf[64];
+
+    for (int i = 0; i < NUM_EVALS; ++i) {
+        size_t n = (start + i) % (sizeof(g_nums) / sizeof(g_nums[0]));
+        const char *headers[] = {"Accept-Encoding", "gzip, br", "User-Agent", "Mozilla/5.0", "X-Num", g_nums[n], NULL};
+        size_t len = http_key_eval(&g_key, headers, params, buf, sizeof(buf));
+
+        if ((len != strlen(g_expected[n])) || memcmp(buf, g_expected[n], len)) {
+            atomic_fetch_add(&g_failures, 1);
+        }
+    }
+
+    return NULL;
+}
+
+int
+main(int argc, const char *argv[])
+{
+    pthread_t threads[NUM_THREADS];
+    http_key_params_t params;
+    size_t num_params;
+
+    http_key_init(&g_key, &test_get_header, &test_malloc, &test_free, 4096, NULL, NULL, NULL);
+    if (HTTP_KEY_PARSE_OK != http_key_parse_alloc(&g_key, KEY, strlen(KEY), &params, &num_params)) {
+        fprintf(stderr, "failed to parse Key: %s\n", KEY);
+        return 1;
+    }
+
+    /* The reference handed to each worker is taken before the thread starts */
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        if (pthread_create(&threads[i], NULL, &worker, http_key_retain(params))) {
+            fprintf(stderr, "failed to create thread\n");
+            return 1;
+        }
+        if (i == NUM_THREADS / 2) {
+            http_key_release(params); /* Evicted from the "cache" while still in use */
+        }
+    }
+
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    if (atomic_load(&g_failures)) {
+        fprintf(stderr, "%d failed evaluations\n", atomic_load(&g_failures));
+        return 1;
+    }
+
+    /* A memo shared by all the workers */
+    if ((HTTP_KEY_PARSE_OK != http_key_parse_alloc(&g_key, KEY, strlen(KEY), &params, &num_params)) ||
+        http_key_memo_attach(&g_key, params, 4, 128)) {
+        fprintf(stderr, "failed to setup a memo for Key: %s\n", KEY);
+        return 1;
+    }
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        if (pthread_create(&threads[i], NULL, &memo_worker, params)) {
+            fprintf(stderr, "failed to create thread\n");
+            return 1;
+        }
+    }
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    {
+        size_t hits, misses;
+
+        http_key_memo_stats(params, &hits, &misses);
+        if (atomic_load(&g_failures) || (0 == hits) || (hits + misses != NUM_THREADS * NUM_EVALS)) {
+            fprintf(stderr, "%d failed evaluations with a memo, %zu hits, %zu misses\n", atomic_load(&g_failures), hits,
+                    misses);
+            return 1;
+        }
+    }
+    http_key_release(params);
+
+    if (test_check_frees()) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+  local variables:
+  mode: C
+  indent-tabs-mode: nil
+  c-basic-offset: 4
+  c-file-offsets: ((statement-block-intro . +)
+  (label . 0)
+  (statement-cont . +))
+  end:
+*/
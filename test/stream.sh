@@ -0,0 +1,40 @@
+#! /usr/bin/env bash
+#
+# Test cases for streaming raw header blocks
+#
+#  Licensed to the Apache Software Foundation (ASF) under one
+#  or more contributor license agreements.  See the NOTICE file
+#  distributed with this work for additional information
+#  regarding copyright ownership.  The ASF licenses this file
+#  to you under the Apache License, Version 2.0 (the
+#  "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+set -e # exit on error
+
+CMD="../cmd/key-cmd -s -t"
+
+BLOCKS="HTTP/1.1 200 OK\r\nAbc: bennet\r\nBar: 54\r\n\r\nGET / HTTP/1.1\nBar: 12\n\nAbc: foo\nAbc: bennet\n"
+
+[ "1,1 10,2 none,4 2,1 1,1 none,4" != "$(printf "$BLOCKS" | $CMD "Abc;substr=bennet" "Bar;div=5" 2>/dev/null | xargs)" ] && exit -1
+[ "1,1 none,4 1,1" != "$(printf "$BLOCKS" | $CMD "Abc;match=bennet" 2>/dev/null | xargs)" ] && exit -1
+
+# Trailing empty lines, and no final empty line
+[ "1,1 0,1" != "$(printf "\r\n\r\nAbc: bennet\r\n\r\n\r\nAbc: Bennet" | $CMD "Abc;match=bennet" 2>/dev/null | xargs)" ] && exit -1
+
+# Same results with a memo, including a single entry memo that is constantly replaced
+KEY="Abc;substr=bennet;match=foo,Bar;div=5"
+EXPECTED="$(printf "$BLOCKS\n\n$BLOCKS" | $CMD "$KEY" 2>/dev/null | xargs)"
+[ "$EXPECTED" != "$(printf "$BLOCKS\n\n$BLOCKS" | $CMD -m 16 "$KEY" 2>/dev/null | xargs)" ] && exit -1
+[ "$EXPECTED" != "$(printf "$BLOCKS\n\n$BLOCKS" | $CMD -m 1 "$KEY" 2>/dev/null | xargs)" ] && exit -1
+[ -z "$(printf "$BLOCKS\n\n$BLOCKS" | $CMD -m 16 "$KEY" 2>&1 >/dev/null | grep '3 hits, 3 misses')" ] && exit -1
+
+exit 0
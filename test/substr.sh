@@ -34,8 +34,22 @@ CMD="../cmd/key-cmd -t"
 [ "0,1" != $($CMD -H "Abc: Bennet" "Abc;substr=bennet") ] && exit -1
 [ "0,1" != $($CMD -H "Abc: Ben net" "Abc;substr=bennet") ] && exit -1
 
+# An empty item ends the list, the same for all substrings
+[ "0,1" != $($CMD -H "Abc: foo,,bar" "Abc;substr=ar") ] && exit -1
+[ "0,1" != $($CMD -H "Abc: foo,,bar" "Abc;substr= ar") ] && exit -1
+[ "0,1" != $($CMD -H "Abc: foo, ,bar" "Abc;substr=r") ] && exit -1
+[ "0,1" != $($CMD -H "Abc: ,bar" "Abc;substr=ar") ] && exit -1
+[ "1,1" != $($CMD -H "Abc: bar,,foo" "Abc;substr=ar") ] && exit -1
+[ "1,1" != $($CMD -H "Abc: bar,,foo" "Abc;substr=r") ] && exit -1
+
 # Some more complex tests, not from RFC
 UA="User-Agent: Mozilla/5.0 (compatible; MSIE 9.0; Windows NT 6.1; Trident/5.0)"
 [ "1110,4" != $($CMD -H "$UA" "user-agent;substr=MSIE;substr=Windows,user-agent;substr=9.0;substr=Safari") ] && exit -1
 
+# Single character substrings, and substrings that can not use the whole header value
+[ "1,1" != $($CMD -H "Abc: foo, bar/1" "Abc;substr=/") ] && exit -1
+[ "0,1" != $($CMD -H "Abc: foo, bar" "Abc;substr=/") ] && exit -1
+[ "0,1" != $($CMD -H "Abc: foo, bar" "Abc;substr=o b") ] && exit -1
+[ "1,1" != $($CMD -H "Abc: foo bar" "Abc;substr=o b") ] && exit -1
+
 exit 0
@@ -0,0 +1,46 @@
+#! /usr/bin/env bash
+#
+# Test cases for Vary headers, on their own and combined with Key
+#
+#  Licensed to the Apache Software Foundation (ASF) under one
+#  or more contributor license agreements.  See the NOTICE file
+#  distributed with this work for additional information
+#  regarding copyright ownership.  The ASF licenses this file
+#  to you under the Apache License, Version 2.0 (the
+#  "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+
+set -e # exit on error
+
+CMD="../cmd/key-cmd -t"
+
+# Whole values, length prefixed, and none for missing headers
+[ "8:gzip, br,10" != "$($CMD -H "Accept-Encoding: gzip, br" -V "Accept-Encoding")" ] && exit -1
+[ "none,4" != "$($CMD -V "Accept-Encoding")" ] && exit -1
+[ "4:none3:foo,11" != "$($CMD -H "Abc: none" -H "Bar: foo" -V "Abc, Bar")" ] && exit -1
+
+# Headers listed more than once are only used once, and "*" is an error
+[ "3:foo,5" != "$($CMD -H "Bar: foo" -V "bar, Bar,BAR")" ] && exit -1
+[ -n "$($CMD -V "Abc, *")" ] && exit -1
+
+# Vary first, followed by the Key parameters
+[ "8:gzip, br1,11" != "$($CMD -H "Accept-Encoding: gzip, br" -V "Accept-Encoding" "Accept-Encoding;substr=gzip")" ] && exit -1
+[ "nonenone,8" != "$($CMD -V "Accept" "Accept-Encoding;substr=gzip")" ] && exit -1
+
+# Too small a buffer for the value
+[ ",0" != "$($CMD -b 9 -H "Accept-Encoding: gzip, br" -V "Accept-Encoding")" ] && exit -1
+[ "8:gzip, br,10" != "$($CMD -b 10 -H "Accept-Encoding: gzip, br" -V "Accept-Encoding")" ] && exit -1
+
+# Streaming, where the Vary applies to every Key
+BLOCKS="Abc: foo\nBar: 12\n\nBar: 54\n\n"
+[ "3:foo2,6 none10,6" != "$(printf "$BLOCKS" | $CMD -s -V "Abc" "Bar;div=5" 2>/dev/null | xargs)" ] && exit -1
+
+exit 0